@@ -1,16 +1,34 @@
+#ifndef _WIN32
+    #define _POSIX_C_SOURCE 200809L
+    #define _DEFAULT_SOURCE // madvise and syscall for host calibration
+#endif
+
 #include<stdio.h>
+#include<stdarg.h>
 #include<stdlib.h>
 #include<string.h>
 #include<time.h>
 #include<stdbool.h>
+#include<errno.h>
 
-// Platform-specific macros
-#ifdef _WIN32
-    #define CLEAR_SCREEN "cls"
-    #define SLEEP(x) system("timeout /t " #x " >nul")
+#ifndef _WIN32
+    #include<fcntl.h>
+    #include<poll.h>
+    #include<signal.h>
+    #include<unistd.h>
+    #include<arpa/inet.h>
+    #include<netinet/in.h>
+    #include<sys/ioctl.h>
+    #include<sys/socket.h>
+    #include<sys/mman.h>
+    #include<pthread.h>
 #else
-    #define CLEAR_SCREEN "clear"
-    #define SLEEP(x) system("sleep " #x)
+    #define WIN32_LEAN_AND_MEAN
+    #include<windows.h>
+#endif
+#ifdef __linux__
+    #include<sys/syscall.h>
+    #include<linux/perf_event.h>
 #endif
 
 // Constants
@@ -19,6 +37,53 @@
 #define MAX_PROCESSES 5
 #define PAGE_SIZE 4  // in KB
 #define MEMORY_SIZE 64 // in KB
+#define PAGE_BYTES (PAGE_SIZE * 1024)
+#define PAGE_SHIFT 12 // log2(PAGE_BYTES)
+#define SEG_OFFSET_BITS 16 // segmented logical address = (seg_no << 16) | offset
+#define XLATE_CHUNK 4096 // requests translated per batch when streaming
+#define BUDDY_MAX_ORDER 24 // largest buddy arena is 2^24 units
+#define SNAPSHOT_MAGIC 0x53564d4d // "MMVS"
+#define SNAPSHOT_VERSION 5
+#define MAX_SCENARIOS 16
+#define SWAP_DEFAULT_SLOTS 256
+#define MAX_NUMA_NODES 8
+#define TRACE_LINE_MAX 1024
+#define SWEEP_BLOCK 4096          // references each frame count consumes before the next takes over
+#define SWEEP_MAX_FRAMES 512
+#define SWEEP_MAX_THREADS 16
+#define SHARDS_MODULUS (1ULL << 24) // hash space the sampling threshold is compared against
+#define SHARDS_BUCKETS 1024         // miss-ratio curve resolution
+#define LATENCY_SUB_BITS 5  // 32 linear sub-buckets per power of two, so values are kept to within 3%
+#define LATENCY_MAX_BITS 40 // latencies up to 2^40 ns; longer ones land in the top bucket
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+#define HOST_PROFILE_PATH "host_profile.txt"
+#define CALIBRATION_LINE 64          // bytes between pointer-chase elements
+#define CALIBRATION_LOADS (1 << 20)  // timed dependent loads per working-set size
+#define CALIBRATION_MAX_MB 128
+#define CALIBRATION_POINTS 48
+#define TERM_MAX_ROWS 200
+#define TERM_MAX_COLS 160
+#define CACHE_LEVELS 3 // L1, L2, last-level cache
+#define SWAP_CLUSTER 16 // slots handed out sequentially before looking for a new free cluster
+#define EVENT_MAGIC 0x56454d4d // "MMEV"
+#define EVENT_VERSION 2 // 2: frame widened to 32 bits
+#define EVENT_BUFFER_SIZE (64 * 1024)
+#define MAX_STREAM_REFS 10000000 // reference strings allowed when not displaying each step
+#define KERNEL_MAX_PAGES 100000 // pages the replacement kernels' direct-mapped lookup table can cover
+#define SERVER_DEFAULT_PORT 8765
+#define SERVER_MAX_CLIENTS 256
+#define SERVER_MAX_REQUEST (8 * 1024 * 1024)
+#define SERVER_MAX_FRAMES 4096
+#define SERVER_MAX_REFS 1000000
+#define SERVER_MAX_WORK 1000000000LL // engine steps one request may cost before it is refused with 413
+
+// Batch translation result flags
+#define XLATE_OK          0x00
+#define XLATE_PAGE_FAULT  0x01
+#define XLATE_BOUNDS      0x02
+#define XLATE_BAD_PAGE    0x04
+#define XLATE_BAD_SEGMENT 0x08
+#define XLATE_BAD_PID     0x10
 
 // ANSI color codes for better visualization
 #define COLOR_RED     "\x1b[31m"
@@ -37,6 +102,9 @@ typedef struct {
     int last_used;
     int reference_bit;
     int modify_bit;
+    int swap_slot; // slot holding a copy of the page in swap, -1 if none
+    int cow;       // copy-on-write share group since fork or merge (0 = private); copied on first write
+    unsigned int content; // hash of the page's data; a store changes it
 } PageTableEntry;
 
 typedef struct {
@@ -44,6 +112,7 @@ typedef struct {
     int base;
     int limit;
     int valid;
+    int page_base; // first page of this segment when segments are paged
 } SegmentTableEntry;
 
 typedef struct {
@@ -55,6 +124,8 @@ typedef struct {
     int modify_bit;
     int age_counter;
     int load_time;
+    int prefetched; // loaded speculatively and not referenced since
+    int share_count; // page table entries mapping the frame; above 1 after a copy-on-write fork
 } Frame;
 
 typedef struct {
@@ -73,6 +144,501 @@ typedef struct {
     int last_used;
 } TLBEntry;
 
+typedef struct {
+    int hit;          // page was already resident
+    int frame_no;     // frame now holding the page
+    int victim_page;  // evicted page, -1 if a free frame was used
+    int victim_pid;
+    int prefetch_hit;      // first reference to a prefetched page
+    int victim_prefetched; // evicted page had been prefetched and never used
+    int victim_dirty;      // evicted page was modified and must be written back
+    int victim_sharers;    // other copy-on-write mappings the eviction took down
+    int cow_copy;          // store to a shared page, copied into a frame of its own
+} ReferenceResult;
+
+typedef enum {
+    PREFETCH_NONE,
+    PREFETCH_SEQUENTIAL, // fixed window after every demand fault
+    PREFETCH_ADAPTIVE,   // window doubles on readahead hits, restarts on a random fault
+    PREFETCH_STRIDE      // repeats a stride once it has been seen twice in a row
+} PrefetchPolicy;
+
+typedef struct {
+    PrefetchPolicy policy;
+    int window;      // pages per trigger (starting window for adaptive)
+    int max_window;
+    int page_space;  // pages that exist; prefetches past the end are dropped
+    // Adaptive and stride detector state
+    int cur_window;
+    int ra_end;      // last page read ahead so far
+    int ra_marker;   // using this prefetched page triggers the next window
+    int last_page;
+    int last_stride;
+    int stride_hits;
+} Prefetcher;
+
+typedef struct {
+    long demand_faults;
+    long issued;           // speculative loads performed
+    long redundant;        // candidates that were already resident
+    long useful;           // prefetched pages referenced before eviction
+    long unused_evicted;   // prefetched pages evicted without being referenced
+    long evictions;        // pages evicted to make room for prefetches
+    long pollution_faults; // demand faults on pages a prefetch had evicted
+} PrefetchStats;
+
+typedef struct {
+    int hits;
+    int faults;
+    int *frame_pages; // optional, frames entries: page held by each frame at the end (-1 if empty)
+} KernelResult;
+
+typedef struct {
+    int algo_choice;   // 1 = FIFO, 4 = Clock
+    const int *refs;   // pages already rebased to 0..page_span-1
+    int length;
+    int page_span;
+    int min_frames;
+    int first;         // this worker runs frame counts min_frames + first, + stride, ...
+    int stride;
+    int max_frames;
+    int *faults;       // faults[frames - min_frames]
+    int ok;
+} FrameSweepJob;
+
+typedef struct {
+    unsigned long long page;
+    unsigned long long hash;     // spatial hash, masked to SHARDS_MODULUS
+    int time;                    // position in the Fenwick tree, -1 while unused
+} ShardsEntry;
+
+typedef struct {
+    int max_samples;             // pages tracked at once; the sampler never grows past this
+    unsigned long long threshold; // a page is sampled when hash < threshold; rate = threshold / modulus
+    ShardsEntry *entries;        // max_samples + 1 slots
+    int *free_slots;
+    int free_count;
+    int *map;                    // open addressing page -> entry, 2 * max_samples rounded up to a power of two
+    int map_mask;
+    int *heap;                   // max-heap of entries by hash, evicted when the sample is full
+    int heap_size;
+    int *fenwick;                // live entries by last-access time (1-based tree)
+    int *time_owner;             // time -> entry or -1
+    int time_capacity;
+    int clock;
+    int live;
+    double bucket_width;         // pages of cache per histogram bucket
+    double *histogram;           // SHARDS_BUCKETS + 1 (last = beyond the curve)
+    double cold;                 // first-touch misses
+    long long references;        // every reference offered, sampled or not
+    long long sampled_refs;
+    long long sampled_pages;     // distinct pages that ever entered the sample
+    int rate_drops;
+} ShardsSampler;
+
+typedef struct {
+    int frames_copied;   // frames an eager fork had to fill
+    int fork_evictions;  // pages evicted to make room for those copies
+    int shared_frames;   // frames mapped by both parent and child afterwards
+} ForkStats;
+
+typedef struct {
+    int pages_per_scan;  // frames examined each time the scanner wakes
+    int scan_interval;   // references between wake-ups
+    double checksum_ns;  // hashing a page to see whether it is still changing
+    double compare_ns;   // comparing a page with a tree candidate
+    double merge_ns;     // remapping a duplicate and freeing its frame
+} KsmConfig;
+
+typedef struct {
+    unsigned int *keys;  // content hash
+    int *frames;         // frame holding that content, -1 = empty slot
+    int capacity;        // power of two
+    int count;
+} KsmIndex;
+
+typedef struct {
+    KsmConfig cfg;
+    KsmIndex stable;     // merged frames by content
+    KsmIndex unstable;   // pages unchanged since the last pass, rebuilt every pass
+    unsigned int *last_checksum; // per frame, content seen on the previous pass
+    unsigned char *seen;
+    int cursor;
+    long scanned;
+    long compares;
+    long merges;
+    long stable_merges;  // merged into an existing stable page
+    long volatile_skips; // changed since the last pass, not yet a candidate
+    long passes;
+    double cpu_ns;
+} KsmScanner;
+
+typedef struct {
+    int window;             // references between load-control decisions
+    int ws_window;          // working-set window, in the process's own references
+    double high_fault_rate; // faults per reference above which memory is overcommitted
+    double low_fault_rate;  // below this a suspended process may come back
+} LoadControlConfig;
+
+typedef struct {
+    long useful_refs;   // references completed
+    long ticks;         // elapsed time: 1 per reference, the paging device adds fault service time
+    long cpu_busy;
+    long faults;
+    int suspensions;
+    int resumptions;
+    double avg_active;  // processes admitted to memory, averaged over time
+} LoadControlStats;
+
+typedef struct {
+    long long counts[LATENCY_BUCKETS];
+    long long total;
+    unsigned long long min;
+    unsigned long long max;
+    double sum;
+} LatencyHistogram; // log-linear (HDR-style) histogram of ns latencies; all zeroes is empty
+
+typedef enum {
+    ACCESS_TLB_HIT,
+    ACCESS_WALK,      // TLB miss, page resident
+    ACCESS_FAULT,     // page read in
+    ACCESS_WRITEBACK, // page read in after writing back a dirty victim
+    ACCESS_KINDS
+} AccessKind;
+
+typedef struct {
+    double tlb_ns;
+    double walk_ns;
+    double fault_ns;
+    double writeback_ns;
+} AccessCostModel;
+
+typedef struct {
+    int valid;
+    long l1_kb;            // largest working set measured at each level's latency
+    long l2_kb;
+    long llc_kb;
+    double l1_ns;          // dependent load latency at each level
+    double l2_ns;
+    double llc_ns;
+    double dram_ns;
+    double tlb_miss_ns;    // extra latency of a load whose translation misses the TLB
+    double tlb_miss_rate;  // dTLB misses per probe load from perf counters, 0 if unavailable
+    int page_kb;
+    int huge_pages;        // cache probes ran on transparent huge pages
+} HostProfile;
+
+typedef enum {
+    TERM_DEFAULT,
+    TERM_RED,
+    TERM_GREEN,
+    TERM_YELLOW,
+    TERM_BLUE,
+    TERM_MAGENTA,
+    TERM_CYAN
+} TermColor;
+
+typedef struct {
+    char ch;
+    unsigned char color; // TermColor
+} TermCell;
+
+typedef struct {
+    TermCell shown[TERM_MAX_ROWS][TERM_MAX_COLS]; // what the terminal displays
+    TermCell next[TERM_MAX_ROWS][TERM_MAX_COLS];  // frame being drawn
+    int rows;           // terminal size, clipped to the grid
+    int cols;
+    int used_rows;      // rows drawn in the last frame
+    int synced;         // shown matches the terminal; cleared by anything printed outside the grid
+    long frames;
+    long cells_drawn;   // cells rewritten by term_present
+} TermScreen;
+
+typedef enum {
+    PLACE_FIRST_FREE, // lowest-numbered free frame
+    PLACE_COLORED     // free frame of the page's cache colour, so a process spreads over all of them
+} FramePlacement;
+
+typedef struct {
+    int size_kb;
+    int ways;
+    int line_bytes;
+} CacheConfig;
+
+typedef struct {
+    CacheConfig cfg;
+    int sets;
+    int line_shift;            // log2(line_bytes)
+    unsigned long long *lines; // sets * ways line numbers, most recently used first in each set; ~0 = empty
+    long accesses;
+    long misses;
+} CacheLevel; // physically indexed, physically tagged, LRU within a set
+
+typedef struct {
+    CacheLevel level[CACHE_LEVELS];
+} CacheHierarchy;
+
+typedef struct {
+    long accesses[CACHE_LEVELS];
+    long misses[CACHE_LEVELS];
+    double avg_ns;       // mean load latency from the level each access hit in
+    int colors;
+    int max_per_color;   // most working-set frames sharing one colour
+    int min_per_color;
+} CachePlacementStats;
+
+typedef enum {
+    TRACE_LACKEY, // valgrind --tool=lackey --trace-mem=yes: "I  0400d7d4,8", " L 1ffefffcf8,8"
+    TRACE_PERF,   // perf script with an addr field, or perf mem report -D
+    TRACE_PLAIN   // "R 0x7ffd1234" / "W 7ffd1234"
+} TraceFormat;
+
+typedef struct {
+    unsigned long long *keys;
+    int *ids;
+    int capacity; // power of two, keys[i] valid where ids[i] >= 0
+    int count;
+} PageFoldMap; // 64-bit page numbers -> dense int page ids in first-seen order
+
+typedef struct {
+    long lines;
+    long references;
+    long skipped;       // lines that are not memory accesses
+    long reads;
+    long writes;
+    long instructions;  // Lackey instruction fetches, replayed only on request
+    long tlb_hits;
+    long tlb_misses;
+    long writebacks;    // evicted pages that a traced store had dirtied
+    LatencyHistogram latency[ACCESS_KINDS]; // per access, priced with trace_access_costs
+    long faults;
+    long hits;
+    int distinct_pages;
+} TraceStats;
+
+typedef enum {
+    NUMA_FIRST_TOUCH, // node of the CPU the process runs on when it faults
+    NUMA_INTERLEAVE,  // pages spread round-robin over the nodes by page number
+    NUMA_PREFERRED    // the process's home node wherever it runs
+} NumaPlacement;
+
+typedef struct {
+    int node_count;
+    int latency_ns[MAX_NUMA_NODES][MAX_NUMA_NODES]; // [cpu node][memory node]
+    int home_node[MAX_PROCESSES];
+    NumaPlacement placement;
+    int migrate;          // sampling-driven page migration
+    int sample_interval;  // every Nth reference of a process is sampled
+    int sched_interval;   // references between scheduler moves of a process, 0 = never
+    double migrate_ns;    // cost of copying one page between nodes
+} NumaConfig;
+
+typedef struct {
+    long accesses;
+    long remote;
+    long faults;
+    long samples;
+    long migrations;      // pages moved between nodes
+    double latency_ns;    // sum of access latencies
+    double migration_ns;  // sum of migration copy costs
+} NumaStats;
+
+typedef struct {
+    int slot_count;
+    unsigned char *slot_used;
+    int used;
+    int cluster_next;      // next slot to try in the current allocation cluster
+    int cluster_end;
+    int last_out_slot;
+    long swap_ins;
+    long swap_outs;
+    long sequential_outs;  // swap-outs written to the slot after the previous one
+    long clean_evictions;  // evictions that needed no write
+    long scattered_allocs; // allocations made outside a free cluster
+    long dropped;          // dirty pages evicted while swap was full
+} SwapArea;
+
+typedef struct {
+    double latency_us;    // access latency per request, overlapped up to queue_depth
+    double bandwidth_mbs; // transfer rate shared by all requests
+    int queue_depth;      // requests the device services at once
+} BackingStoreModel;
+
+typedef enum {
+    IO_EV_CPU_DONE, // a process's run on the CPU ended (fault, quantum or finish)
+    IO_EV_IO_DONE   // the device completed a page read or write-back
+} IoEventType;
+
+typedef struct {
+    double time;      // ns
+    IoEventType type;
+    int proc;         // process index, -1 for a write-back
+    int faulted;      // CPU_DONE: the run ended in a page fault
+    double submitted; // IO_DONE: when the request was queued
+} IoEvent;
+
+typedef struct {
+    long references;
+    long faults;
+    long writebacks;
+    double makespan_ns;
+    double cpu_busy_ns;
+    double mean_wait_ns;   // time reads spent queued before the device took them
+    LatencyHistogram fault_latency; // fault to page-ready
+    int max_queued;
+} BackingStoreResults;
+
+typedef enum {
+    XLATE_PAGING,
+    XLATE_SEGMENTATION,
+    XLATE_SEGMENTED_PAGING
+} TranslationMode;
+
+typedef enum {
+    FIT_FIRST,
+    FIT_BEST,
+    FIT_WORST,
+    FIT_NEXT,
+    FIT_BUDDY
+} AllocPolicy;
+
+typedef struct {
+    int start;
+    int size;
+} MemoryBlock; // a hole or an allocated block, in KB units
+
+typedef struct {
+    AllocPolicy policy;
+    int total_size;
+    int used;
+    // Fit policies: holes ordered by start address
+    MemoryBlock *holes;
+    int hole_count;
+    int hole_capacity;
+    int next_fit_index;
+    // Buddy: one free list per order, linked through the block start unit
+    int max_order;
+    int buddy_heads[BUDDY_MAX_ORDER + 1];
+    int *buddy_next;
+    int *buddy_prev;
+    signed char *buddy_free_order; // order of the free block starting here, -1 otherwise
+    int buddy_free_blocks;
+} PhysicalAllocator;
+
+typedef enum {
+    COMPACT_NONE,
+    COMPACT_FULL,
+    COMPACT_INCREMENTAL,
+    COMPACT_PARTIAL
+} CompactionStrategy;
+
+typedef struct {
+    int start;
+    int size;
+    int *owner;  // table field holding the block's base address
+    int fixups;  // table entries rewritten when the block moves
+} CompactionBlock;
+
+typedef struct {
+    double copy_ns_per_kb; // cost of copying 1 KB of block contents
+    double fixup_ns;       // cost of rewriting one page/segment table entry
+} CompactionCostModel;
+
+typedef struct {
+    long runs;
+    long blocks_moved;
+    long bytes_copied;
+    long fixups;
+    double cost_ns;
+} CompactionStats;
+
+typedef struct {
+    int refs;
+    size_t size;
+    unsigned char data[];
+} SharedChunk; // reference-counted, copied only when a sharer writes to it
+
+typedef struct {
+    int frame_count;
+    int process_count;
+    int time_counter;
+    int page_faults;
+    int page_hits;
+    int fifo_index;
+    int clock_hand;
+    int tlb_size;
+    int seg_policy;
+    int seg_total;
+    int seg_used;
+    int seg_next_fit;
+    int swap_slots;
+    int swap_next;
+    int swap_end;
+    int swap_last_out;
+    long swap_ins;
+    long swap_outs;
+    long swap_sequential;
+    long swap_clean;
+    long swap_scattered;
+    long swap_dropped;
+} SimCounters;
+
+typedef struct {
+    SimCounters counters;
+    SharedChunk *frames;                   // physical_memory
+    SharedChunk *procs[MAX_PROCESSES];     // processes[]
+    SharedChunk *tlb_chunk;                // tlb[]
+    SharedChunk *holes;                    // segment_allocator hole list
+} SimState;
+
+typedef enum {
+    EV_HIT,
+    EV_FAULT,
+    EV_EVICT,
+    EV_TLB_HIT,
+    EV_TLB_MISS
+} EventType;
+
+typedef enum {
+    OUTPUT_DISPLAY, // coloured step-by-step tables
+    OUTPUT_NDJSON,
+    OUTPUT_BINARY,
+    OUTPUT_QUIET    // counters only, no per-event work
+} OutputMode;
+
+typedef struct {
+    unsigned char type;
+    unsigned char pid;
+    unsigned short reserved; // zero
+    int step;
+    int page;
+    int frame;
+} SimEvent; // 16-byte record, written as-is in binary mode
+
+typedef struct {
+    OutputMode mode;
+    FILE *out;
+    char *buffer;
+    size_t used;
+    long events;
+    int failed; // a write or the close failed, so the stream is incomplete
+} EventWriter;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} TextBuffer; // growable byte buffer for requests and responses
+
+typedef struct {
+    int fd;
+    TextBuffer request;
+    TextBuffer response;
+    size_t sent;
+    int writing;
+    char origin[128]; // Origin header of the request, empty if none or not allowed
+} ServerClient;
+
 // Global variables
 Frame *physical_memory = NULL;
 Process processes[MAX_PROCESSES];
@@ -85,6 +651,17 @@ int fifo_index = 0;
 int clock_hand = 0;
 TLBEntry tlb[32];
 int tlb_size = 4;
+PhysicalAllocator segment_allocator; // places segments in the MEMORY_SIZE KB space
+CompactionCostModel compaction_cost = {100.0, 50.0}; // ~10 GB/s copy, 50 ns per fix-up
+EventWriter event_writer = {OUTPUT_DISPLAY, NULL, NULL, 0, 0, 0};
+SwapArea swap_area;
+AccessCostModel trace_access_costs = {10.0, 100.0, 100000.0, 100000.0}; // 100 us SSD read or write
+HostProfile host_profile; // calibrated latencies, loaded from HOST_PROFILE_PATH at start-up
+TermScreen term_screen;
+int animation_ms = 500; // delay between animated steps
+const char *server_ui_origin = NULL; // extra browser origin the server answers, from --server PORT ORIGIN
+FramePlacement frame_placement = PLACE_FIRST_FREE; // set only while run_cache_placement runs; FIFO and the kernels assume first free
+int page_colors = 1; // LLC set span in pages: frames congruent modulo this share cache sets
 
 
 
@@ -98,21 +675,171 @@ void display_memory();
 void display_page_tables();
 void display_segment_tables();
 void generate_page_reference_string(int *ref_string, int length);
+void fill_reference_string(int *ref_string, int length, int page_count);
+void reset_replacement_state();
+ReferenceResult reference_page(int algo_choice, int process_index, int page_no,
+                               const int *ref_string, int ref_length, int index);
+ReferenceResult prefetch_page(int algo_choice, int process_index, int page_no,
+                              const int *ref_string, int ref_length, int index);
+ReferenceResult write_page(int algo_choice, int process_index, int page_no,
+                           const int *ref_string, int ref_length, int index);
 int fifo_replacement();
 int lru_replacement();
-int optimal_replacement(int *future_refs, int ref_count, int current_index);
+int optimal_replacement(const int *future_refs, int ref_count, int current_index);
 int clock_replacement();
 int get_free_frame();
-void visualize_page_fault(int page_no, int frame_no, const char *algorithm);
+int get_colored_frame(int pid, int page_no);
 void setup_memory_frames();
 void add_new_process();
 void clear_input_buffer();
+void read_word(char *buf, size_t size, const char *fallback);
 void display_header(const char *title);
 void simulate_tlb_system();
 void display_tlb(int hit_page);
 int search_tlb(int page_no);
 void update_tlb(int page_no, int frame_no, int current_time);
 void init_tlb();
+double get_time_seconds();
+void display_advanced_menu();
+void advanced_tools_menu();
+void translate_batch(TranslationMode mode, const int *pids, const int *logical_addrs,
+                     int count, int *physical_addrs, unsigned char *flags);
+long translate_stream(TranslationMode mode, FILE *in, FILE *out, long *skipped);
+void simulate_batch_translation();
+int allocator_init(PhysicalAllocator *a, AllocPolicy policy, int total_size);
+void allocator_destroy(PhysicalAllocator *a);
+int allocator_alloc(PhysicalAllocator *a, int size);
+void allocator_free(PhysicalAllocator *a, int start, int size);
+int allocator_largest_hole(const PhysicalAllocator *a);
+int allocator_hole_count(const PhysicalAllocator *a);
+float allocator_fragmentation(const PhysicalAllocator *a);
+int place_segment(SegmentTableEntry *seg);
+void display_segment_memory_map();
+void generate_churn_trace(int *op_size, int *op_target, int *live, int op_count,
+                          int arena, int max_request);
+void simulate_allocator_churn();
+void physical_allocator_menu();
+int allocator_rebuild_holes(PhysicalAllocator *a, const CompactionBlock *blocks, int count);
+int compact_allocator(PhysicalAllocator *a, CompactionBlock *blocks, int count, int min_hole,
+                      int max_moves, const CompactionCostModel *model, CompactionStats *stats);
+int compact_segments(CompactionStats *stats);
+int compact_frames(const CompactionCostModel *model, CompactionStats *stats);
+void display_compaction_stats(const CompactionStats *stats);
+void simulate_compaction_churn();
+void compaction_menu();
+int resize_frames(int new_count);
+int sim_state_capture(SimState *state);
+void sim_state_fork(const SimState *parent, SimState *child);
+int sim_state_activate(const SimState *state);
+int sim_state_restore(SimState *state);
+int sim_state_commit(SimState *state);
+void sim_state_release(SimState *state);
+int sim_state_save(const SimState *state, const char *path);
+int sim_state_load(SimState *state, const char *path);
+void simulate_what_if_scenarios();
+void snapshot_menu();
+OutputMode prompt_output_mode();
+int event_writer_open(OutputMode mode, const char *path);
+void event_writer_flush();
+int event_writer_close();
+void emit_event(EventType type, int step, int pid, int page, int frame);
+void emit_reference_events(int step, int pid, int page_no, const ReferenceResult *r);
+void render_replacement_step(int step, int total, int page_no, const ReferenceResult *r, const char *algorithm);
+int tb_reserve(TextBuffer *tb, size_t extra);
+int tb_append(TextBuffer *tb, const char *data, size_t len);
+int tb_printf(TextBuffer *tb, const char *fmt, ...);
+void tb_free(TextBuffer *tb);
+int run_policy(int algo_choice, int frames, const int *refs, int ref_length, int *hits, int *faults);
+int run_simulation_server(int port);
+void generate_prefetch_trace(int *refs, int length, int page_space, int pattern);
+void prefetch_on_reference(Prefetcher *pf, PrefetchStats *stats, int algo_choice, int page_no,
+                           const ReferenceResult *r, const int *refs, int length, int index,
+                           unsigned char *polluted);
+void run_prefetch_simulation(int algo_choice, Prefetcher *pf, const int *refs, int length,
+                             PrefetchStats *stats);
+void simulate_prefetching();
+int run_backing_store_simulation(int algo_choice, int nproc, int **refs, int length,
+                                 const BackingStoreModel *dev, double cpu_ns, int quantum,
+                                 BackingStoreResults *out);
+void simulate_backing_store();
+int swap_init(SwapArea *s, int slot_count);
+void swap_destroy(SwapArea *s);
+void swap_reset(SwapArea *s);
+void swap_rebuild(SwapArea *s);
+int swap_alloc_slot(SwapArea *s);
+void swap_free_slot(SwapArea *s, int slot);
+void swap_evict(SwapArea *s, PageTableEntry *pte, int dirty);
+void swap_load(SwapArea *s, PageTableEntry *pte, int dirty);
+float swap_fragmentation(const SwapArea *s);
+void display_swap_stats(const SwapArea *s);
+int numa_node_of_frame(int frame_no, int node_count);
+int run_numa_simulation(const NumaConfig *cfg, int nproc, int **refs, int length, NumaStats *stats);
+void simulate_numa();
+int run_replacement_kernel(int algo_choice, int frames, const int *refs, int length, KernelResult *out);
+void benchmark_replacement_kernels();
+int run_frame_sweep(int algo_choice, const int *refs, int length, int min_frames, int max_frames,
+                    int threads, int *faults);
+void detect_belady_anomaly();
+int shards_init(ShardsSampler *s, int max_samples, double initial_rate, long max_cache);
+void shards_free(ShardsSampler *s);
+void shards_access(ShardsSampler *s, unsigned long long page);
+double shards_rate(const ShardsSampler *s);
+double shards_miss_ratio(const ShardsSampler *s, long cache_pages);
+size_t shards_memory(const ShardsSampler *s);
+void simulate_shards_mrc();
+int fork_process(int parent_index, int copy_on_write, int algo_choice, ForkStats *stats);
+int frames_saved_by_sharing();
+void simulate_cow_fork();
+void fork_menu();
+int ksm_init(KsmScanner *k, const KsmConfig *cfg);
+void ksm_free(KsmScanner *k);
+int ksm_merge_frames(int keep, int dup);
+void ksm_scan(KsmScanner *k);
+void simulate_ksm();
+int swap_out_process(int process_index, int *dirty_pages);
+int working_set_size(const int *last_ref, int page_count, int virtual_time, int window);
+void run_load_control(int nproc, int pages, int locality, int refs_per_process, int fault_service,
+                      const LoadControlConfig *cfg, LoadControlStats *out);
+void simulate_load_control();
+void latency_record(LatencyHistogram *h, unsigned long long ns);
+void latency_merge(LatencyHistogram *dst, const LatencyHistogram *src);
+unsigned long long latency_percentile(const LatencyHistogram *h, double percentile);
+double latency_mean(const LatencyHistogram *h);
+unsigned long long access_latency(const AccessCostModel *costs, AccessKind kind);
+void display_latency_header(const char *first_column);
+void display_latency_row(const char *label, const LatencyHistogram *h);
+void display_access_latencies(const LatencyHistogram latency[ACCESS_KINDS]);
+int calibrate_host(HostProfile *profile, int verbose);
+int save_host_profile(const char *path, const HostProfile *profile);
+int load_host_profile(const char *path, HostProfile *profile);
+void apply_host_profile(const HostProfile *profile);
+void display_host_profile(const HostProfile *profile);
+void simulate_host_calibration();
+int run_calibration_cli(int argc, char *argv[]);
+void term_clear();
+void term_sleep_ms(int ms);
+void term_begin_frame();
+void term_print(int row, int col, TermColor color, const char *format, ...);
+void term_present();
+void term_end_frames();
+void render_replacement_frame(int step, int total, int page_no, const ReferenceResult *r, const char *algorithm);
+void display_settings_menu();
+int cache_init(CacheHierarchy *c, const CacheConfig cfg[CACHE_LEVELS]);
+void cache_free(CacheHierarchy *c);
+int cache_access(CacheHierarchy *c, unsigned long long paddr);
+int cache_page_colors(const CacheConfig *llc);
+int run_cache_placement(FramePlacement placement, const CacheConfig cfg[CACHE_LEVELS], int nproc, int pages,
+                        long accesses, CachePlacementStats *out);
+void simulate_cache_coloring();
+int fold_map_init(PageFoldMap *m, int capacity);
+void fold_map_free(PageFoldMap *m);
+int fold_page(PageFoldMap *m, unsigned long long page);
+int parse_trace_line(TraceFormat format, const char *line, unsigned long long *addr, char *op);
+int replay_trace(FILE *in, TraceFormat format, int page_shift, int algo_choice, int with_instructions,
+                 TraceStats *stats);
+void display_trace_stats(const TraceStats *stats, double elapsed);
+void simulate_trace_replay();
+int run_trace_replay_cli(int argc, char *argv[]);
 
 
 // Function implementations
@@ -121,6 +848,23 @@ void clear_input_buffer() {
     while ((c = getchar()) != '\n' && c != EOF);
 }
 
+// Reads the first word of a line; a blank line (just Enter) gives fallback
+void read_word(char *buf, size_t size, const char *fallback) {
+    char line[256];
+    if (fgets(line, sizeof(line), stdin) == NULL) line[0] = '\0';
+    else if (strchr(line, '\n') == NULL) clear_input_buffer();
+    
+    char *start = line + strspn(line, " \t\r\n");
+    size_t len = strcspn(start, " \t\r\n");
+    if (len == 0) {
+        snprintf(buf, size, "%s", fallback);
+        return;
+    }
+    if (len >= size) len = size - 1;
+    memcpy(buf, start, len);
+    buf[len] = '\0';
+}
+
 void display_header(const char *title) {
     printf("\n" COLOR_CYAN "================================================================\n");
     printf("                                                                \n");
@@ -131,6 +875,9 @@ void display_header(const char *title) {
 
 void init_system() {
     srand((unsigned int)time(NULL));
+    allocator_init(&segment_allocator, FIT_FIRST, MEMORY_SIZE);
+    swap_init(&swap_area, SWAP_DEFAULT_SLOTS);
+    if (load_host_profile(HOST_PROFILE_PATH, &host_profile)) apply_host_profile(&host_profile);
     
     // Initialize processes
     process_count = 2;
@@ -148,22 +895,28 @@ void init_system() {
         processes[0].page_table[i].last_used = -1;
         processes[0].page_table[i].reference_bit = 0;
         processes[0].page_table[i].modify_bit = rand() % 2;
+        processes[0].page_table[i].swap_slot = -1;
+        processes[0].page_table[i].cow = 0;
+        processes[0].page_table[i].content = 0;
     }
     
     processes[0].seg_table[0].seg_no = 0;
-    processes[0].seg_table[0].base = 0;
     processes[0].seg_table[0].limit = 8;
     processes[0].seg_table[0].valid = 1;
+    processes[0].seg_table[0].page_base = 0;
+    place_segment(&processes[0].seg_table[0]);
     
     processes[0].seg_table[1].seg_no = 1;
-    processes[0].seg_table[1].base = 8;
     processes[0].seg_table[1].limit = 12;
     processes[0].seg_table[1].valid = 1;
+    processes[0].seg_table[1].page_base = 2;
+    place_segment(&processes[0].seg_table[1]);
     
     processes[0].seg_table[2].seg_no = 2;
-    processes[0].seg_table[2].base = 20;
     processes[0].seg_table[2].limit = 4;
     processes[0].seg_table[2].valid = 1;
+    processes[0].seg_table[2].page_base = 5;
+    place_segment(&processes[0].seg_table[2]);
     
     // Process 2
     strcpy(processes[1].name, "Process B");
@@ -178,17 +931,22 @@ void init_system() {
         processes[1].page_table[i].last_used = -1;
         processes[1].page_table[i].reference_bit = 0;
         processes[1].page_table[i].modify_bit = rand() % 2;
+        processes[1].page_table[i].swap_slot = -1;
+        processes[1].page_table[i].cow = 0;
+        processes[1].page_table[i].content = 0;
     }
     
     processes[1].seg_table[0].seg_no = 0;
-    processes[1].seg_table[0].base = 0;
     processes[1].seg_table[0].limit = 16;
     processes[1].seg_table[0].valid = 1;
+    processes[1].seg_table[0].page_base = 0;
+    place_segment(&processes[1].seg_table[0]);
     
     processes[1].seg_table[1].seg_no = 1;
-    processes[1].seg_table[1].base = 16;
     processes[1].seg_table[1].limit = 8;
     processes[1].seg_table[1].valid = 1;
+    processes[1].seg_table[1].page_base = 4;
+    place_segment(&processes[1].seg_table[1]);
 }
 
 void setup_memory_frames() {
@@ -225,6 +983,8 @@ void setup_memory_frames() {
         physical_memory[i].modify_bit = 0;
         physical_memory[i].age_counter = 0;
         physical_memory[i].load_time = -1;
+        physical_memory[i].prefetched = 0;
+        physical_memory[i].share_count = 0;
     }
     
     // Reset FIFO index and clock hand
@@ -232,11 +992,11 @@ void setup_memory_frames() {
     clock_hand = 0;
     
     printf(COLOR_GREEN "Memory initialized with %d frames\n" COLOR_RESET, frame_count);
-    SLEEP(1);
+    term_sleep_ms(1000);
 }
 
 void display_main_menu() {
-    system(CLEAR_SCREEN);
+    term_clear();
     display_header("MEMORY MANAGEMENT VISUALIZER");
     
     printf("\n" COLOR_GREEN "Main Menu:\n" COLOR_RESET);
@@ -249,7 +1009,8 @@ void display_main_menu() {
     printf(COLOR_YELLOW "7." COLOR_RESET " View Page Tables\n");
     printf(COLOR_YELLOW "8." COLOR_RESET " View Segment Tables\n");
     printf(COLOR_YELLOW "9." COLOR_RESET " Add New Process\n");
-    printf(COLOR_YELLOW "10." COLOR_RESET " Exit\n");
+    printf(COLOR_YELLOW "10." COLOR_RESET " Advanced Analysis Tools\n");
+    printf(COLOR_YELLOW "11." COLOR_RESET " Exit\n");
 
     
     printf("\n" COLOR_CYAN "Current Configuration: ");
@@ -259,7 +1020,7 @@ void display_main_menu() {
         printf("%d frames allocated\n" COLOR_RESET, frame_count);
     }
     
-    printf("\n" COLOR_CYAN "Enter your choice (1-10): " COLOR_RESET);
+    printf("\n" COLOR_CYAN "Enter your choice (1-11): " COLOR_RESET);
 
 }
 
@@ -278,7 +1039,15 @@ void display_memory() {
     for (int i = 0; i < frame_count; i++) {
         printf(COLOR_CYAN "   %2d   " COLOR_RESET, i);
         
-        if (physical_memory[i].occupied) {
+        if (physical_memory[i].occupied && physical_memory[i].share_count > 1) {
+            printf(COLOR_BLUE "   P%-3d    P%-2d      %d       %d      %3d     Shared x%d\n" COLOR_RESET,
+                   physical_memory[i].page_no,
+                   physical_memory[i].process_id,
+                   physical_memory[i].reference_bit,
+                   physical_memory[i].modify_bit,
+                   physical_memory[i].load_time,
+                   physical_memory[i].share_count);
+        } else if (physical_memory[i].occupied) {
             printf(COLOR_GREEN "   P%-3d    P%-2d      %d       %d      %3d     Used  \n" COLOR_RESET,
                    physical_memory[i].page_no,
                    physical_memory[i].process_id,
@@ -304,7 +1073,7 @@ void display_page_tables() {
     for (int p = 0; p < process_count; p++) {
         printf("\n" COLOR_CYAN "Process %d (%s) Page Table:\n" COLOR_RESET, processes[p].pid, processes[p].name);
         printf(COLOR_MAGENTA "-------------------------------------------------------------------------\n");
-        printf(COLOR_YELLOW " Page #   Valid  Frame #  Last Use  R-bit  M-bit  In Mem. \n" COLOR_RESET);
+        printf(COLOR_YELLOW " Page #   Valid  Frame #  Last Use  R-bit  M-bit  In Mem.   Swap\n" COLOR_RESET);
         printf(COLOR_MAGENTA "-------------------------------------------------------------------------\n" COLOR_RESET);
         
         for (int i = 0; i < processes[p].page_count; i++) {
@@ -323,7 +1092,8 @@ void display_page_tables() {
                     for (int f = 0; f < frame_count; f++) {
                         if (physical_memory[f].occupied && 
                             physical_memory[f].page_no == processes[p].page_table[i].page_no &&
-                            physical_memory[f].process_id == processes[p].pid) {
+                            (physical_memory[f].process_id == processes[p].pid ||
+                             (processes[p].page_table[i].cow && processes[p].page_table[i].frame_no == f))) {
                             in_memory = 1;
                             break;
                         }
@@ -331,13 +1101,20 @@ void display_page_tables() {
                 }
                 
                 if (in_memory) {
-                    printf("      Y    \n" COLOR_RESET);
+                    printf("      Y    " COLOR_RESET);
                 } else {
-                    printf(COLOR_RED "      N    \n" COLOR_RESET);
+                    printf(COLOR_RED "      N    " COLOR_RESET);
                 }
             } else {
-                printf(COLOR_RED "    N      --     ---       -      -       N    \n" COLOR_RESET);
+                printf(COLOR_RED "    N      --     ---       -      -       N    " COLOR_RESET);
             }
+            
+            if (processes[p].page_table[i].swap_slot >= 0) {
+                printf(COLOR_BLUE "%5d" COLOR_RESET, processes[p].page_table[i].swap_slot);
+            } else {
+                printf("   --");
+            }
+            printf(processes[p].page_table[i].cow ? COLOR_BLUE "  COW\n" COLOR_RESET : "\n");
         }
         printf(COLOR_MAGENTA "-------------------------------------------------------------------------\n" COLOR_RESET);
     }
@@ -352,6 +1129,11 @@ void display_segment_tables() {
         
         for (int i = 0; i < processes[p].seg_count; i++) {
             printf(COLOR_CYAN "   %2d   " COLOR_RESET, processes[p].seg_table[i].seg_no);
+            if (!processes[p].seg_table[i].valid) {
+                printf(COLOR_RED "  ----    %4d   %4dK    ----      N    (not placed)\n" COLOR_RESET,
+                       processes[p].seg_table[i].limit, processes[p].seg_table[i].limit);
+                continue;
+            }
             printf(COLOR_GREEN "  %4d    %4d   %4dK    %4d",
                    processes[p].seg_table[i].base,
                    processes[p].seg_table[i].limit,
@@ -376,7 +1158,7 @@ void simulate_paging() {
         return;
     }
     
-    system(CLEAR_SCREEN);
+    term_clear();
     display_header("PAGING SYSTEM SIMULATION");
     
     printf("\n" COLOR_YELLOW "Simulating Paging System...\n" COLOR_RESET);
@@ -421,7 +1203,7 @@ void simulate_paging() {
             printf("  " COLOR_RED "INVALID PAGE NUMBER!" COLOR_RESET " Page %d doesn't exist.\n", page_no);
         }
         
-        if (i < 2) SLEEP(2);
+        if (i < 2) term_sleep_ms(2 * animation_ms);
     }
     
     printf("\n\n" COLOR_GREEN "Paging simulation complete!\n" COLOR_RESET);
@@ -430,7 +1212,7 @@ void simulate_paging() {
 }
 
 void simulate_segmentation() {
-    system(CLEAR_SCREEN);
+    term_clear();
     display_header("SEGMENTATION SYSTEM SIMULATION");
     
     printf("\n" COLOR_YELLOW "Simulating Segmentation System...\n" COLOR_RESET);
@@ -455,6 +1237,10 @@ void simulate_segmentation() {
         printf("\n" COLOR_MAGENTA "Example %d:\n" COLOR_RESET, i+1);
         printf("  Process: %s (ID: %d)\n", processes[process_id].name, processes[process_id].pid);
         printf("  Segment Number: %d\n", seg_no);
+        if (!processes[process_id].seg_table[seg_no].valid) {
+            printf("  Access Status: " COLOR_RED "SEGMENT NOT PLACED (did not fit in memory)\n" COLOR_RESET);
+            continue;
+        }
         printf("  Segment Base: %d KB (%d bytes)\n", 
                processes[process_id].seg_table[seg_no].base,
                processes[process_id].seg_table[seg_no].base * 1024);
@@ -475,7 +1261,7 @@ void simulate_segmentation() {
                    offset, processes[process_id].seg_table[seg_no].limit * 1024);
         }
         
-        if (i < 2) SLEEP(2);
+        if (i < 2) term_sleep_ms(2 * animation_ms);
     }
     
     printf("\n\n" COLOR_GREEN "Segmentation simulation complete!\n" COLOR_RESET);
@@ -483,33 +1269,25 @@ void simulate_segmentation() {
     getchar();
 }
 
-void visualize_page_fault(int page_no, int frame_no, const char *algorithm) {
-    printf("\n" COLOR_RED "================================================================\n");
-    printf("                        PAGE FAULT OCCURRED!\n");
-    printf("================================================================\n" COLOR_RESET);
-    printf("Requested Page: " COLOR_YELLOW "P%d" COLOR_RESET "\n", page_no);
-    printf("Replacement Algorithm: " COLOR_CYAN "%s" COLOR_RESET "\n", algorithm);
-    printf("Selected Frame for Replacement: " COLOR_MAGENTA "%d" COLOR_RESET "\n", frame_no);
-    
-    if (physical_memory[frame_no].occupied) {
-        printf("Victim Page: " COLOR_RED "P%d" COLOR_RESET, physical_memory[frame_no].page_no);
-        printf(" (Process P%d)\n", physical_memory[frame_no].process_id);
-    }
-}
-
-void generate_page_reference_string(int *ref_string, int length) {
-    printf("\n" COLOR_CYAN "Generated Reference String: " COLOR_RESET);
+void fill_reference_string(int *ref_string, int length, int page_count) {
     for (int i = 0; i < length; i++) {
         // Generate references with some locality of reference
         if (i > 0 && rand() % 3 != 0) {
             // 66% chance to reference nearby pages
             ref_string[i] = (ref_string[i-1] + rand() % 3 - 1);
             if (ref_string[i] < 0) ref_string[i] = 0;
-            if (ref_string[i] >= processes[0].page_count) 
-                ref_string[i] = processes[0].page_count - 1;
+            if (ref_string[i] >= page_count) 
+                ref_string[i] = page_count - 1;
         } else {
-            ref_string[i] = rand() % processes[0].page_count;
+            ref_string[i] = rand() % page_count;
         }
+    }
+}
+
+void generate_page_reference_string(int *ref_string, int length) {
+    fill_reference_string(ref_string, length, processes[0].page_count);
+    printf("\n" COLOR_CYAN "Generated Reference String: " COLOR_RESET);
+    for (int i = 0; i < length; i++) {
         printf("%d ", ref_string[i]);
     }
     printf("\n");
@@ -524,6 +1302,21 @@ int get_free_frame() {
     return -1; // No free frame
 }
 
+// Free frame for a page under page colouring: frame f caches in the sets of
+// colour f % page_colors, so pages are given colours in turn, offset by pid so
+// processes do not all start on colour 0. Falls back to the next colour with a
+// free frame; -1 if memory is full.
+int get_colored_frame(int pid, int page_no) {
+    int want = page_no < 0 || pid < 0 ? 0 : (page_no + pid) % page_colors;
+    for (int k = 0; k < page_colors; k++) {
+        int color = (want + k) % page_colors;
+        for (int i = color; i < frame_count; i += page_colors) {
+            if (!physical_memory[i].occupied) return i;
+        }
+    }
+    return -1;
+}
+
 int fifo_replacement() {
     int selected = fifo_index;
     
@@ -561,7 +1354,7 @@ int lru_replacement() {
     return found ? lru_frame : 0;
 }
 
-int optimal_replacement(int *future_refs, int ref_count, int current_index) {
+int optimal_replacement(const int *future_refs, int ref_count, int current_index) {
     int optimal_frame = 0;
     int farthest_use = -1;
     
@@ -606,6 +1399,321 @@ int clock_replacement() {
     return clock_hand;
 }
 
+// Clears every frame, page table entry, policy cursor and counter so a new
+// reference string starts from an empty memory
+void reset_replacement_state() {
+    page_faults = 0;
+    page_hits = 0;
+    time_counter = 0;
+    fifo_index = 0;
+    clock_hand = 0;
+    
+    for (int p = 0; p < process_count; p++) {
+        for (int i = 0; i < processes[p].page_count; i++) {
+            processes[p].page_table[i].valid = 0;
+            processes[p].page_table[i].frame_no = -1;
+            processes[p].page_table[i].last_used = -1;
+            processes[p].page_table[i].reference_bit = 0;
+            processes[p].page_table[i].swap_slot = -1;
+            processes[p].page_table[i].cow = 0;
+        }
+    }
+    swap_reset(&swap_area);
+    
+    for (int i = 0; i < frame_count; i++) {
+        physical_memory[i].occupied = 0;
+        physical_memory[i].page_no = -1;
+        physical_memory[i].process_id = -1;
+        physical_memory[i].reference_bit = 0;
+        physical_memory[i].load_time = -1;
+        physical_memory[i].prefetched = 0;
+        physical_memory[i].share_count = 0;
+    }
+}
+
+// Page table entry of a process's page, NULL if the page is outside its table
+static PageTableEntry *find_pte(int pid, int page_no) {
+    for (int p = 0; p < process_count; p++) {
+        if (processes[p].pid == pid) {
+            return page_no >= 0 && page_no < processes[p].page_count ? &processes[p].page_table[page_no] : NULL;
+        }
+    }
+    return NULL;
+}
+
+static int find_resident_frame(int pid, int page_no) {
+    for (int f = 0; f < frame_count; f++) {
+        if (physical_memory[f].occupied && physical_memory[f].page_no == page_no &&
+            physical_memory[f].process_id == pid) {
+            return f;
+        }
+    }
+    
+    // A shared page sits in a frame recorded under another sharer (or, after
+    // a merge, under another page number)
+    PageTableEntry *pte = find_pte(pid, page_no);
+    if (pte == NULL || !pte->cow) return -1;
+    if (pte->valid) {
+        return physical_memory[pte->frame_no].occupied ? pte->frame_no : -1;
+    }
+    
+    // Not mapped here, but another member of its share group may have brought
+    // the shared copy back in: map that frame instead of reading another copy
+    for (int p = 0; p < process_count; p++) {
+        for (int i = 0; i < processes[p].page_count; i++) {
+            PageTableEntry *other = &processes[p].page_table[i];
+            if (other != pte && other->valid && other->cow == pte->cow) {
+                pte->valid = 1;
+                pte->frame_no = other->frame_no;
+                physical_memory[other->frame_no].share_count++;
+                return other->frame_no;
+            }
+        }
+    }
+    return -1;
+}
+
+// Invalidates the copy-on-write mappings of frame f other than the one already
+// unmapped; they stay in their share group. Returns how many were taken down.
+static int unmap_frame_sharers(int f) {
+    int dropped = 0;
+    for (int p = 0; p < process_count; p++) {
+        for (int i = 0; i < processes[p].page_count; i++) {
+            PageTableEntry *pte = &processes[p].page_table[i];
+            if (pte->valid && pte->cow && pte->frame_no == f) {
+                pte->valid = 0;
+                pte->frame_no = -1;
+                dropped++;
+            }
+        }
+    }
+    return dropped;
+}
+
+// Unmaps the page held by frame r->frame_no, if any, and records it as the victim
+static void evict_frame(ReferenceResult *r) {
+    if (!physical_memory[r->frame_no].occupied) return;
+    
+    r->victim_page = physical_memory[r->frame_no].page_no;
+    r->victim_pid = physical_memory[r->frame_no].process_id;
+    r->victim_prefetched = physical_memory[r->frame_no].prefetched;
+    r->victim_dirty = physical_memory[r->frame_no].modify_bit;
+    
+    PageTableEntry *pte = find_pte(r->victim_pid, r->victim_page);
+    if (pte != NULL) {
+        pte->valid = 0;
+        pte->frame_no = -1;
+        swap_evict(&swap_area, pte, r->victim_dirty);
+    }
+    
+    // Evicting a shared frame unmaps it from every sharer; the first to touch
+    // it again reads it back and the rest of the group map that frame
+    if (physical_memory[r->frame_no].share_count > 1) {
+        r->victim_sharers = unmap_frame_sharers(r->frame_no);
+    }
+    physical_memory[r->frame_no].share_count = 0;
+}
+
+// Chooses the frame for page_no of pid, which is not resident: a free frame
+// picked by frame_placement, or a victim picked by the policy whose page is
+// then unmapped. Fills the frame and victim fields of r.
+static void select_frame(int algo_choice, int pid, int page_no, const int *ref_string, int ref_length,
+                         int index, ReferenceResult *r) {
+    r->frame_no = frame_placement == PLACE_COLORED ? get_colored_frame(pid, page_no) : get_free_frame();
+    if (r->frame_no != -1) return;
+    
+    // Need to replace a page
+    switch (algo_choice) {
+        case 1: // FIFO
+            r->frame_no = fifo_replacement();
+            break;
+        case 2: // LRU
+            r->frame_no = lru_replacement();
+            break;
+        case 3: // Optimal
+            r->frame_no = optimal_replacement(ref_string, ref_length, index + 1);
+            break;
+        case 4: // Clock
+            r->frame_no = clock_replacement();
+            break;
+        default:
+            r->frame_no = fifo_replacement();
+    }
+    
+    // Remove old page from page table
+    evict_frame(r);
+}
+
+// Performs one page reference for processes[process_index] with the given
+// algorithm (1=FIFO 2=LRU 3=Optimal 4=Clock): hit detection, victim selection,
+// eviction and page table updates. ref_string/index are only used by Optimal
+// to look ahead. Produces no output.
+ReferenceResult reference_page(int algo_choice, int process_index, int page_no,
+                               const int *ref_string, int ref_length, int index) {
+    ReferenceResult r = {0, -1, -1, -1, 0, 0, 0, 0, 0};
+    Process *proc = &processes[process_index];
+    time_counter++;
+    
+    // Check if page is in memory
+    r.frame_no = find_resident_frame(proc->pid, page_no);
+    r.hit = r.frame_no >= 0;
+    
+    if (r.hit) {
+        page_hits++;
+        
+        // Update reference bit and last used time
+        physical_memory[r.frame_no].reference_bit = 1;
+        physical_memory[r.frame_no].load_time = time_counter;
+        r.prefetch_hit = physical_memory[r.frame_no].prefetched;
+        physical_memory[r.frame_no].prefetched = 0;
+        
+        if (page_no >= 0 && page_no < proc->page_count && proc->page_table[page_no].valid) {
+            proc->page_table[page_no].last_used = time_counter;
+            proc->page_table[page_no].reference_bit = 1;
+        }
+        return r;
+    }
+    
+    page_faults++;
+    select_frame(algo_choice, proc->pid, page_no, ref_string, ref_length, index, &r);
+    
+    // Load new page
+    physical_memory[r.frame_no].occupied = 1;
+    physical_memory[r.frame_no].page_no = page_no;
+    physical_memory[r.frame_no].process_id = proc->pid;
+    physical_memory[r.frame_no].reference_bit = 1;
+    physical_memory[r.frame_no].modify_bit = rand() % 2;
+    physical_memory[r.frame_no].load_time = time_counter;
+    physical_memory[r.frame_no].prefetched = 0;
+    physical_memory[r.frame_no].share_count = 1;
+    
+    if (page_no >= 0 && page_no < proc->page_count) {
+        proc->page_table[page_no].valid = 1;
+        proc->page_table[page_no].frame_no = r.frame_no;
+        proc->page_table[page_no].last_used = time_counter;
+        proc->page_table[page_no].reference_bit = 1;
+        swap_load(&swap_area, &proc->page_table[page_no], physical_memory[r.frame_no].modify_bit);
+    }
+    return r;
+}
+
+// Loads page_no for processes[process_index] speculatively, through the same
+// replacement policy as a demand fault but without counting a fault. The page
+// enters clean, unreferenced and just older than the current reference so a
+// use-once prefetch is the first to go. Returns frame_no -1 if already resident.
+ReferenceResult prefetch_page(int algo_choice, int process_index, int page_no,
+                              const int *ref_string, int ref_length, int index) {
+    ReferenceResult r = {0, -1, -1, -1, 0, 0, 0, 0, 0};
+    Process *proc = &processes[process_index];
+    
+    if (find_resident_frame(proc->pid, page_no) >= 0) return r;
+    
+    select_frame(algo_choice, proc->pid, page_no, ref_string, ref_length, index, &r);
+    
+    physical_memory[r.frame_no].occupied = 1;
+    physical_memory[r.frame_no].page_no = page_no;
+    physical_memory[r.frame_no].process_id = proc->pid;
+    physical_memory[r.frame_no].reference_bit = 0;
+    physical_memory[r.frame_no].modify_bit = 0;
+    physical_memory[r.frame_no].load_time = time_counter - 1;
+    physical_memory[r.frame_no].prefetched = 1;
+    physical_memory[r.frame_no].share_count = 1;
+    
+    if (page_no >= 0 && page_no < proc->page_count) {
+        proc->page_table[page_no].valid = 1;
+        proc->page_table[page_no].frame_no = r.frame_no;
+        proc->page_table[page_no].reference_bit = 0;
+        swap_load(&swap_area, &proc->page_table[page_no], 0);
+    }
+    return r;
+}
+
+// Performs a store by processes[process_index] to page_no: a reference that
+// also dirties the page and changes its content hash. The first store to a
+// copy-on-write mapping of a frame that is still shared is a COW fault: the
+// writer gets a frame of its own, picked like any demand fault, and the other
+// sharers keep the original.
+ReferenceResult write_page(int algo_choice, int process_index, int page_no,
+                           const int *ref_string, int ref_length, int index) {
+    Process *proc = &processes[process_index];
+    PageTableEntry *pte = page_no >= 0 && page_no < proc->page_count ? &proc->page_table[page_no] : NULL;
+    
+    if (pte == NULL || !pte->cow) {
+        ReferenceResult r = reference_page(algo_choice, process_index, page_no, ref_string, ref_length, index);
+        physical_memory[r.frame_no].modify_bit = 1;
+        if (pte != NULL && pte->valid) {
+            pte->modify_bit = 1;
+            pte->content = pte->content * 2654435761u + (unsigned int)time_counter;
+        }
+        return r;
+    }
+    
+    if (!pte->valid) find_resident_frame(proc->pid, page_no); // maps a resident shared copy if any
+    if (!pte->valid || physical_memory[pte->frame_no].share_count <= 1) {
+        // Nobody else maps the frame (or it is not resident and the copy read
+        // in will be written at once): the page becomes private without a copy
+        if (pte->valid) {
+            physical_memory[pte->frame_no].process_id = proc->pid;
+            physical_memory[pte->frame_no].page_no = page_no;
+        }
+        pte->cow = 0;
+        ReferenceResult r = reference_page(algo_choice, process_index, page_no, ref_string, ref_length, index);
+        physical_memory[r.frame_no].modify_bit = 1;
+        pte->modify_bit = 1;
+        pte->content = pte->content * 2654435761u + (unsigned int)time_counter;
+        return r;
+    }
+    
+    // Detach the writer first so the copy can never evict its own mapping
+    int shared = pte->frame_no;
+    ReferenceResult r = {0, -1, -1, -1, 0, 0, 0, 0, 0};
+    time_counter++;
+    page_faults++;
+    r.cow_copy = 1;
+    pte->valid = 0;
+    pte->frame_no = -1;
+    pte->cow = 0;
+    physical_memory[shared].share_count--;
+    if (physical_memory[shared].process_id == proc->pid && physical_memory[shared].page_no == page_no) {
+        // Hand the frame's ownership to a remaining sharer
+        for (int p = 0; p < process_count; p++) {
+            for (int i = 0; i < processes[p].page_count; i++) {
+                PageTableEntry *other = &processes[p].page_table[i];
+                if (other->valid && other->frame_no == shared) {
+                    physical_memory[shared].process_id = processes[p].pid;
+                    physical_memory[shared].page_no = i;
+                    p = process_count;
+                    break;
+                }
+            }
+        }
+    }
+    
+    select_frame(algo_choice, proc->pid, page_no, ref_string, ref_length, index, &r);
+    
+    physical_memory[r.frame_no].occupied = 1;
+    physical_memory[r.frame_no].page_no = page_no;
+    physical_memory[r.frame_no].process_id = proc->pid;
+    physical_memory[r.frame_no].reference_bit = 1;
+    physical_memory[r.frame_no].modify_bit = 1;
+    physical_memory[r.frame_no].load_time = time_counter;
+    physical_memory[r.frame_no].prefetched = 0;
+    physical_memory[r.frame_no].share_count = 1;
+    
+    pte->valid = 1;
+    pte->frame_no = r.frame_no;
+    pte->last_used = time_counter;
+    pte->reference_bit = 1;
+    pte->modify_bit = 1;
+    pte->content = pte->content * 2654435761u + (unsigned int)time_counter;
+    // The page's swap copy belonged to the shared version
+    if (pte->swap_slot >= 0) {
+        swap_free_slot(&swap_area, pte->swap_slot);
+        pte->swap_slot = -1;
+    }
+    return r;
+}
+
 void simulate_page_replacement() {
     if (physical_memory == NULL) {
         printf(COLOR_RED "\nMemory not initialized! Please setup memory frames first.\n" COLOR_RESET);
@@ -614,7 +1722,7 @@ void simulate_page_replacement() {
         return;
     }
     
-    system(CLEAR_SCREEN);
+    term_clear();
     display_header("PAGE REPLACEMENT ALGORITHMS");
     
     printf("\n" COLOR_YELLOW "Select Page Replacement Algorithm:\n" COLOR_RESET);
@@ -638,8 +1746,21 @@ void simulate_page_replacement() {
     
     const char *algo_names[] = {"FIFO", "LRU", "Optimal", "Clock"};
     
+    OutputMode output = prompt_output_mode();
+    int animate = 0;
+    if (output == OUTPUT_DISPLAY) {
+        printf("\n" COLOR_YELLOW "Step Mode:\n" COLOR_RESET);
+        printf(COLOR_CYAN "1." COLOR_RESET " Press Enter after each reference\n");
+        printf(COLOR_CYAN "2." COLOR_RESET " Animate (%d ms per step, set in Display Settings)\n", animation_ms);
+        printf("\n" COLOR_YELLOW "Enter your choice (1-2): " COLOR_RESET);
+        if (scanf("%d", &animate) != 1) animate = 1;
+        clear_input_buffer();
+        animate = animate == 2;
+    }
+    int max_length = output == OUTPUT_DISPLAY ? (animate ? 1000 : 30) : MAX_STREAM_REFS;
+    
     // Ask for reference string length
-    printf("\n" COLOR_CYAN "Enter length of reference string (5-30): " COLOR_RESET);
+    printf("\n" COLOR_CYAN "Enter length of reference string (5-%d): " COLOR_RESET, max_length);
     int ref_length;
     if (scanf("%d", &ref_length) != 1) {
         clear_input_buffer();
@@ -648,21 +1769,27 @@ void simulate_page_replacement() {
     clear_input_buffer();
     
     if (ref_length < 5) ref_length = 5;
-    if (ref_length > 30) ref_length = 30;
+    if (ref_length > max_length) ref_length = max_length;
     
-    // Generate or input reference string
-    printf("\n" COLOR_CYAN "Generate random reference string? (y/n): " COLOR_RESET);
-    char choice;
-    choice = getchar();
-    clear_input_buffer();
+    // Generate or input reference string (long streams are always generated)
+    char choice = 'y';
+    if (output == OUTPUT_DISPLAY) {
+        printf("\n" COLOR_CYAN "Generate random reference string? (y/n): " COLOR_RESET);
+        choice = getchar();
+        clear_input_buffer();
+    }
     
     int *reference_string = (int*)malloc(ref_length * sizeof(int));
     if (reference_string == NULL) {
         printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        event_writer_close();
         return;
     }
     
-    if (choice == 'y' || choice == 'Y') {
+    if (output != OUTPUT_DISPLAY) {
+        fill_reference_string(reference_string, ref_length, processes[0].page_count);
+        printf(COLOR_CYAN "Generated %d references\n" COLOR_RESET, ref_length);
+    } else if (choice == 'y' || choice == 'Y') {
         generate_page_reference_string(reference_string, ref_length);
     } else {
         printf("\n" COLOR_CYAN "Enter %d page numbers (0-%d): \n", ref_length, processes[0].page_count - 1);
@@ -684,148 +1811,34 @@ void simulate_page_replacement() {
     }
     
     printf("\n" COLOR_CYAN "Starting %s Algorithm Simulation...\n" COLOR_RESET, algo_names[algo_choice-1]);
-    printf("Initial Memory State:\n");
-    display_memory();
     
-    // Reset statistics and counters
-    page_faults = 0;
-    page_hits = 0;
-    time_counter = 0;
-    fifo_index = 0;
-    clock_hand = 0;
-    
-    // Reset all page table entries
-    for (int p = 0; p < process_count; p++) {
-        for (int i = 0; i < processes[p].page_count; i++) {
-            processes[p].page_table[i].valid = 0;
-            processes[p].page_table[i].frame_no = -1;
-            processes[p].page_table[i].last_used = -1;
-            processes[p].page_table[i].reference_bit = 0;
-        }
-    }
-    
-    // Reset all frames
-    for (int i = 0; i < frame_count; i++) {
-        physical_memory[i].occupied = 0;
-        physical_memory[i].page_no = -1;
-        physical_memory[i].process_id = -1;
-        physical_memory[i].reference_bit = 0;
-        physical_memory[i].load_time = -1;
-    }
+    reset_replacement_state();
+    double start_time = get_time_seconds();
     
     // Simulate page references
     for (int i = 0; i < ref_length; i++) {
         int page_no = reference_string[i];
-        time_counter++;
-        
-        printf("\n" COLOR_MAGENTA "=" COLOR_RESET " Step %2d/%2d | Reference: Page %2d | Algorithm: %-7s " COLOR_MAGENTA "=" COLOR_RESET "\n", 
-               i+1, ref_length, page_no, algo_names[algo_choice-1]);
-        
-        // Check if page is in memory
-        int page_found = 0;
-        int frame_no = -1;
-        
-        for (int f = 0; f < frame_count; f++) {
-            if (physical_memory[f].occupied && physical_memory[f].page_no == page_no) {
-                page_found = 1;
-                frame_no = f;
-                break;
-            }
-        }
+        ReferenceResult r = reference_page(algo_choice, 0, page_no, reference_string, ref_length, i);
         
-        if (page_found) {
-            // Page hit
-            page_hits++;
-            printf(COLOR_GREEN "* Page HIT! " COLOR_RESET);
-            printf("Page %d found in frame %d\n", page_no, frame_no);
-            
-            // Update reference bit and last used time
-            physical_memory[frame_no].reference_bit = 1;
-            physical_memory[frame_no].load_time = time_counter;
-            
-            if (processes[0].page_table[page_no].valid) {
-                processes[0].page_table[page_no].last_used = time_counter;
-                processes[0].page_table[page_no].reference_bit = 1;
-            }
-        } else {
-            // Page fault
-            page_faults++;
-            
-            // Find frame for new page
-            int free_frame = get_free_frame();
-            
-            if (free_frame != -1) {
-                // Free frame available
-                frame_no = free_frame;
-                printf(COLOR_YELLOW "* Page FAULT! " COLOR_RESET);
-                printf("Loading page %d into free frame %d\n", page_no, frame_no);
-            } else {
-                // Need to replace a page
-                switch (algo_choice) {
-                    case 1: // FIFO
-                        frame_no = fifo_replacement();
-                        break;
-                    case 2: // LRU
-                        frame_no = lru_replacement();
-                        break;
-                    case 3: // Optimal
-                        frame_no = optimal_replacement(reference_string, ref_length, i+1);
-                        break;
-                    case 4: // Clock
-                        frame_no = clock_replacement();
-                        break;
-                    default:
-                        frame_no = fifo_replacement();
-                }
-                
-                visualize_page_fault(page_no, frame_no, algo_names[algo_choice-1]);
-                
-                // Remove old page from page table
-                if (physical_memory[frame_no].occupied) {
-                    int old_page = physical_memory[frame_no].page_no;
-                    int old_pid = physical_memory[frame_no].process_id;
-                    
-                    for (int p = 0; p < process_count; p++) {
-                        if (processes[p].pid == old_pid) {
-                            if (old_page < processes[p].page_count) {
-                                processes[p].page_table[old_page].valid = 0;
-                                processes[p].page_table[old_page].frame_no = -1;
-                            }
-                            break;
-                        }
-                    }
-                    
-                    printf("  Replaced " COLOR_RED "Page %d " COLOR_RESET, old_page);
-                    printf("with " COLOR_GREEN "Page %d " COLOR_RESET, page_no);
-                    printf("in frame %d\n", frame_no);
-                }
-            }
-            
-            // Load new page
-            physical_memory[frame_no].occupied = 1;
-            physical_memory[frame_no].page_no = page_no;
-            physical_memory[frame_no].process_id = 1; // Assume process 1
-            physical_memory[frame_no].reference_bit = 1;
-            physical_memory[frame_no].modify_bit = rand() % 2;
-            physical_memory[frame_no].load_time = time_counter;
-            
-            // Update page table for process 1
-            if (page_no < processes[0].page_count) {
-                processes[0].page_table[page_no].valid = 1;
-                processes[0].page_table[page_no].frame_no = frame_no;
-                processes[0].page_table[page_no].last_used = time_counter;
-                processes[0].page_table[page_no].reference_bit = 1;
+        if (output == OUTPUT_DISPLAY && animate) {
+            render_replacement_frame(i + 1, ref_length, page_no, &r, algo_names[algo_choice-1]);
+            term_sleep_ms(animation_ms);
+        } else if (output == OUTPUT_DISPLAY) {
+            render_replacement_step(i + 1, ref_length, page_no, &r, algo_names[algo_choice-1]);
+            if (i < ref_length - 1) {
+                printf("Press Enter for next reference...");
+                getchar();
             }
-        }
-        
-        display_memory();
-        
-        if (i < ref_length - 1) {
-            printf("\nPress Enter for next reference...");
-            getchar();
+        } else if (output != OUTPUT_QUIET) {
+            emit_reference_events(i + 1, processes[0].pid, page_no, &r);
         }
     }
     
+    double elapsed = get_time_seconds() - start_time;
+    long events_written = event_writer.events;
+    int events_ok = event_writer_close();
+    if (output == OUTPUT_DISPLAY) term_end_frames();
+    
     // Display statistics
     printf("\n" COLOR_GREEN "================================================================\n");
     printf("                     SIMULATION RESULTS\n");
@@ -837,6 +1850,12 @@ void simulate_page_replacement() {
     printf("Page Faults: %d\n", page_faults);
     printf("Hit Ratio: %.2f%%\n", (float)page_hits/ref_length*100);
     printf("Fault Ratio: %.2f%%\n", (float)page_faults/ref_length*100);
+    display_swap_stats(&swap_area);
+    if (output != OUTPUT_DISPLAY) {
+        printf("Events Written: %ld\n", events_written);
+        if (!events_ok) printf(COLOR_RED "Write error: the event file is incomplete\n" COLOR_RESET);
+        printf("Elapsed: %.4f s (%.1f ns/reference)\n", elapsed, elapsed / ref_length * 1e9);
+    }
     
     printf("\nFinal Memory State:\n");
     display_memory();
@@ -850,11 +1869,11 @@ void simulate_page_replacement() {
 void add_new_process() {
     if (process_count >= MAX_PROCESSES) {
         printf(COLOR_RED "\nCannot add more processes. Maximum limit (%d) reached.\n" COLOR_RESET, MAX_PROCESSES);
-        SLEEP(2);
+        term_sleep_ms(2000);
         return;
     }
     
-    system(CLEAR_SCREEN);
+    term_clear();
     display_header("ADD NEW PROCESS");
     
     processes[process_count].pid = process_count + 1;
@@ -897,13 +1916,15 @@ void add_new_process() {
         processes[process_count].page_table[i].last_used = -1;
         processes[process_count].page_table[i].reference_bit = 0;
         processes[process_count].page_table[i].modify_bit = rand() % 2;
+        processes[process_count].page_table[i].swap_slot = -1;
+        processes[process_count].page_table[i].cow = 0;
+        processes[process_count].page_table[i].content = 0;
     }
     
-    // Initialize segment table
-    int base = 0;
+    // Initialize segment table (each segment starts on a page boundary when paged)
+    int page_base = 0;
     for (int i = 0; i < processes[process_count].seg_count; i++) {
         processes[process_count].seg_table[i].seg_no = i;
-        processes[process_count].seg_table[i].base = base;
         printf(COLOR_CYAN "Enter size for segment %d (in KB, 1-20): ", i);
         if (scanf("%d", &processes[process_count].seg_table[i].limit) != 1) {
             processes[process_count].seg_table[i].limit = 4;
@@ -915,8 +1936,12 @@ void add_new_process() {
         if (processes[process_count].seg_table[i].limit > 20) 
             processes[process_count].seg_table[i].limit = 20;
             
-        processes[process_count].seg_table[i].valid = 1;
-        base += processes[process_count].seg_table[i].limit;
+        processes[process_count].seg_table[i].page_base = page_base;
+        if (!place_segment(&processes[process_count].seg_table[i])) {
+            printf(COLOR_RED "Segment %d does not fit: largest hole is %d KB. It is left unplaced.\n" COLOR_RESET,
+                   i, allocator_largest_hole(&segment_allocator));
+        }
+        page_base += (processes[process_count].seg_table[i].limit + PAGE_SIZE - 1) / PAGE_SIZE;
     }
     
     process_count++;
@@ -927,16 +1952,28 @@ void add_new_process() {
     getchar();
 }
 
-int main() {
+int main(int argc, char *argv[]) {
     init_system();
     
+    if (argc > 1 && strcmp(argv[1], "--server") == 0) {
+        int port = argc > 2 ? atoi(argv[2]) : SERVER_DEFAULT_PORT;
+        if (argc > 3) server_ui_origin = argv[3];
+        return run_simulation_server(port) ? 0 : 1;
+    }
+    if (argc > 1 && strcmp(argv[1], "--replay") == 0) {
+        return run_trace_replay_cli(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "--calibrate") == 0) {
+        return run_calibration_cli(argc, argv);
+    }
+    
     int choice;
     do {
         display_main_menu();
         if (scanf("%d", &choice) != 1) {
             clear_input_buffer();
             printf(COLOR_RED "Invalid input! Please enter a number.\n" COLOR_RESET);
-            SLEEP(1);
+            term_sleep_ms(1000);
             continue;
         }
         clear_input_buffer();
@@ -958,21 +1995,21 @@ int main() {
                 simulate_tlb_system();
                 break;
             case 6:
-                system(CLEAR_SCREEN);
+                term_clear();
                 display_header("MEMORY STATE");
                 display_memory();
                 printf("\nPress Enter to continue...");
                 getchar();
                 break;
             case 7:
-                system(CLEAR_SCREEN);
+                term_clear();
                 display_header("PAGE TABLES");
                 display_page_tables();
                 printf("\nPress Enter to continue...");
                 getchar();
                 break;
             case 8:
-                system(CLEAR_SCREEN);
+                term_clear();
                 display_header("SEGMENT TABLES");
                 display_segment_tables();
                 printf("\nPress Enter to continue...");
@@ -982,23 +2019,28 @@ int main() {
                 add_new_process();
                 break;
             case 10:
-                system(CLEAR_SCREEN);
+                advanced_tools_menu();
+                break;
+            case 11:
+                term_clear();
                 display_header("EXITING MEMORY MANAGEMENT VISUALIZER");
                 printf(COLOR_GREEN "\nThank you for using the Memory Management Visualizer!\n" COLOR_RESET);
                 printf(COLOR_YELLOW "Goodbye!\n\n" COLOR_RESET);
                 break;
             default:
-                printf(COLOR_RED "Invalid choice! Please enter 1-10.\n" COLOR_RESET);
+                printf(COLOR_RED "Invalid choice! Please enter 1-11.\n" COLOR_RESET);
 
-                SLEEP(1);
+                term_sleep_ms(1000);
         }
-    } while (choice != 10);
+    } while (choice != 11);
 
     
     // Clean up
     if (physical_memory != NULL) {
         free(physical_memory);
     }
+    allocator_destroy(&segment_allocator);
+    swap_destroy(&swap_area);
     
     return 0;
 }
@@ -1081,10 +2123,10 @@ void display_tlb(int hit_page) {
 }
 
 void simulate_tlb_system() {
-    system(CLEAR_SCREEN);
+    term_clear();
     display_header("TLB SIMULATION");
     
-    int hit_time, miss_time, ref_len;
+    int hit_time, miss_time, walk_time, fault_time, ref_len;
     
     // Configuration
     printf("\n" COLOR_CYAN "TLB Configuration:\n" COLOR_RESET);
@@ -1094,65 +2136,156 @@ void simulate_tlb_system() {
     if (tlb_size > 32) tlb_size = 32;
     clear_input_buffer();
     
-    printf("Enter TLB Hit Time (ns): ");
-    if (scanf("%d", &hit_time) != 1) hit_time = 10;
-    clear_input_buffer();
+    int calibrated = 0;
+    if (host_profile.valid) {
+        printf("Use calibrated host latencies (L1 %.1f ns, DRAM %.1f ns, TLB miss %.1f ns)? (1 = yes, 0 = enter): ",
+               host_profile.l1_ns, host_profile.dram_ns, host_profile.tlb_miss_ns);
+        if (scanf("%d", &calibrated) != 1) calibrated = 1;
+        clear_input_buffer();
+    }
+    
+    if (calibrated) {
+        // A TLB hit costs an L1 load and a miss adds the measured page-walk
+        // penalty; memory accesses without a TLB cost a DRAM load
+        hit_time = host_profile.l1_ns < 1 ? 1 : (int)(host_profile.l1_ns + 0.5);
+        miss_time = host_profile.dram_ns < 1 ? 1 : (int)(host_profile.dram_ns + 0.5);
+        walk_time = host_profile.tlb_miss_ns < 0 ? 0 : (int)(host_profile.tlb_miss_ns + 0.5);
+        printf("TLB Hit Time: %d ns, Memory Access Time: %d ns, Page Walk Penalty: %d ns (from %s)\n",
+               hit_time, miss_time, walk_time, HOST_PROFILE_PATH);
+    } else {
+        printf("Enter TLB Hit Time (ns): ");
+        if (scanf("%d", &hit_time) != 1) hit_time = 10;
+        clear_input_buffer();
+        
+        printf("Enter Main Memory Access Time (ns): ");
+        if (scanf("%d", &miss_time) != 1) miss_time = 100;
+        clear_input_buffer();
+        walk_time = miss_time; // a miss reads the page table from memory
+    }
     
-    printf("Enter Main Memory Access Time (ns): ");
-    if (scanf("%d", &miss_time) != 1) miss_time = 100;
+    printf("Enter Page Fault Service Time (ns, 0 = TLB only): ");
+    if (scanf("%d", &fault_time) != 1) fault_time = 0;
     clear_input_buffer();
+    if (fault_time < 0) fault_time = 0;
+    
+    // With a fault time, misses walk processes[0]'s page table and fault through LRU
+    int paging = fault_time > 0 && physical_memory != NULL && process_count > 0 && processes[0].page_count > 0;
+    if (fault_time > 0 && !paging) {
+        printf(COLOR_RED "Memory not initialized, simulating the TLB only.\n" COLOR_RESET);
+        fault_time = 0;
+    }
+    int page_range = paging ? processes[0].page_count : 10;
     
-    printf("Enter Reference String Length (5-20): ");
+    OutputMode output = prompt_output_mode();
+    
+    int max_len = output == OUTPUT_DISPLAY ? 20 : MAX_STREAM_REFS;
+    printf("Enter Reference String Length (5-%d): ", max_len);
     if (scanf("%d", &ref_len) != 1) ref_len = 10;
     clear_input_buffer();
+    if (ref_len < 5) ref_len = 5;
+    if (ref_len > max_len) ref_len = max_len;
     
     // Generate Reference String
     int *ref_string = (int*)malloc(ref_len * sizeof(int));
+    if (ref_string == NULL) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        event_writer_close();
+        return;
+    }
     srand(time(NULL));
-    printf("\n" COLOR_YELLOW "Reference String: " COLOR_RESET);
+    if (output == OUTPUT_DISPLAY) printf("\n" COLOR_YELLOW "Reference String: " COLOR_RESET);
     for (int i = 0; i < ref_len; i++) {
-        ref_string[i] = rand() % 10; // Pages 0-9
-        printf("%d ", ref_string[i]);
+        ref_string[i] = rand() % page_range;
+        if (output == OUTPUT_DISPLAY) printf("%d ", ref_string[i]);
     }
     printf("\n");
     
     // Simulation
     init_tlb();
     int tlb_hits = 0, tlb_misses = 0;
-    int total_time = 0;
+    long total_time = 0, fault_total = 0;
+    static LatencyHistogram latency[ACCESS_KINDS];
+    memset(latency, 0, sizeof(latency));
+    AccessCostModel costs = {hit_time, walk_time, fault_time, fault_time};
+    SimState user_state;
+    if (paging) {
+        if (!sim_state_capture(&user_state)) {
+            printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+            event_writer_close();
+            free(ref_string);
+            return;
+        }
+        reset_replacement_state();
+    }
     
     printf("\n" COLOR_GREEN "Starting Simulation..." COLOR_RESET "\n");
-    SLEEP(1);
+    if (output == OUTPUT_DISPLAY) term_sleep_ms(animation_ms);
     
     for (int i = 0; i < ref_len; i++) {
         int page = ref_string[i];
         int time_step = i + 1;
         int frame = page * 2 + 1; // Dummy frame mapping
         
-        printf("\n" COLOR_CYAN "Step %d: Accessing Page %d" COLOR_RESET "\n", time_step, page);
+        if (output == OUTPUT_DISPLAY) {
+            printf("\n" COLOR_CYAN "Step %d: Accessing Page %d" COLOR_RESET "\n", time_step, page);
+        }
         
         int tlb_index = search_tlb(page);
+        AccessKind kind = tlb_index != -1 ? ACCESS_TLB_HIT : ACCESS_WALK;
+        
+        if (paging) {
+            ReferenceResult r = reference_page(2, 0, page, NULL, 0, 0);
+            frame = r.frame_no;
+            if (!r.hit) {
+                kind = r.victim_dirty ? ACCESS_WRITEBACK : ACCESS_FAULT;
+                fault_total += r.victim_dirty ? 2L * fault_time : fault_time;
+                if (output == OUTPUT_DISPLAY) {
+                    printf(COLOR_RED "  -> PAGE FAULT! +%dns%s\n" COLOR_RESET, r.victim_dirty ? 2 * fault_time : fault_time,
+                           r.victim_dirty ? " (dirty victim written back)" : "");
+                }
+            }
+            // Shoot down the translation of an evicted page
+            if (r.victim_page >= 0) {
+                int stale = search_tlb(r.victim_page);
+                if (stale >= 0) tlb[stale].valid = 0;
+            }
+        }
+        latency_record(&latency[kind], access_latency(&costs, kind));
         
         if (tlb_index != -1) {
             // Hit
             tlb_hits++;
             total_time += hit_time;
-            printf(COLOR_GREEN "  -> TLB HIT! Time: %dns\n" COLOR_RESET, hit_time);
             
             // Update usage
             tlb[tlb_index].last_used = time_step;
-            display_tlb(page);
+            if (output == OUTPUT_DISPLAY) {
+                printf(COLOR_GREEN "  -> TLB HIT! Time: %dns\n" COLOR_RESET, hit_time);
+                display_tlb(page);
+            } else if (output != OUTPUT_QUIET) {
+                emit_event(EV_TLB_HIT, time_step, processes[0].pid, page, tlb[tlb_index].frame_no);
+            }
         } else {
             // Miss
             tlb_misses++;
-            total_time += (hit_time + miss_time); // TLB search + Memory access
-            printf(COLOR_RED "  -> TLB MISS! Time: %d + %d = %dns\n" COLOR_RESET, hit_time, miss_time, hit_time + miss_time);
+            total_time += (hit_time + walk_time); // TLB search + page-table walk
             
             update_tlb(page, frame, time_step);
-            display_tlb(-1);
+            if (output == OUTPUT_DISPLAY) {
+                printf(COLOR_RED "  -> TLB MISS! Time: %d + %d = %dns\n" COLOR_RESET, hit_time, walk_time, hit_time + walk_time);
+                display_tlb(-1);
+            } else if (output != OUTPUT_QUIET) {
+                emit_event(EV_TLB_MISS, time_step, processes[0].pid, page, frame);
+            }
         }
         
-        SLEEP(1);
+        if (output == OUTPUT_DISPLAY) term_sleep_ms(animation_ms);
+    }
+    long events_written = event_writer.events;
+    int events_ok = event_writer_close();
+    total_time += fault_total;
+    if (paging) {
+        sim_state_restore(&user_state);
     }
     
     // Results
@@ -1171,11 +2304,6908 @@ void simulate_tlb_system() {
     
     // Ideal vs Actual
     printf("\n" COLOR_CYAN "Performance Analysis:" COLOR_RESET "\n");
-    printf("Without TLB:     %d ns (Assuming %d ns access)\n", ref_len * miss_time, miss_time);
-    printf("With TLB:        %d ns\n", total_time);
-    printf("Speedup:         %.2fx\n", (float)(ref_len * miss_time) / total_time);
+    printf("Without TLB:     %ld ns (Assuming %d ns access)\n", (long)ref_len * miss_time + fault_total, miss_time);
+    printf("With TLB:        %ld ns\n", total_time);
+    printf("Speedup:         %.2fx\n", (float)((long)ref_len * miss_time + fault_total) / total_time);
+    if (output != OUTPUT_DISPLAY) printf("Events Written:  %ld\n", events_written);
+    if (!events_ok) printf(COLOR_RED "Write error: the event file is incomplete\n" COLOR_RESET);
+    
+    printf("\n" COLOR_CYAN "Access Latency Distribution:" COLOR_RESET "\n");
+    display_access_latencies(latency);
     
     printf("\nPress Enter to continue...");
     getchar();
     free(ref_string);
 }
+
+// Advanced Tools Function Implementations
+
+double get_time_seconds() {
+#ifdef _WIN32
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+void display_advanced_menu() {
+    term_clear();
+    display_header("ADVANCED ANALYSIS TOOLS");
+
+    printf("\n" COLOR_GREEN "Advanced Tools:\n" COLOR_RESET);
+    printf(COLOR_YELLOW "1." COLOR_RESET " Batch Address Translation\n");
+    printf(COLOR_YELLOW "2." COLOR_RESET " Physical Allocator (Fit Policies & Buddy)\n");
+    printf(COLOR_YELLOW "3." COLOR_RESET " Memory Compaction Engine\n");
+    printf(COLOR_YELLOW "4." COLOR_RESET " Snapshots & What-If Scenarios\n");
+    printf(COLOR_YELLOW "5." COLOR_RESET " Prefetch / Readahead Simulation\n");
+    printf(COLOR_YELLOW "6." COLOR_RESET " Backing Store & Overlapping Faults\n");
+    printf(COLOR_YELLOW "7." COLOR_RESET " NUMA Placement & Migration\n");
+    printf(COLOR_YELLOW "8." COLOR_RESET " Replay Profiler Trace (Lackey / perf / R-W)\n");
+    printf(COLOR_YELLOW "9." COLOR_RESET " Replacement Kernel Benchmark\n");
+    printf(COLOR_YELLOW "10." COLOR_RESET " Belady's Anomaly Detector (FIFO / Clock)\n");
+    printf(COLOR_YELLOW "11." COLOR_RESET " Sampled Miss-Ratio Curve (SHARDS)\n");
+    printf(COLOR_YELLOW "12." COLOR_RESET " Fork & Copy-on-Write\n");
+    printf(COLOR_YELLOW "13." COLOR_RESET " Same-Page Merging (KSM)\n");
+    printf(COLOR_YELLOW "14." COLOR_RESET " Thrashing & Load Control\n");
+    printf(COLOR_YELLOW "15." COLOR_RESET " Host Calibration (Cache / TLB Latency)\n");
+    printf(COLOR_YELLOW "16." COLOR_RESET " Display Settings (Animation Speed)\n");
+    printf(COLOR_YELLOW "17." COLOR_RESET " CPU Cache & Page Colouring\n");
+    printf(COLOR_YELLOW "0." COLOR_RESET " Back to Main Menu\n");
+
+    printf("\n" COLOR_CYAN "Enter your choice: " COLOR_RESET);
+}
+
+void advanced_tools_menu() {
+    int choice;
+    do {
+        display_advanced_menu();
+        if (scanf("%d", &choice) != 1) {
+            clear_input_buffer();
+            printf(COLOR_RED "Invalid input! Please enter a number.\n" COLOR_RESET);
+            term_sleep_ms(1000);
+            choice = -1;
+            continue;
+        }
+        clear_input_buffer();
+
+        switch (choice) {
+            case 0:
+                break;
+            case 1:
+                simulate_batch_translation();
+                break;
+            case 2:
+                physical_allocator_menu();
+                break;
+            case 3:
+                compaction_menu();
+                break;
+            case 4:
+                snapshot_menu();
+                break;
+            case 5:
+                simulate_prefetching();
+                break;
+            case 6:
+                simulate_backing_store();
+                break;
+            case 7:
+                simulate_numa();
+                break;
+            case 8:
+                simulate_trace_replay();
+                break;
+            case 9:
+                benchmark_replacement_kernels();
+                break;
+            case 10:
+                detect_belady_anomaly();
+                break;
+            case 11:
+                simulate_shards_mrc();
+                break;
+            case 12:
+                fork_menu();
+                break;
+            case 13:
+                simulate_ksm();
+                break;
+            case 14:
+                simulate_load_control();
+                break;
+            case 15:
+                simulate_host_calibration();
+                break;
+            case 16:
+                display_settings_menu();
+                break;
+            case 17:
+                simulate_cache_coloring();
+                break;
+            default:
+                printf(COLOR_RED "Invalid choice!\n" COLOR_RESET);
+                term_sleep_ms(1000);
+        }
+    } while (choice != 0);
+}
+
+// Batch Address Translation Function Implementations
+
+// Translates count (pid, logical address) pairs in one pass. The page tables and
+// segment tables are first flattened into small lookup arrays so the main loop has
+// no data-dependent branches: the page/offset split is a shift and a mask, bounds
+// checks become flag arithmetic, and invalid inputs are clamped to a safe slot
+// instead of skipped. This lets the compiler vectorize the loop.
+//
+// Logical address formats:
+//   XLATE_PAGING            - byte address in the process's paged space
+//   XLATE_SEGMENTATION      - (seg_no << SEG_OFFSET_BITS) | offset, physical = base + offset
+//   XLATE_SEGMENTED_PAGING  - same encoding, offset is then paged from seg.page_base
+void translate_batch(TranslationMode mode, const int *pids, const int *logical_addrs,
+                     int count, int *physical_addrs, unsigned char *flags) {
+    int pid_slot[MAX_PROCESSES + 1];
+    int page_limit[MAX_PROCESSES];
+    int frame_lut[MAX_PROCESSES * MAX_PAGES];
+    int seg_count_lut[MAX_PROCESSES];
+    int seg_base[MAX_PROCESSES * MAX_SEGMENTS];
+    int seg_limit[MAX_PROCESSES * MAX_SEGMENTS];
+    int seg_page_base[MAX_PROCESSES * MAX_SEGMENTS];
+
+    // Flatten the tables (-1 frame = page not resident)
+    for (int i = 0; i <= MAX_PROCESSES; i++) pid_slot[i] = -1;
+    for (int p = 0; p < MAX_PROCESSES; p++) {
+        int active = p < process_count;
+        page_limit[p] = active ? processes[p].page_count : 0;
+        seg_count_lut[p] = active ? processes[p].seg_count : 0;
+        if (active && processes[p].pid >= 1 && processes[p].pid <= MAX_PROCESSES) {
+            pid_slot[processes[p].pid] = p;
+        }
+        for (int i = 0; i < MAX_PAGES; i++) {
+            int valid = active && i < processes[p].page_count && processes[p].page_table[i].valid;
+            frame_lut[p * MAX_PAGES + i] = valid ? processes[p].page_table[i].frame_no : -1;
+        }
+        for (int s = 0; s < MAX_SEGMENTS; s++) {
+            int valid = active && s < processes[p].seg_count && processes[p].seg_table[s].valid;
+            seg_base[p * MAX_SEGMENTS + s] = valid ? processes[p].seg_table[s].base * 1024 : 0;
+            seg_limit[p * MAX_SEGMENTS + s] = valid ? processes[p].seg_table[s].limit * 1024 : 0;
+            seg_page_base[p * MAX_SEGMENTS + s] = valid ? processes[p].seg_table[s].page_base : 0;
+        }
+    }
+
+    if (mode == XLATE_PAGING) {
+        for (int i = 0; i < count; i++) {
+            unsigned int pid = (unsigned int)pids[i];
+            int slot = pid_slot[pid <= MAX_PROCESSES ? pid : 0];
+            int pid_ok = slot >= 0;
+            slot = pid_ok ? slot : 0;
+
+            unsigned int addr = (unsigned int)logical_addrs[i];
+            unsigned int page = addr >> PAGE_SHIFT;
+            unsigned int offset = addr & (PAGE_BYTES - 1);
+            int page_ok = page < (unsigned int)page_limit[slot];
+            int frame = frame_lut[slot * MAX_PAGES + (page_ok ? page : 0)];
+            int resident = frame >= 0;
+
+            physical_addrs[i] = (pid_ok && page_ok && resident) ? frame * PAGE_BYTES + (int)offset : -1;
+            flags[i] = (unsigned char)((!pid_ok) * XLATE_BAD_PID |
+                                       (pid_ok && !page_ok) * XLATE_BAD_PAGE |
+                                       (pid_ok && page_ok && !resident) * XLATE_PAGE_FAULT);
+        }
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        unsigned int pid = (unsigned int)pids[i];
+        int slot = pid_slot[pid <= MAX_PROCESSES ? pid : 0];
+        int pid_ok = slot >= 0;
+        slot = pid_ok ? slot : 0;
+
+        unsigned int addr = (unsigned int)logical_addrs[i];
+        unsigned int seg = addr >> SEG_OFFSET_BITS;
+        unsigned int offset = addr & ((1u << SEG_OFFSET_BITS) - 1);
+        int seg_ok = seg < (unsigned int)seg_count_lut[slot] && seg < MAX_SEGMENTS;
+        int s = slot * MAX_SEGMENTS + (seg_ok ? (int)seg : 0);
+        int in_bounds = offset < (unsigned int)seg_limit[s];
+        int ok = pid_ok && seg_ok && in_bounds;
+        unsigned char f = (unsigned char)((!pid_ok) * XLATE_BAD_PID |
+                                          (pid_ok && !seg_ok) * XLATE_BAD_SEGMENT |
+                                          (pid_ok && seg_ok && !in_bounds) * XLATE_BOUNDS);
+
+        if (mode == XLATE_SEGMENTATION) {
+            physical_addrs[i] = ok ? seg_base[s] + (int)offset : -1;
+            flags[i] = f;
+        } else {
+            // Segmented paging: the segment offset selects a page within the segment
+            unsigned int page = (unsigned int)seg_page_base[s] + (offset >> PAGE_SHIFT);
+            int page_ok = page < (unsigned int)page_limit[slot];
+            int frame = frame_lut[slot * MAX_PAGES + (page_ok ? page : 0)];
+            int resident = frame >= 0;
+
+            physical_addrs[i] = (ok && page_ok && resident) ?
+                frame * PAGE_BYTES + (int)(offset & (PAGE_BYTES - 1)) : -1;
+            flags[i] = (unsigned char)(f | (ok && !page_ok) * XLATE_BAD_PAGE |
+                                       (ok && page_ok && !resident) * XLATE_PAGE_FAULT);
+        }
+    }
+}
+
+// Reads "pid logical_address" pairs from in and writes
+// "pid logical_address physical_address flags" lines to out, translating in
+// chunks of XLATE_CHUNK so arbitrarily long streams use constant memory.
+// Blank lines are ignored; other lines that are not a pair are counted in
+// *skipped. Returns the number of pairs translated.
+long translate_stream(TranslationMode mode, FILE *in, FILE *out, long *skipped) {
+    int *pids = (int*)malloc(XLATE_CHUNK * sizeof(int));
+    int *logical = (int*)malloc(XLATE_CHUNK * sizeof(int));
+    int *physical = (int*)malloc(XLATE_CHUNK * sizeof(int));
+    unsigned char *flags = (unsigned char*)malloc(XLATE_CHUNK);
+    long total = 0;
+    *skipped = 0;
+
+    if (pids == NULL || logical == NULL || physical == NULL || flags == NULL) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        free(pids); free(logical); free(physical); free(flags);
+        return 0;
+    }
+
+    char line[TRACE_LINE_MAX];
+    int n;
+    do {
+        n = 0;
+        while (n < XLATE_CHUNK && fgets(line, sizeof(line), in) != NULL) {
+            if (strchr(line, '\n') == NULL) {
+                // Overlong line: drop the rest of it
+                int c;
+                while ((c = fgetc(in)) != '\n' && c != EOF);
+            }
+            if (line[strspn(line, " \t\r\n")] == '\0') continue;
+            if (sscanf(line, "%d %i", &pids[n], &logical[n]) == 2) n++;
+            else (*skipped)++;
+        }
+        translate_batch(mode, pids, logical, n, physical, flags);
+        if (out != NULL) {
+            for (int i = 0; i < n; i++) {
+                fprintf(out, "%d %d %d %d\n", pids[i], logical[i], physical[i], flags[i]);
+            }
+        }
+        total += n;
+    } while (n == XLATE_CHUNK);
+
+    free(pids);
+    free(logical);
+    free(physical);
+    free(flags);
+    return total;
+}
+
+void simulate_batch_translation() {
+    term_clear();
+    display_header("BATCH ADDRESS TRANSLATION");
+
+    const char *mode_names[] = {"Paging", "Segmentation", "Segmented Paging"};
+
+    printf("\n" COLOR_YELLOW "Select Translation Mode:\n" COLOR_RESET);
+    printf(COLOR_CYAN "1." COLOR_RESET " Paging (page/offset split)\n");
+    printf(COLOR_CYAN "2." COLOR_RESET " Segmentation (base/limit check)\n");
+    printf(COLOR_CYAN "3." COLOR_RESET " Segmented Paging (segments are paged)\n");
+    printf("\n" COLOR_YELLOW "Enter your choice (1-3): " COLOR_RESET);
+
+    int mode_choice;
+    if (scanf("%d", &mode_choice) != 1) mode_choice = 1;
+    clear_input_buffer();
+    if (mode_choice < 1 || mode_choice > 3) mode_choice = 1;
+    TranslationMode mode = (TranslationMode)(mode_choice - 1);
+
+    printf("\n" COLOR_YELLOW "Select Input:\n" COLOR_RESET);
+    printf(COLOR_CYAN "1." COLOR_RESET " Throughput mode (random requests)\n");
+    printf(COLOR_CYAN "2." COLOR_RESET " Stream from file (\"pid address\" per line)\n");
+    printf("\n" COLOR_YELLOW "Enter your choice (1-2): " COLOR_RESET);
+
+    int source;
+    if (scanf("%d", &source) != 1) source = 1;
+    clear_input_buffer();
+
+    if (source == 2) {
+        char in_path[256], out_path[256];
+        printf(COLOR_CYAN "Input file: " COLOR_RESET);
+        if (scanf("%255s", in_path) != 1) in_path[0] = '\0';
+        clear_input_buffer();
+        printf(COLOR_CYAN "Output file (- for none): " COLOR_RESET);
+        if (scanf("%255s", out_path) != 1) strcpy(out_path, "-");
+        clear_input_buffer();
+
+        FILE *in = fopen(in_path, "r");
+        if (in == NULL) {
+            printf(COLOR_RED "Cannot open '%s'\n" COLOR_RESET, in_path);
+            printf("\nPress Enter to continue...");
+            getchar();
+            return;
+        }
+        FILE *out = NULL;
+        if (strcmp(out_path, "-") != 0) {
+            out = fopen(out_path, "w");
+            if (out == NULL) {
+                printf(COLOR_RED "Cannot open '%s' for writing: %s\n" COLOR_RESET, out_path, strerror(errno));
+                fclose(in);
+                printf("\nPress Enter to continue...");
+                getchar();
+                return;
+            }
+        }
+
+        double start = get_time_seconds();
+        long skipped;
+        long total = translate_stream(mode, in, out, &skipped);
+        double elapsed = get_time_seconds() - start;
+
+        fclose(in);
+        if (out != NULL) fclose(out);
+
+        printf("\n" COLOR_GREEN "Translated %ld addresses (%s) in %.3f s\n" COLOR_RESET,
+               total, mode_names[mode], elapsed);
+        if (skipped > 0) {
+            printf(COLOR_YELLOW "%ld malformed lines skipped (expected \"pid logical_address\")\n" COLOR_RESET, skipped);
+        }
+        printf("\nPress Enter to continue...");
+        getchar();
+        return;
+    }
+
+    printf(COLOR_CYAN "Number of translations per batch (1000-1000000): " COLOR_RESET);
+    int count;
+    if (scanf("%d", &count) != 1) count = 100000;
+    clear_input_buffer();
+    if (count < 1000) count = 1000;
+    if (count > 1000000) count = 1000000;
+
+    printf(COLOR_CYAN "Number of batches (1-1000): " COLOR_RESET);
+    int batches;
+    if (scanf("%d", &batches) != 1) batches = 10;
+    clear_input_buffer();
+    if (batches < 1) batches = 1;
+    if (batches > 1000) batches = 1000;
+
+    int *pids = (int*)malloc(count * sizeof(int));
+    int *logical = (int*)malloc(count * sizeof(int));
+    int *physical = (int*)malloc(count * sizeof(int));
+    unsigned char *flags = (unsigned char*)malloc(count);
+    if (pids == NULL || logical == NULL || physical == NULL || flags == NULL) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        free(pids); free(logical); free(physical); free(flags);
+        return;
+    }
+
+    // Mostly valid requests with some out-of-range ones to exercise every flag
+    for (int i = 0; i < count; i++) {
+        int p = rand() % process_count;
+        pids[i] = processes[p].pid;
+        if (mode == XLATE_PAGING) {
+            logical[i] = rand() % (processes[p].page_count * PAGE_BYTES + PAGE_BYTES);
+        } else {
+            int seg = rand() % (processes[p].seg_count + 1);
+            int limit = seg < processes[p].seg_count ? processes[p].seg_table[seg].limit : 4;
+            logical[i] = (seg << SEG_OFFSET_BITS) | (rand() % (limit * 1024 + 1024));
+        }
+    }
+
+    double start = get_time_seconds();
+    for (int b = 0; b < batches; b++) {
+        translate_batch(mode, pids, logical, count, physical, flags);
+    }
+    double elapsed = get_time_seconds() - start;
+
+    int ok = 0, faults = 0, bounds = 0, bad = 0;
+    for (int i = 0; i < count; i++) {
+        if (flags[i] == XLATE_OK) ok++;
+        if (flags[i] & XLATE_PAGE_FAULT) faults++;
+        if (flags[i] & XLATE_BOUNDS) bounds++;
+        if (flags[i] & (XLATE_BAD_PAGE | XLATE_BAD_SEGMENT | XLATE_BAD_PID)) bad++;
+    }
+
+    printf("\n" COLOR_CYAN "Sample Translations:\n" COLOR_RESET);
+    for (int i = 0; i < 5 && i < count; i++) {
+        printf("  PID %d  %8d -> ", pids[i], logical[i]);
+        if (flags[i] == XLATE_OK) {
+            printf(COLOR_GREEN "%d\n" COLOR_RESET, physical[i]);
+        } else if (flags[i] & XLATE_PAGE_FAULT) {
+            printf(COLOR_YELLOW "PAGE FAULT\n" COLOR_RESET);
+        } else if (flags[i] & XLATE_BOUNDS) {
+            printf(COLOR_RED "OUT OF BOUNDS\n" COLOR_RESET);
+        } else {
+            printf(COLOR_RED "INVALID\n" COLOR_RESET);
+        }
+    }
+
+    printf("\n" COLOR_GREEN "================================================================\n");
+    printf("                     THROUGHPUT RESULTS\n");
+    printf("================================================================\n" COLOR_RESET);
+    printf("Mode: %s\n", mode_names[mode]);
+    printf("Translations: %ld (%d x %d)\n", (long)count * batches, batches, count);
+    printf("Translated OK: %d  Page Faults: %d  Out of Bounds: %d  Invalid: %d\n",
+           ok, faults, bounds, bad);
+    printf("Elapsed: %.4f s\n", elapsed);
+    if (elapsed > 0) {
+        printf("Throughput: %.2f million translations/sec\n",
+               (double)count * batches / elapsed / 1e6);
+    }
+
+    printf("\nPress Enter to continue...");
+    getchar();
+
+    free(pids);
+    free(logical);
+    free(physical);
+    free(flags);
+}
+
+// Physical Allocator Function Implementations
+
+static int buddy_order_for(int size) {
+    int order = 0;
+    while ((1 << order) < size) order++;
+    return order;
+}
+
+static void buddy_push(PhysicalAllocator *a, int start, int order) {
+    a->buddy_free_order[start] = (signed char)order;
+    a->buddy_prev[start] = -1;
+    a->buddy_next[start] = a->buddy_heads[order];
+    if (a->buddy_heads[order] != -1) a->buddy_prev[a->buddy_heads[order]] = start;
+    a->buddy_heads[order] = start;
+    a->buddy_free_blocks++;
+}
+
+static void buddy_remove(PhysicalAllocator *a, int start, int order) {
+    int prev = a->buddy_prev[start];
+    int next = a->buddy_next[start];
+    if (prev != -1) a->buddy_next[prev] = next;
+    else a->buddy_heads[order] = next;
+    if (next != -1) a->buddy_prev[next] = prev;
+    a->buddy_free_order[start] = -1;
+    a->buddy_free_blocks--;
+}
+
+// Returns 1 on success. Buddy arenas are rounded down to a power of two.
+int allocator_init(PhysicalAllocator *a, AllocPolicy policy, int total_size) {
+    memset(a, 0, sizeof(*a));
+    a->policy = policy;
+
+    if (policy == FIT_BUDDY) {
+        a->max_order = 0;
+        while (a->max_order < BUDDY_MAX_ORDER && (2 << a->max_order) <= total_size) a->max_order++;
+        a->total_size = 1 << a->max_order;
+        a->buddy_next = (int*)malloc(a->total_size * sizeof(int));
+        a->buddy_prev = (int*)malloc(a->total_size * sizeof(int));
+        a->buddy_free_order = (signed char*)malloc(a->total_size);
+        if (a->buddy_next == NULL || a->buddy_prev == NULL || a->buddy_free_order == NULL) {
+            allocator_destroy(a);
+            return 0;
+        }
+        memset(a->buddy_free_order, -1, a->total_size);
+        for (int i = 0; i <= BUDDY_MAX_ORDER; i++) a->buddy_heads[i] = -1;
+        buddy_push(a, 0, a->max_order);
+        return 1;
+    }
+
+    a->total_size = total_size;
+    a->hole_capacity = 64;
+    a->holes = (MemoryBlock*)malloc(a->hole_capacity * sizeof(MemoryBlock));
+    if (a->holes == NULL) return 0;
+    a->holes[0].start = 0;
+    a->holes[0].size = total_size;
+    a->hole_count = 1;
+    return 1;
+}
+
+void allocator_destroy(PhysicalAllocator *a) {
+    free(a->holes);
+    free(a->buddy_next);
+    free(a->buddy_prev);
+    free(a->buddy_free_order);
+    a->holes = NULL;
+    a->buddy_next = NULL;
+    a->buddy_prev = NULL;
+    a->buddy_free_order = NULL;
+    a->hole_count = 0;
+}
+
+// Returns the start of the allocated block, or -1 if no hole is large enough
+int allocator_alloc(PhysicalAllocator *a, int size) {
+    if (size < 1 || size > a->total_size) return -1;
+
+    if (a->policy == FIT_BUDDY) {
+        int order = buddy_order_for(size);
+        int o = order;
+        while (o <= a->max_order && a->buddy_heads[o] == -1) o++;
+        if (o > a->max_order) return -1;
+
+        int start = a->buddy_heads[o];
+        buddy_remove(a, start, o);
+        while (o > order) {
+            o--;
+            buddy_push(a, start + (1 << o), o);
+        }
+        a->used += 1 << order;
+        return start;
+    }
+
+    int chosen = -1;
+    switch (a->policy) {
+        case FIT_FIRST:
+            for (int i = 0; i < a->hole_count; i++) {
+                if (a->holes[i].size >= size) { chosen = i; break; }
+            }
+            break;
+        case FIT_BEST:
+            for (int i = 0; i < a->hole_count; i++) {
+                if (a->holes[i].size >= size &&
+                    (chosen == -1 || a->holes[i].size < a->holes[chosen].size)) {
+                    chosen = i;
+                    if (a->holes[i].size == size) break;
+                }
+            }
+            break;
+        case FIT_WORST:
+            for (int i = 0; i < a->hole_count; i++) {
+                if (a->holes[i].size >= size &&
+                    (chosen == -1 || a->holes[i].size > a->holes[chosen].size)) {
+                    chosen = i;
+                }
+            }
+            break;
+        case FIT_NEXT:
+            for (int n = 0; n < a->hole_count; n++) {
+                int i = (a->next_fit_index + n) % a->hole_count;
+                if (a->holes[i].size >= size) { chosen = i; break; }
+            }
+            break;
+        default:
+            break;
+    }
+    if (chosen == -1) return -1;
+
+    int start = a->holes[chosen].start;
+    a->holes[chosen].start += size;
+    a->holes[chosen].size -= size;
+    if (a->holes[chosen].size == 0) {
+        memmove(&a->holes[chosen], &a->holes[chosen + 1],
+                (a->hole_count - chosen - 1) * sizeof(MemoryBlock));
+        a->hole_count--;
+    }
+    a->next_fit_index = a->hole_count > 0 ? chosen % a->hole_count : 0;
+    a->used += size;
+    return start;
+}
+
+// Returns a block to the allocator, coalescing with neighbouring holes/buddies
+void allocator_free(PhysicalAllocator *a, int start, int size) {
+    if (a->policy == FIT_BUDDY) {
+        int order = buddy_order_for(size);
+        a->used -= 1 << order;
+        while (order < a->max_order) {
+            int buddy = start ^ (1 << order);
+            if (a->buddy_free_order[buddy] != order) break;
+            buddy_remove(a, buddy, order);
+            if (buddy < start) start = buddy;
+            order++;
+        }
+        buddy_push(a, start, order);
+        return;
+    }
+
+    // Binary search for the first hole after this block
+    int lo = 0, hi = a->hole_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (a->holes[mid].start < start) lo = mid + 1;
+        else hi = mid;
+    }
+
+    int merge_prev = lo > 0 && a->holes[lo - 1].start + a->holes[lo - 1].size == start;
+    int merge_next = lo < a->hole_count && start + size == a->holes[lo].start;
+    a->used -= size;
+
+    if (merge_prev && merge_next) {
+        a->holes[lo - 1].size += size + a->holes[lo].size;
+        memmove(&a->holes[lo], &a->holes[lo + 1], (a->hole_count - lo - 1) * sizeof(MemoryBlock));
+        a->hole_count--;
+        // Holes from lo on shift down one; the rover's hole at lo was absorbed into lo - 1
+        if (a->next_fit_index >= lo) a->next_fit_index--;
+    } else if (merge_prev) {
+        a->holes[lo - 1].size += size;
+    } else if (merge_next) {
+        a->holes[lo].start = start;
+        a->holes[lo].size += size;
+    } else {
+        if (a->hole_count == a->hole_capacity) {
+            MemoryBlock *grown = (MemoryBlock*)realloc(a->holes, 2 * a->hole_capacity * sizeof(MemoryBlock));
+            if (grown == NULL) return; // block is leaked rather than corrupting the list
+            a->holes = grown;
+            a->hole_capacity *= 2;
+        }
+        memmove(&a->holes[lo + 1], &a->holes[lo], (a->hole_count - lo) * sizeof(MemoryBlock));
+        a->holes[lo].start = start;
+        a->holes[lo].size = size;
+        // Keep the rover on the same hole when the new one lands at or before it
+        if (a->next_fit_index >= lo && a->next_fit_index < a->hole_count) a->next_fit_index++;
+        a->hole_count++;
+    }
+}
+
+int allocator_largest_hole(const PhysicalAllocator *a) {
+    if (a->policy == FIT_BUDDY) {
+        for (int o = a->max_order; o >= 0; o--) {
+            if (a->buddy_heads[o] != -1) return 1 << o;
+        }
+        return 0;
+    }
+    int largest = 0;
+    for (int i = 0; i < a->hole_count; i++) {
+        if (a->holes[i].size > largest) largest = a->holes[i].size;
+    }
+    return largest;
+}
+
+int allocator_hole_count(const PhysicalAllocator *a) {
+    return a->policy == FIT_BUDDY ? a->buddy_free_blocks : a->hole_count;
+}
+
+// External fragmentation: share of free memory outside the largest hole
+float allocator_fragmentation(const PhysicalAllocator *a) {
+    int free_total = a->total_size - a->used;
+    if (free_total <= 0) return 0.0f;
+    return 1.0f - (float)allocator_largest_hole(a) / free_total;
+}
+
+// Returns 0 if no hole can hold the segment; it is then left invalid with base -1
+int place_segment(SegmentTableEntry *seg) {
+    seg->base = allocator_alloc(&segment_allocator, seg->limit);
+    seg->valid = seg->base >= 0;
+    return seg->valid;
+}
+
+void display_segment_memory_map() {
+    const char *policy_names[] = {"First-Fit", "Best-Fit", "Worst-Fit", "Next-Fit", "Buddy"};
+
+    printf("\n" COLOR_CYAN "Segment Memory Map (%d KB, %s placement):\n" COLOR_RESET,
+           segment_allocator.total_size, policy_names[segment_allocator.policy]);
+    printf(COLOR_MAGENTA "---------------------------------------------------------------\n");
+    printf(COLOR_YELLOW "  Start    End     Size   Owner\n" COLOR_RESET);
+    printf(COLOR_MAGENTA "---------------------------------------------------------------\n" COLOR_RESET);
+
+    for (int p = 0; p < process_count; p++) {
+        for (int i = 0; i < processes[p].seg_count; i++) {
+            SegmentTableEntry *seg = &processes[p].seg_table[i];
+            if (!seg->valid) continue;
+            printf(COLOR_GREEN "  %4d    %4d    %4dK   %s seg %d\n" COLOR_RESET,
+                   seg->base, seg->base + seg->limit, seg->limit, processes[p].name, seg->seg_no);
+        }
+    }
+    for (int i = 0; i < segment_allocator.hole_count; i++) {
+        printf(COLOR_RED "  %4d    %4d    %4dK   (hole)\n" COLOR_RESET,
+               segment_allocator.holes[i].start,
+               segment_allocator.holes[i].start + segment_allocator.holes[i].size,
+               segment_allocator.holes[i].size);
+    }
+    printf(COLOR_MAGENTA "---------------------------------------------------------------\n" COLOR_RESET);
+    printf("Used: %d/%d KB  Holes: %d  Largest Hole: %d KB  External Fragmentation: %.1f%%\n",
+           segment_allocator.used, segment_allocator.total_size,
+           allocator_hole_count(&segment_allocator), allocator_largest_hole(&segment_allocator),
+           allocator_fragmentation(&segment_allocator) * 100);
+}
+
+// Generates an allocate/free trace. op_size[i] > 0 allocates op_size[i] KB;
+// op_size[i] == 0 frees the block created by allocation op_target[i]. The
+// nominal live set is kept around 80% of the arena so fragmentation matters.
+// live must hold op_count ints of scratch space.
+void generate_churn_trace(int *op_size, int *op_target, int *live, int op_count,
+                          int arena, int max_request) {
+    int live_count = 0;
+    long live_size = 0;
+    for (int i = 0; i < op_count; i++) {
+        int want_alloc = live_count == 0 || (live_size < arena * 8L / 10 && rand() % 100 < 60);
+        if (want_alloc) {
+            op_size[i] = 1 + rand() % max_request;
+            op_target[i] = i;
+            live[live_count++] = i;
+            live_size += op_size[i];
+        } else {
+            int k = rand() % live_count;
+            op_size[i] = 0;
+            op_target[i] = live[k];
+            live_size -= op_size[live[k]];
+            live[k] = live[--live_count];
+        }
+    }
+}
+
+// Replays one randomly generated allocate/free trace against every policy.
+// Frees refer to the allocation that created the block, so an allocation that
+// fails under one policy simply has its matching free skipped there.
+void simulate_allocator_churn() {
+    term_clear();
+    display_header("ALLOCATION CHURN ANALYSIS");
+
+    const char *policy_names[] = {"First-Fit", "Best-Fit", "Worst-Fit", "Next-Fit", "Buddy"};
+
+    printf("\n" COLOR_CYAN "Arena size in KB (256-1048576): " COLOR_RESET);
+    int arena;
+    if (scanf("%d", &arena) != 1) arena = 4096;
+    clear_input_buffer();
+    if (arena < 256) arena = 256;
+    if (arena > 1048576) arena = 1048576;
+
+    printf(COLOR_CYAN "Number of operations (100-1000000): " COLOR_RESET);
+    int op_count;
+    if (scanf("%d", &op_count) != 1) op_count = 100000;
+    clear_input_buffer();
+    if (op_count < 100) op_count = 100;
+    if (op_count > 1000000) op_count = 1000000;
+
+    printf(COLOR_CYAN "Maximum request size in KB (1-%d): " COLOR_RESET, arena / 4);
+    int max_request;
+    if (scanf("%d", &max_request) != 1) max_request = 64;
+    clear_input_buffer();
+    if (max_request < 1) max_request = 1;
+    if (max_request > arena / 4) max_request = arena / 4;
+
+    int *op_size = (int*)malloc(op_count * sizeof(int));
+    int *op_target = (int*)malloc(op_count * sizeof(int));
+    int *live = (int*)malloc(op_count * sizeof(int));
+    int *block_start = (int*)malloc(op_count * sizeof(int));
+    if (op_size == NULL || op_target == NULL || live == NULL || block_start == NULL) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        free(op_size); free(op_target); free(live); free(block_start);
+        return;
+    }
+
+    generate_churn_trace(op_size, op_target, live, op_count, arena, max_request);
+
+    printf("\n" COLOR_GREEN "================================================================\n");
+    printf("                   ALLOCATOR CHURN RESULTS\n");
+    printf("================================================================\n" COLOR_RESET);
+    printf("Arena: %d KB  Operations: %d  Request size: 1-%d KB\n\n", arena, op_count, max_request);
+    printf(COLOR_YELLOW "%-10s %8s %8s %9s %9s %8s %10s\n" COLOR_RESET,
+           "Policy", "Allocs", "Failed", "Ext.Frag", "Int.Frag", "Holes", "ns/alloc");
+
+    for (int policy = FIT_FIRST; policy <= FIT_BUDDY; policy++) {
+        PhysicalAllocator a;
+        if (!allocator_init(&a, (AllocPolicy)policy, arena)) {
+            printf(COLOR_RED "%-10s allocation failed\n" COLOR_RESET, policy_names[policy]);
+            continue;
+        }
+
+        long allocs = 0, failures = 0;
+        long requested = 0, granted = 0;
+        double frag_sum = 0, alloc_time = 0;
+
+        for (int i = 0; i < op_count; i++) {
+            if (op_size[i] > 0) {
+                double t0 = get_time_seconds();
+                block_start[i] = allocator_alloc(&a, op_size[i]);
+                alloc_time += get_time_seconds() - t0;
+                allocs++;
+                if (block_start[i] < 0) {
+                    failures++;
+                } else {
+                    requested += op_size[i];
+                    granted += policy == FIT_BUDDY ? 1 << buddy_order_for(op_size[i]) : op_size[i];
+                }
+            } else if (block_start[op_target[i]] >= 0) {
+                allocator_free(&a, block_start[op_target[i]], op_size[op_target[i]]);
+            }
+            frag_sum += allocator_fragmentation(&a);
+        }
+
+        printf("%-10s %8ld %8ld %8.1f%% %8.1f%% %8d %10.1f\n",
+               policy_names[policy], allocs, failures,
+               frag_sum / op_count * 100,
+               granted > 0 ? (double)(granted - requested) / granted * 100 : 0.0,
+               allocator_hole_count(&a),
+               allocs > 0 ? alloc_time / allocs * 1e9 : 0.0);
+        allocator_destroy(&a);
+    }
+
+    printf("\nExt.Frag = average share of free memory outside the largest hole\n");
+    printf("Int.Frag = share of granted memory lost to rounding (buddy only)\n");
+
+    free(op_size);
+    free(op_target);
+    free(live);
+    free(block_start);
+
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+void physical_allocator_menu() {
+    term_clear();
+    display_header("PHYSICAL ALLOCATOR");
+
+    display_segment_memory_map();
+
+    printf("\n" COLOR_YELLOW "Options:\n" COLOR_RESET);
+    printf(COLOR_CYAN "1." COLOR_RESET " Run allocation churn analysis (all policies)\n");
+    printf(COLOR_CYAN "2." COLOR_RESET " Change segment placement policy\n");
+    printf(COLOR_CYAN "0." COLOR_RESET " Back\n");
+    printf("\n" COLOR_YELLOW "Enter your choice: " COLOR_RESET);
+
+    int choice;
+    if (scanf("%d", &choice) != 1) choice = 0;
+    clear_input_buffer();
+
+    if (choice == 1) {
+        simulate_allocator_churn();
+    } else if (choice == 2) {
+        printf("\n" COLOR_CYAN "1." COLOR_RESET " First-Fit  " COLOR_CYAN "2." COLOR_RESET " Best-Fit  "
+               COLOR_CYAN "3." COLOR_RESET " Worst-Fit  " COLOR_CYAN "4." COLOR_RESET " Next-Fit\n");
+        printf(COLOR_YELLOW "New policy for future segments (1-4): " COLOR_RESET);
+        int policy;
+        if (scanf("%d", &policy) != 1) policy = 1;
+        clear_input_buffer();
+        if (policy < 1 || policy > 4) policy = 1;
+        // The fit policies share the same hole list, so switching is safe at any time
+        segment_allocator.policy = (AllocPolicy)(policy - 1);
+        printf(COLOR_GREEN "Segment placement policy updated.\n" COLOR_RESET);
+        term_sleep_ms(1000);
+    }
+}
+
+// Compaction Function Implementations
+
+static int compare_blocks_by_start(const void *x, const void *y) {
+    const CompactionBlock *a = (const CompactionBlock*)x;
+    const CompactionBlock *b = (const CompactionBlock*)y;
+    return (a->start > b->start) - (a->start < b->start);
+}
+
+// Recreates the hole list as the gaps between address-ordered blocks. Returns
+// 0, leaving the list untouched, if it cannot be grown to count + 1 holes.
+int allocator_rebuild_holes(PhysicalAllocator *a, const CompactionBlock *blocks, int count) {
+    if (a->hole_capacity < count + 1) {
+        MemoryBlock *grown = (MemoryBlock*)realloc(a->holes, (count + 1) * sizeof(MemoryBlock));
+        if (grown == NULL) return 0;
+        a->holes = grown;
+        a->hole_capacity = count + 1;
+    }
+
+    int cursor = 0;
+    a->hole_count = 0;
+    for (int i = 0; i <= count; i++) {
+        int end = i < count ? blocks[i].start : a->total_size;
+        if (end > cursor) {
+            a->holes[a->hole_count].start = cursor;
+            a->holes[a->hole_count].size = end - cursor;
+            a->hole_count++;
+        }
+        if (i < count) cursor = blocks[i].start + blocks[i].size;
+    }
+    a->next_fit_index = 0;
+    return 1;
+}
+
+// Slides blocks towards address 0, rewriting each moved block's owner field.
+//   min_hole  > 0: stop as soon as a hole of at least min_hole KB exists (partial)
+//   max_moves > 0: move at most this many blocks per call (incremental)
+// Both 0 compacts everything (full). Returns the number of blocks moved, or -1
+// with nothing moved if the hole list cannot be grown to describe the result.
+int compact_allocator(PhysicalAllocator *a, CompactionBlock *blocks, int count, int min_hole,
+                      int max_moves, const CompactionCostModel *model, CompactionStats *stats) {
+    // Reserve the rebuilt hole list first so a failure leaves every block in place
+    if (a->hole_capacity < count + 1) {
+        MemoryBlock *grown = (MemoryBlock*)realloc(a->holes, (count + 1) * sizeof(MemoryBlock));
+        if (grown == NULL) return -1;
+        a->holes = grown;
+        a->hole_capacity = count + 1;
+    }
+    qsort(blocks, count, sizeof(CompactionBlock), compare_blocks_by_start);
+
+    int cursor = 0;
+    int moved = 0;
+    for (int i = 0; i < count; i++) {
+        if (min_hole > 0 && blocks[i].start - cursor >= min_hole) break;
+        if (max_moves > 0 && moved >= max_moves) break;
+
+        if (blocks[i].start > cursor) {
+            blocks[i].start = cursor;
+            if (blocks[i].owner != NULL) *blocks[i].owner = cursor;
+            moved++;
+            stats->blocks_moved++;
+            stats->bytes_copied += (long)blocks[i].size * 1024;
+            stats->fixups += blocks[i].fixups;
+            stats->cost_ns += blocks[i].size * model->copy_ns_per_kb + blocks[i].fixups * model->fixup_ns;
+        }
+        cursor = blocks[i].start + blocks[i].size;
+    }
+
+    stats->runs++;
+    if (!allocator_rebuild_holes(a, blocks, count)) return -1;
+    return moved;
+}
+
+// Fully compacts the segment allocator, fixing up each process's segment table
+int compact_segments(CompactionStats *stats) {
+    CompactionBlock blocks[MAX_PROCESSES * MAX_SEGMENTS];
+    int count = 0;
+
+    if (segment_allocator.policy == FIT_BUDDY) return 0;
+
+    for (int p = 0; p < process_count; p++) {
+        for (int i = 0; i < processes[p].seg_count; i++) {
+            if (!processes[p].seg_table[i].valid) continue;
+            blocks[count].start = processes[p].seg_table[i].base;
+            blocks[count].size = processes[p].seg_table[i].limit;
+            blocks[count].owner = &processes[p].seg_table[i].base;
+            blocks[count].fixups = 1;
+            count++;
+        }
+    }
+    return compact_allocator(&segment_allocator, blocks, count, 0, 0, &compaction_cost, stats);
+}
+
+// Moves occupied frames to the lowest frame numbers. Every page table and TLB
+// entry that points at a moved frame is one fix-up.
+int compact_frames(const CompactionCostModel *model, CompactionStats *stats) {
+    int moved = 0;
+    int free_index = 0;
+
+    if (physical_memory == NULL) return 0;
+
+    // Occupied frames keep their order, so frame i lands at the number of
+    // occupied frames below it. A hand on a free frame moves to the next
+    // occupied one, which is where that count lands too (wrapping past the end).
+    int occupied = 0, fifo_new = -1, clock_new = -1;
+    for (int i = 0; i < frame_count; i++) {
+        if (i == fifo_index) fifo_new = occupied;
+        if (i == clock_hand) clock_new = occupied;
+        if (physical_memory[i].occupied) occupied++;
+    }
+
+    for (int i = 0; i < frame_count; i++) {
+        if (!physical_memory[i].occupied) continue;
+
+        if (i != free_index) {
+            int fixups = 0;
+            physical_memory[free_index] = physical_memory[i];
+            physical_memory[free_index].frame_no = free_index;
+
+            physical_memory[i].occupied = 0;
+            physical_memory[i].page_no = -1;
+            physical_memory[i].process_id = -1;
+            physical_memory[i].reference_bit = 0;
+            physical_memory[i].modify_bit = 0;
+            physical_memory[i].load_time = -1;
+            physical_memory[i].share_count = 0;
+
+            for (int p = 0; p < process_count; p++) {
+                for (int j = 0; j < processes[p].page_count; j++) {
+                    if (processes[p].page_table[j].valid && processes[p].page_table[j].frame_no == i) {
+                        processes[p].page_table[j].frame_no = free_index;
+                        fixups++;
+                    }
+                }
+            }
+            for (int t = 0; t < tlb_size; t++) {
+                if (tlb[t].valid && tlb[t].frame_no == i) {
+                    tlb[t].frame_no = free_index;
+                    fixups++;
+                }
+            }
+
+            moved++;
+            stats->blocks_moved++;
+            stats->bytes_copied += PAGE_BYTES;
+            stats->fixups += fixups;
+            stats->cost_ns += PAGE_SIZE * model->copy_ns_per_kb + fixups * model->fixup_ns;
+        }
+        free_index++;
+    }
+    fifo_index = fifo_new >= 0 && fifo_new < occupied ? fifo_new : 0;
+    clock_hand = clock_new >= 0 && clock_new < occupied ? clock_new : 0;
+    stats->runs++;
+    return moved;
+}
+
+void display_compaction_stats(const CompactionStats *stats) {
+    printf("Blocks Moved:  %ld\n", stats->blocks_moved);
+    printf("Bytes Copied:  %ld (%.1f KB)\n", stats->bytes_copied, stats->bytes_copied / 1024.0);
+    printf("Table Fix-ups: %ld\n", stats->fixups);
+    printf("Modelled Cost: %.2f us\n", stats->cost_ns / 1000.0);
+}
+
+// Replays one churn trace with each compaction strategy and compares the
+// compaction cost paid against the allocation failures it avoided.
+void simulate_compaction_churn() {
+    term_clear();
+    display_header("COMPACTION COST ANALYSIS");
+
+    const char *policy_names[] = {"First-Fit", "Best-Fit", "Worst-Fit", "Next-Fit"};
+    const char *strategy_names[] = {"None", "Full", "Incremental", "Partial"};
+
+    printf("\n" COLOR_CYAN "Placement policy (1=First 2=Best 3=Worst 4=Next): " COLOR_RESET);
+    int policy;
+    if (scanf("%d", &policy) != 1) policy = 1;
+    clear_input_buffer();
+    if (policy < 1 || policy > 4) policy = 1;
+    policy--;
+
+    printf(COLOR_CYAN "Arena size in KB (256-65536): " COLOR_RESET);
+    int arena;
+    if (scanf("%d", &arena) != 1) arena = 4096;
+    clear_input_buffer();
+    if (arena < 256) arena = 256;
+    if (arena > 65536) arena = 65536;
+
+    printf(COLOR_CYAN "Number of operations (100-500000): " COLOR_RESET);
+    int op_count;
+    if (scanf("%d", &op_count) != 1) op_count = 50000;
+    clear_input_buffer();
+    if (op_count < 100) op_count = 100;
+    if (op_count > 500000) op_count = 500000;
+
+    printf(COLOR_CYAN "Maximum request size in KB (1-%d): " COLOR_RESET, arena / 4);
+    int max_request;
+    if (scanf("%d", &max_request) != 1) max_request = 128;
+    clear_input_buffer();
+    if (max_request < 1) max_request = 1;
+    if (max_request > arena / 4) max_request = arena / 4;
+
+    printf(COLOR_CYAN "Partial compaction threshold (external fragmentation %%, 0-100): " COLOR_RESET);
+    int threshold;
+    if (scanf("%d", &threshold) != 1) threshold = 50;
+    clear_input_buffer();
+    if (threshold < 0) threshold = 0;
+    if (threshold > 100) threshold = 100;
+
+    printf(COLOR_CYAN "Incremental budget (blocks moved per step, 1-64): " COLOR_RESET);
+    int budget;
+    if (scanf("%d", &budget) != 1) budget = 8;
+    clear_input_buffer();
+    if (budget < 1) budget = 1;
+    if (budget > 64) budget = 64;
+
+    printf(COLOR_CYAN "Cost of one allocation failure (us, e.g. swapping out a process): " COLOR_RESET);
+    double failure_us;
+    if (scanf("%lf", &failure_us) != 1) failure_us = 1000.0;
+    clear_input_buffer();
+
+    int *op_size = (int*)malloc(op_count * sizeof(int));
+    int *op_target = (int*)malloc(op_count * sizeof(int));
+    int *block_start = (int*)malloc(op_count * sizeof(int));
+    int *live = (int*)malloc(op_count * sizeof(int));
+    int *live_pos = (int*)malloc(op_count * sizeof(int));
+    CompactionBlock *blocks = (CompactionBlock*)malloc(op_count * sizeof(CompactionBlock));
+    if (op_size == NULL || op_target == NULL || block_start == NULL ||
+        live == NULL || live_pos == NULL || blocks == NULL) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        free(op_size); free(op_target); free(block_start); free(live); free(live_pos); free(blocks);
+        return;
+    }
+
+    generate_churn_trace(op_size, op_target, live, op_count, arena, max_request);
+
+    printf("\n" COLOR_GREEN "================================================================\n");
+    printf("                   COMPACTION COST RESULTS\n");
+    printf("================================================================\n" COLOR_RESET);
+    printf("Policy: %s  Arena: %d KB  Operations: %d  Copy: %.0f ns/KB  Fix-up: %.0f ns\n\n",
+           policy_names[policy], arena, op_count,
+           compaction_cost.copy_ns_per_kb, compaction_cost.fixup_ns);
+    printf(COLOR_YELLOW "%-12s %7s %7s %6s %8s %9s %8s %10s %10s\n" COLOR_RESET,
+           "Strategy", "Failed", "Avoided", "Runs", "Moved", "MB Copied", "Fix-ups", "Cost(us)", "Net(us)");
+
+    long baseline_failures = 0;
+    for (int strategy = COMPACT_NONE; strategy <= COMPACT_PARTIAL; strategy++) {
+        PhysicalAllocator a;
+        CompactionStats stats = {0, 0, 0, 0, 0.0};
+        long failures = 0;
+        int live_count = 0;
+
+        if (!allocator_init(&a, (AllocPolicy)policy, arena)) break;
+
+        for (int i = 0; i < op_count; i++) {
+            if (op_size[i] > 0) {
+                int start = allocator_alloc(&a, op_size[i]);
+                int compact = start < 0 && strategy != COMPACT_NONE;
+                if (compact && strategy == COMPACT_PARTIAL) {
+                    compact = allocator_fragmentation(&a) * 100 >= threshold;
+                }
+                if (compact) {
+                    for (int k = 0; k < live_count; k++) {
+                        blocks[k].start = block_start[live[k]];
+                        blocks[k].size = op_size[live[k]];
+                        blocks[k].owner = &block_start[live[k]];
+                        blocks[k].fixups = 1;
+                    }
+                    compact_allocator(&a, blocks, live_count,
+                                      strategy == COMPACT_PARTIAL ? op_size[i] : 0,
+                                      strategy == COMPACT_INCREMENTAL ? budget : 0,
+                                      &compaction_cost, &stats);
+                    start = allocator_alloc(&a, op_size[i]);
+                }
+                block_start[i] = start;
+                if (start < 0) {
+                    failures++;
+                } else {
+                    live_pos[i] = live_count;
+                    live[live_count++] = i;
+                }
+            } else if (block_start[op_target[i]] >= 0) {
+                int target = op_target[i];
+                allocator_free(&a, block_start[target], op_size[target]);
+                block_start[target] = -1;
+                int pos = live_pos[target];
+                live[pos] = live[--live_count];
+                live_pos[live[pos]] = pos;
+            }
+        }
+
+        if (strategy == COMPACT_NONE) baseline_failures = failures;
+        long avoided = baseline_failures - failures;
+        double cost_us = stats.cost_ns / 1000.0;
+
+        printf("%-12s %7ld %7ld %6ld %8ld %9.1f %8ld %10.1f %10.1f\n",
+               strategy_names[strategy], failures, avoided, stats.runs, stats.blocks_moved,
+               stats.bytes_copied / (1024.0 * 1024.0), stats.fixups, cost_us,
+               avoided * failure_us - cost_us);
+        allocator_destroy(&a);
+    }
+
+    printf("\nNet = (avoided failures x %.0f us) - compaction cost; positive means compaction pays off\n",
+           failure_us);
+
+    free(op_size);
+    free(op_target);
+    free(block_start);
+    free(live);
+    free(live_pos);
+    free(blocks);
+
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+void compaction_menu() {
+    term_clear();
+    display_header("MEMORY COMPACTION ENGINE");
+
+    printf("\n" COLOR_YELLOW "Cost Model: " COLOR_RESET "%.0f ns per KB copied, %.0f ns per table fix-up\n",
+           compaction_cost.copy_ns_per_kb, compaction_cost.fixup_ns);
+
+    printf("\n" COLOR_YELLOW "Options:\n" COLOR_RESET);
+    printf(COLOR_CYAN "1." COLOR_RESET " Compact segment memory (segment table fix-ups)\n");
+    printf(COLOR_CYAN "2." COLOR_RESET " Compact page frames (page table fix-ups)\n");
+    printf(COLOR_CYAN "3." COLOR_RESET " Compare strategies on an allocation churn trace\n");
+    printf(COLOR_CYAN "4." COLOR_RESET " Change cost model\n");
+    printf(COLOR_CYAN "0." COLOR_RESET " Back\n");
+    printf("\n" COLOR_YELLOW "Enter your choice: " COLOR_RESET);
+
+    int choice;
+    if (scanf("%d", &choice) != 1) choice = 0;
+    clear_input_buffer();
+
+    CompactionStats stats = {0, 0, 0, 0, 0.0};
+    switch (choice) {
+        case 1:
+            if (segment_allocator.policy == FIT_BUDDY) {
+                printf(COLOR_RED "\nBuddy placement cannot be compacted.\n" COLOR_RESET);
+            } else {
+                printf("\nBefore:");
+                display_segment_memory_map();
+                if (compact_segments(&stats) < 0) {
+                    printf(COLOR_RED "\nCompaction failed: out of memory for the hole list.\n" COLOR_RESET);
+                }
+                printf("\nAfter:");
+                display_segment_memory_map();
+                printf("\n");
+                display_compaction_stats(&stats);
+            }
+            printf("\nPress Enter to continue...");
+            getchar();
+            break;
+        case 2:
+            if (physical_memory == NULL) {
+                printf(COLOR_RED "\nMemory not initialized! Please setup memory frames first.\n" COLOR_RESET);
+            } else {
+                compact_frames(&compaction_cost, &stats);
+                display_memory();
+                printf("\n");
+                display_compaction_stats(&stats);
+            }
+            printf("\nPress Enter to continue...");
+            getchar();
+            break;
+        case 3:
+            simulate_compaction_churn();
+            break;
+        case 4:
+            printf(COLOR_CYAN "Copy cost (ns per KB): " COLOR_RESET);
+            if (scanf("%lf", &compaction_cost.copy_ns_per_kb) != 1) compaction_cost.copy_ns_per_kb = 100.0;
+            clear_input_buffer();
+            printf(COLOR_CYAN "Fix-up cost (ns per table entry): " COLOR_RESET);
+            if (scanf("%lf", &compaction_cost.fixup_ns) != 1) compaction_cost.fixup_ns = 50.0;
+            clear_input_buffer();
+            break;
+        default:
+            break;
+    }
+}
+
+// Snapshot Function Implementations
+
+static SharedChunk *chunk_new(const void *data, size_t size) {
+    SharedChunk *c = (SharedChunk*)malloc(sizeof(SharedChunk) + size);
+    if (c == NULL) return NULL;
+    c->refs = 1;
+    c->size = size;
+    if (size > 0) memcpy(c->data, data, size);
+    return c;
+}
+
+static void chunk_release(SharedChunk *c) {
+    if (c != NULL && --c->refs == 0) free(c);
+}
+
+static SharedChunk *chunk_share(SharedChunk *c) {
+    if (c != NULL) c->refs++;
+    return c;
+}
+
+// Stores data into *slot. Unchanged data keeps sharing the existing chunk, an
+// unshared chunk is overwritten in place, and a shared chunk is copied first.
+static int chunk_sync(SharedChunk **slot, const void *data, size_t size) {
+    SharedChunk *c = *slot;
+    if (c != NULL && c->size == size && memcmp(c->data, data, size) == 0) return 1;
+    if (c != NULL && c->refs == 1 && c->size == size) {
+        memcpy(c->data, data, size);
+        return 1;
+    }
+    SharedChunk *copy = chunk_new(data, size);
+    if (copy == NULL) return 0;
+    chunk_release(c);
+    *slot = copy;
+    return 1;
+}
+
+int resize_frames(int new_count) {
+    if (new_count == frame_count && physical_memory != NULL) return 1;
+    if (new_count <= 0) {
+        free(physical_memory);
+        physical_memory = NULL;
+        frame_count = 0;
+        return 1;
+    }
+
+    Frame *grown = (Frame*)realloc(physical_memory, new_count * sizeof(Frame));
+    if (grown == NULL) return 0;
+    physical_memory = grown;
+
+    for (int i = frame_count; i < new_count; i++) {
+        physical_memory[i].frame_no = i;
+        physical_memory[i].occupied = 0;
+        physical_memory[i].page_no = -1;
+        physical_memory[i].process_id = -1;
+        physical_memory[i].reference_bit = 0;
+        physical_memory[i].modify_bit = 0;
+        physical_memory[i].age_counter = 0;
+        physical_memory[i].load_time = -1;
+        physical_memory[i].prefetched = 0;
+        physical_memory[i].share_count = 0;
+    }
+    frame_count = new_count;
+    if (fifo_index >= frame_count) fifo_index = 0;
+    if (clock_hand >= frame_count) clock_hand = 0;
+    return 1;
+}
+
+static void sim_state_read_counters(SimCounters *c) {
+    c->frame_count = physical_memory != NULL ? frame_count : 0;
+    c->process_count = process_count;
+    c->time_counter = time_counter;
+    c->page_faults = page_faults;
+    c->page_hits = page_hits;
+    c->fifo_index = fifo_index;
+    c->clock_hand = clock_hand;
+    c->tlb_size = tlb_size;
+    c->seg_policy = segment_allocator.policy;
+    c->seg_total = segment_allocator.total_size;
+    c->seg_used = segment_allocator.used;
+    c->seg_next_fit = segment_allocator.next_fit_index;
+    c->swap_slots = swap_area.slot_count;
+    c->swap_next = swap_area.cluster_next;
+    c->swap_end = swap_area.cluster_end;
+    c->swap_last_out = swap_area.last_out_slot;
+    c->swap_ins = swap_area.swap_ins;
+    c->swap_outs = swap_area.swap_outs;
+    c->swap_sequential = swap_area.sequential_outs;
+    c->swap_clean = swap_area.clean_evictions;
+    c->swap_scattered = swap_area.scattered_allocs;
+    c->swap_dropped = swap_area.dropped;
+}
+
+// Copies the live simulator globals into a new state that owns its chunks
+int sim_state_capture(SimState *state) {
+    memset(state, 0, sizeof(*state));
+    return sim_state_commit(state);
+}
+
+// O(1) per chunk: the child shares every chunk with the parent
+void sim_state_fork(const SimState *parent, SimState *child) {
+    child->counters = parent->counters;
+    child->frames = chunk_share(parent->frames);
+    for (int p = 0; p < MAX_PROCESSES; p++) child->procs[p] = chunk_share(parent->procs[p]);
+    child->tlb_chunk = chunk_share(parent->tlb_chunk);
+    child->holes = chunk_share(parent->holes);
+}
+
+// Loads a state into the simulator globals so the engines can run on it. The
+// globals are plain arrays, so this is a full snapshot copy of every chunk;
+// chunks are shared copy-on-write only between states (fork and commit).
+// Everything that can fail is allocated first, so on failure (0) the globals
+// are left as they were.
+int sim_state_activate(const SimState *state) {
+    const SimCounters *c = &state->counters;
+    int hole_count = (int)(state->holes->size / sizeof(MemoryBlock));
+
+    Frame *frames = NULL;
+    if (c->frame_count > 0) {
+        frames = (Frame*)malloc(c->frame_count * sizeof(Frame));
+        if (frames == NULL) return 0;
+        memcpy(frames, state->frames->data, c->frame_count * sizeof(Frame));
+    }
+    MemoryBlock *holes = NULL;
+    if (segment_allocator.hole_capacity < hole_count) {
+        holes = (MemoryBlock*)malloc(hole_count * sizeof(MemoryBlock));
+        if (holes == NULL) {
+            free(frames);
+            return 0;
+        }
+    }
+    SwapArea swap;
+    int new_swap = c->swap_slots != swap_area.slot_count;
+    if (new_swap && !swap_init(&swap, c->swap_slots)) {
+        free(frames);
+        free(holes);
+        return 0;
+    }
+
+    free(physical_memory);
+    physical_memory = frames;
+    frame_count = c->frame_count;
+    process_count = c->process_count;
+    for (int p = 0; p < process_count; p++) {
+        memcpy(&processes[p], state->procs[p]->data, sizeof(Process));
+    }
+    memcpy(tlb, state->tlb_chunk->data, sizeof(tlb));
+
+    time_counter = c->time_counter;
+    page_faults = c->page_faults;
+    page_hits = c->page_hits;
+    fifo_index = c->fifo_index;
+    clock_hand = c->clock_hand;
+    tlb_size = c->tlb_size;
+
+    if (holes != NULL) {
+        free(segment_allocator.holes);
+        segment_allocator.holes = holes;
+        segment_allocator.hole_capacity = hole_count;
+    }
+    if (hole_count > 0) memcpy(segment_allocator.holes, state->holes->data, state->holes->size);
+    segment_allocator.hole_count = hole_count;
+    segment_allocator.policy = (AllocPolicy)c->seg_policy;
+    segment_allocator.total_size = c->seg_total;
+    segment_allocator.used = c->seg_used;
+    segment_allocator.next_fit_index = c->seg_next_fit;
+
+    // The slot map is implied by the page tables
+    if (new_swap) {
+        swap_destroy(&swap_area);
+        swap_area = swap;
+    }
+    swap_rebuild(&swap_area);
+    swap_area.cluster_next = c->swap_next;
+    swap_area.cluster_end = c->swap_end;
+    swap_area.last_out_slot = c->swap_last_out;
+    swap_area.swap_ins = c->swap_ins;
+    swap_area.swap_outs = c->swap_outs;
+    swap_area.sequential_outs = c->swap_sequential;
+    swap_area.clean_evictions = c->swap_clean;
+    swap_area.scattered_allocs = c->swap_scattered;
+    swap_area.dropped = c->swap_dropped;
+    return 1;
+}
+
+// Puts the user's state back after an analysis tool and releases it
+int sim_state_restore(SimState *state) {
+    int ok = sim_state_activate(state);
+    if (!ok) printf(COLOR_RED "Memory allocation failed! The previous memory state could not be restored.\n" COLOR_RESET);
+    sim_state_release(state);
+    return ok;
+}
+
+// Writes the globals back into a state, copying only the chunks that changed
+// and are still shared with another state (copy-on-write)
+int sim_state_commit(SimState *state) {
+    sim_state_read_counters(&state->counters);
+
+    int ok = chunk_sync(&state->frames, physical_memory, state->counters.frame_count * sizeof(Frame));
+    for (int p = 0; p < MAX_PROCESSES; p++) {
+        if (p < process_count) {
+            ok = ok && chunk_sync(&state->procs[p], &processes[p], sizeof(Process));
+        } else {
+            chunk_release(state->procs[p]);
+            state->procs[p] = NULL;
+        }
+    }
+    ok = ok && chunk_sync(&state->tlb_chunk, tlb, sizeof(tlb));
+    ok = ok && chunk_sync(&state->holes, segment_allocator.holes,
+                          segment_allocator.hole_count * sizeof(MemoryBlock));
+    return ok;
+}
+
+void sim_state_release(SimState *state) {
+    chunk_release(state->frames);
+    for (int p = 0; p < MAX_PROCESSES; p++) chunk_release(state->procs[p]);
+    chunk_release(state->tlb_chunk);
+    chunk_release(state->holes);
+    memset(state, 0, sizeof(*state));
+}
+
+// File layout: magic, version, table limits, SimCounters, frames, then per
+// process its header and only the page/segment entries in use, the TLB and
+// the segment hole list. Native byte order.
+int sim_state_save(const SimState *state, const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) return 0;
+
+    int header[4] = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, MAX_PAGES, MAX_SEGMENTS};
+    int hole_count = (int)(state->holes->size / sizeof(MemoryBlock));
+    int ok = fwrite(header, sizeof(header), 1, f) == 1;
+    ok = ok && fwrite(&state->counters, sizeof(SimCounters), 1, f) == 1;
+    ok = ok && fwrite(state->frames->data, 1, state->frames->size, f) == state->frames->size;
+
+    for (int p = 0; ok && p < state->counters.process_count; p++) {
+        const Process *proc = (const Process*)state->procs[p]->data;
+        ok = fwrite(&proc->pid, sizeof(int), 1, f) == 1 &&
+             fwrite(&proc->page_count, sizeof(int), 1, f) == 1 &&
+             fwrite(&proc->seg_count, sizeof(int), 1, f) == 1 &&
+             fwrite(proc->name, sizeof(proc->name), 1, f) == 1 &&
+             fwrite(proc->page_table, sizeof(PageTableEntry), proc->page_count, f) == (size_t)proc->page_count &&
+             fwrite(proc->seg_table, sizeof(SegmentTableEntry), proc->seg_count, f) == (size_t)proc->seg_count;
+    }
+
+    ok = ok && fwrite(state->tlb_chunk->data, 1, state->tlb_chunk->size, f) == state->tlb_chunk->size;
+    ok = ok && fwrite(&hole_count, sizeof(int), 1, f) == 1;
+    ok = ok && fwrite(state->holes->data, 1, state->holes->size, f) == state->holes->size;
+    return fclose(f) == 0 && ok;
+}
+
+// Every index a loaded state carries must lie inside the table it indexes;
+// the engines use them unchecked once the state is activated
+static int sim_state_valid(const SimState *state) {
+    const SimCounters *c = &state->counters;
+    int frame_limit = c->frame_count > 0 ? c->frame_count : 1;
+    int hole_count = (int)(state->holes->size / sizeof(MemoryBlock));
+    const MemoryBlock *holes = (const MemoryBlock*)state->holes->data;
+
+    if (c->fifo_index < 0 || c->fifo_index >= frame_limit) return 0;
+    if (c->clock_hand < 0 || c->clock_hand >= frame_limit) return 0;
+    if (c->seg_policy < FIT_FIRST || c->seg_policy > FIT_NEXT) return 0; // segments never use buddy
+    if (c->seg_total != MEMORY_SIZE || c->seg_used < 0 || c->seg_used > c->seg_total) return 0;
+    if (c->seg_next_fit < 0 || c->seg_next_fit >= (hole_count > 0 ? hole_count : 1)) return 0;
+    if (c->swap_next < -1 || c->swap_next > c->swap_slots) return 0;
+    if (c->swap_end < 0 || c->swap_end > c->swap_slots) return 0;
+
+    int hole_end = 0;
+    for (int i = 0; i < hole_count; i++) {
+        if (holes[i].start < hole_end || holes[i].size <= 0 || holes[i].size > c->seg_total - holes[i].start) return 0;
+        hole_end = holes[i].start + holes[i].size;
+    }
+
+    for (int p = 0; p < c->process_count; p++) {
+        const Process *proc = (const Process*)state->procs[p]->data;
+        for (int i = 0; i < proc->page_count; i++) {
+            const PageTableEntry *pte = &proc->page_table[i];
+            if (pte->page_no < 0 || pte->page_no >= MAX_PAGES || pte->cow < 0) return 0;
+            if (pte->frame_no < -1 || pte->frame_no >= c->frame_count || (pte->valid && pte->frame_no < 0)) return 0;
+            if (pte->swap_slot < -1 || pte->swap_slot >= c->swap_slots) return 0;
+        }
+        for (int i = 0; i < proc->seg_count; i++) {
+            const SegmentTableEntry *seg = &proc->seg_table[i];
+            if (seg->limit < 0 || seg->limit > c->seg_total || seg->page_base < 0 || seg->page_base > MAX_PAGES) return 0;
+            if (seg->valid && (seg->base < 0 || seg->base > c->seg_total - seg->limit)) return 0;
+        }
+    }
+
+    const TLBEntry *entries = (const TLBEntry*)state->tlb_chunk->data;
+    for (int i = 0; i < 32; i++) {
+        if (entries[i].valid && (entries[i].frame_no < 0 || entries[i].frame_no >= c->frame_count)) return 0;
+    }
+    return 1;
+}
+
+// Reads a file written by sim_state_save, rejecting it if any table size or
+// index in it is out of range
+int sim_state_load(SimState *state, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return 0;
+
+    int header[4];
+    SimCounters c;
+    memset(state, 0, sizeof(*state));
+    int ok = fread(header, sizeof(header), 1, f) == 1 &&
+             header[0] == SNAPSHOT_MAGIC && header[1] == SNAPSHOT_VERSION &&
+             header[2] == MAX_PAGES && header[3] == MAX_SEGMENTS &&
+             fread(&c, sizeof(c), 1, f) == 1 &&
+             c.frame_count >= 0 && c.frame_count <= 1000000 &&
+             c.process_count >= 0 && c.process_count <= MAX_PROCESSES &&
+             c.tlb_size >= 0 && c.tlb_size <= 32 &&
+             c.swap_slots > 0 && c.swap_slots <= 1000000;
+
+    Frame *frames = ok ? (Frame*)malloc(c.frame_count * sizeof(Frame) + 1) : NULL;
+    ok = ok && frames != NULL &&
+         fread(frames, sizeof(Frame), c.frame_count, f) == (size_t)c.frame_count &&
+         (state->frames = chunk_new(frames, c.frame_count * sizeof(Frame))) != NULL;
+    free(frames);
+
+    for (int p = 0; ok && p < c.process_count; p++) {
+        Process proc;
+        memset(&proc, 0, sizeof(proc));
+        ok = fread(&proc.pid, sizeof(int), 1, f) == 1 &&
+             fread(&proc.page_count, sizeof(int), 1, f) == 1 &&
+             fread(&proc.seg_count, sizeof(int), 1, f) == 1 &&
+             proc.page_count >= 0 && proc.page_count <= MAX_PAGES &&
+             proc.seg_count >= 0 && proc.seg_count <= MAX_SEGMENTS &&
+             fread(proc.name, sizeof(proc.name), 1, f) == 1 &&
+             fread(proc.page_table, sizeof(PageTableEntry), proc.page_count, f) == (size_t)proc.page_count &&
+             fread(proc.seg_table, sizeof(SegmentTableEntry), proc.seg_count, f) == (size_t)proc.seg_count;
+        proc.name[sizeof(proc.name) - 1] = '\0';
+        ok = ok && (state->procs[p] = chunk_new(&proc, sizeof(proc))) != NULL;
+    }
+
+    TLBEntry saved_tlb[32];
+    int hole_count = 0;
+    ok = ok && fread(saved_tlb, sizeof(saved_tlb), 1, f) == 1 &&
+         (state->tlb_chunk = chunk_new(saved_tlb, sizeof(saved_tlb))) != NULL &&
+         fread(&hole_count, sizeof(int), 1, f) == 1 && hole_count >= 0 && hole_count <= c.seg_total;
+
+    MemoryBlock *holes = ok ? (MemoryBlock*)malloc(hole_count * sizeof(MemoryBlock) + 1) : NULL;
+    ok = ok && holes != NULL &&
+         fread(holes, sizeof(MemoryBlock), hole_count, f) == (size_t)hole_count &&
+         (state->holes = chunk_new(holes, hole_count * sizeof(MemoryBlock))) != NULL;
+    free(holes);
+    fclose(f);
+
+    state->counters = c;
+    ok = ok && sim_state_valid(state);
+    if (!ok) sim_state_release(state);
+    return ok;
+}
+
+// Warms the simulator up on a trace prefix once, then forks one state per
+// what-if continuation (policy x frame count) instead of replaying the prefix
+// for each of them.
+void simulate_what_if_scenarios() {
+    if (physical_memory == NULL) {
+        printf(COLOR_RED "\nMemory not initialized! Please setup memory frames first.\n" COLOR_RESET);
+        printf("Press Enter to continue...");
+        getchar();
+        return;
+    }
+
+    term_clear();
+    display_header("WHAT-IF SCENARIOS");
+
+    const char *algo_names[] = {"FIFO", "LRU", "Optimal", "Clock"};
+
+    printf("\n" COLOR_CYAN "Reference string length (100-5000000): " COLOR_RESET);
+    int ref_length;
+    if (scanf("%d", &ref_length) != 1) ref_length = 100000;
+    clear_input_buffer();
+    if (ref_length < 100) ref_length = 100;
+    if (ref_length > 5000000) ref_length = 5000000;
+
+    printf(COLOR_CYAN "Warm-up prefix length (1-%d): " COLOR_RESET, ref_length - 1);
+    int prefix;
+    if (scanf("%d", &prefix) != 1) prefix = ref_length / 2;
+    clear_input_buffer();
+    if (prefix < 1) prefix = 1;
+    if (prefix > ref_length - 1) prefix = ref_length - 1;
+
+    printf(COLOR_CYAN "Distinct pages referenced (%d-1000): " COLOR_RESET, frame_count);
+    int page_range;
+    if (scanf("%d", &page_range) != 1) page_range = 32;
+    clear_input_buffer();
+    if (page_range < frame_count) page_range = frame_count;
+    if (page_range > 1000) page_range = 1000;
+
+    printf(COLOR_CYAN "Warm-up algorithm (1=FIFO 2=LRU 3=Optimal 4=Clock): " COLOR_RESET);
+    int warm_algo;
+    if (scanf("%d", &warm_algo) != 1) warm_algo = 2;
+    clear_input_buffer();
+    if (warm_algo < 1 || warm_algo > 4) warm_algo = 2;
+
+    printf(COLOR_CYAN "Extra frames for the larger-memory scenarios (1-64): " COLOR_RESET);
+    int extra_frames;
+    if (scanf("%d", &extra_frames) != 1) extra_frames = 4;
+    clear_input_buffer();
+    if (extra_frames < 1) extra_frames = 1;
+    if (extra_frames > 64) extra_frames = 64;
+
+    int *refs = (int*)malloc(ref_length * sizeof(int));
+    if (refs == NULL) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        return;
+    }
+    fill_reference_string(refs, ref_length, page_range);
+
+    // Keep the user's state so it can be put back afterwards
+    SimState user_state;
+    if (!sim_state_capture(&user_state)) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        free(refs);
+        return;
+    }
+
+    double t0 = get_time_seconds();
+    reset_replacement_state();
+    for (int i = 0; i < prefix; i++) {
+        reference_page(warm_algo, 0, refs[i], refs, ref_length, i);
+    }
+    double warm_time = get_time_seconds() - t0;
+
+    SimState base;
+    if (!sim_state_capture(&base)) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        sim_state_restore(&user_state);
+        free(refs);
+        return;
+    }
+    int base_frames = frame_count;
+
+    SimState branches[MAX_SCENARIOS];
+    int scenario_algo[MAX_SCENARIOS], scenario_frames[MAX_SCENARIOS];
+    int scenario_hits[MAX_SCENARIOS], scenario_faults[MAX_SCENARIOS];
+    int scenarios = 0;
+
+    t0 = get_time_seconds();
+    for (int extra = 0; extra <= 1; extra++) {
+        for (int algo = 1; algo <= 4; algo++) {
+            SimState *b = &branches[scenarios];
+            sim_state_fork(&base, b);
+            scenario_algo[scenarios] = algo;
+            scenario_frames[scenarios] = base_frames + extra * extra_frames;
+            scenarios++;
+        }
+    }
+    double fork_time = get_time_seconds() - t0;
+
+    int ran = 0;
+    for (int s = 0; s < scenarios; s++) {
+        if (!sim_state_activate(&branches[s]) || !resize_frames(scenario_frames[s])) break;
+        int hits_before = page_hits, faults_before = page_faults;
+        for (int i = prefix; i < ref_length; i++) {
+            reference_page(scenario_algo[s], 0, refs[i], refs, ref_length, i);
+        }
+        scenario_hits[s] = page_hits - hits_before;
+        scenario_faults[s] = page_faults - faults_before;
+        sim_state_commit(&branches[s]);
+        ran++;
+    }
+    if (ran < scenarios) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        for (int s = 0; s < scenarios; s++) sim_state_release(&branches[s]);
+        sim_state_release(&base);
+        sim_state_restore(&user_state);
+        free(refs);
+        printf("\nPress Enter to continue...");
+        getchar();
+        return;
+    }
+
+    // Count chunks still shared between the warmed-up base and the branches
+    size_t logical_bytes = 0, shared_bytes = 0;
+    for (int s = 0; s < scenarios; s++) {
+        SharedChunk *chunks[MAX_PROCESSES + 3];
+        SharedChunk *base_chunks[MAX_PROCESSES + 3];
+        int n = 0;
+        chunks[n] = branches[s].frames; base_chunks[n++] = base.frames;
+        chunks[n] = branches[s].tlb_chunk; base_chunks[n++] = base.tlb_chunk;
+        chunks[n] = branches[s].holes; base_chunks[n++] = base.holes;
+        for (int p = 0; p < MAX_PROCESSES; p++) {
+            chunks[n] = branches[s].procs[p]; base_chunks[n++] = base.procs[p];
+        }
+        for (int k = 0; k < n; k++) {
+            if (chunks[k] == NULL) continue;
+            logical_bytes += chunks[k]->size;
+            if (chunks[k] == base_chunks[k]) shared_bytes += chunks[k]->size;
+        }
+    }
+
+    printf("\n" COLOR_GREEN "================================================================\n");
+    printf("                    WHAT-IF SCENARIO RESULTS\n");
+    printf("================================================================\n" COLOR_RESET);
+    printf("Trace: %d references over %d pages, warm-up %d refs with %s on %d frames\n\n",
+           ref_length, page_range, prefix, algo_names[warm_algo - 1], base_frames);
+    printf(COLOR_YELLOW "%-10s %7s %10s %10s %10s\n" COLOR_RESET, "Policy", "Frames", "Hits", "Faults", "Fault %");
+    for (int s = 0; s < scenarios; s++) {
+        int n = ref_length - prefix;
+        printf("%-10s %7d %10d %10d %9.2f%%\n", algo_names[scenario_algo[s] - 1], scenario_frames[s],
+               scenario_hits[s], scenario_faults[s], (float)scenario_faults[s] / n * 100);
+    }
+
+    printf("\n" COLOR_CYAN "Fork Efficiency:" COLOR_RESET "\n");
+    printf("Warm-up replay:    %.3f ms (paid once instead of %d times)\n", warm_time * 1000, scenarios);
+    printf("Forking %d states: %.3f ms\n", scenarios, fork_time * 1000);
+    printf("Branch state:      %zu bytes logical, %zu bytes still shared with the base\n",
+           logical_bytes, shared_bytes);
+
+    for (int s = 0; s < scenarios; s++) sim_state_release(&branches[s]);
+    sim_state_release(&base);
+    sim_state_restore(&user_state);
+    free(refs);
+
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+void snapshot_menu() {
+    term_clear();
+    display_header("SNAPSHOTS & WHAT-IF");
+
+    printf("\n" COLOR_YELLOW "Options:\n" COLOR_RESET);
+    printf(COLOR_CYAN "1." COLOR_RESET " Save simulator state to a snapshot file\n");
+    printf(COLOR_CYAN "2." COLOR_RESET " Restore simulator state from a snapshot file\n");
+    printf(COLOR_CYAN "3." COLOR_RESET " Branch what-if scenarios from a warmed-up state\n");
+    printf(COLOR_CYAN "0." COLOR_RESET " Back\n");
+    printf("\n" COLOR_YELLOW "Enter your choice: " COLOR_RESET);
+
+    int choice;
+    if (scanf("%d", &choice) != 1) choice = 0;
+    clear_input_buffer();
+
+    if (choice == 1 || choice == 2) {
+        char path[256];
+        printf(COLOR_CYAN "Snapshot file: " COLOR_RESET);
+        if (scanf("%255s", path) != 1) strcpy(path, "memsim.snap");
+        clear_input_buffer();
+
+        SimState state;
+        if (choice == 1) {
+            int ok = sim_state_capture(&state) && sim_state_save(&state, path);
+            sim_state_release(&state);
+            if (ok) printf(COLOR_GREEN "State saved to %s\n" COLOR_RESET, path);
+            else printf(COLOR_RED "Could not save snapshot to %s\n" COLOR_RESET, path);
+        } else if (sim_state_load(&state, path)) {
+            int ok = sim_state_activate(&state);
+            sim_state_release(&state);
+            if (ok) {
+                printf(COLOR_GREEN "State restored from %s (%d frames, %d processes)\n" COLOR_RESET,
+                       path, frame_count, process_count);
+            } else {
+                printf(COLOR_RED "Not enough memory to restore %s; the current state is unchanged\n" COLOR_RESET, path);
+            }
+        } else {
+            printf(COLOR_RED "Could not read a valid snapshot from %s\n" COLOR_RESET, path);
+        }
+        printf("\nPress Enter to continue...");
+        getchar();
+    } else if (choice == 3) {
+        simulate_what_if_scenarios();
+    }
+}
+
+// Event Stream Function Implementations
+
+// Asks how a simulation should report its steps and opens the event writer.
+// Falls back to quiet mode if the output file cannot be opened.
+OutputMode prompt_output_mode() {
+    printf("\n" COLOR_YELLOW "Select Output Mode:\n" COLOR_RESET);
+    printf(COLOR_CYAN "1." COLOR_RESET " Coloured step-by-step display\n");
+    printf(COLOR_CYAN "2." COLOR_RESET " NDJSON event stream to file\n");
+    printf(COLOR_CYAN "3." COLOR_RESET " Binary event stream to file\n");
+    printf(COLOR_CYAN "4." COLOR_RESET " Quiet (results only)\n");
+    printf("\n" COLOR_YELLOW "Enter your choice (1-4): " COLOR_RESET);
+
+    int choice;
+    if (scanf("%d", &choice) != 1) choice = 1;
+    clear_input_buffer();
+    if (choice < 1 || choice > 4) choice = 1;
+
+    OutputMode mode = (OutputMode)(choice - 1);
+    char path[256] = "";
+    if (mode == OUTPUT_NDJSON || mode == OUTPUT_BINARY) {
+        printf(COLOR_CYAN "Event file: " COLOR_RESET);
+        if (scanf("%255s", path) != 1) strcpy(path, mode == OUTPUT_NDJSON ? "events.ndjson" : "events.bin");
+        clear_input_buffer();
+    }
+
+    if (!event_writer_open(mode, path)) {
+        printf(COLOR_RED "Cannot open '%s', running in quiet mode.\n" COLOR_RESET, path);
+        event_writer_open(OUTPUT_QUIET, NULL);
+        return OUTPUT_QUIET;
+    }
+    return mode;
+}
+
+int event_writer_open(OutputMode mode, const char *path) {
+    event_writer_close();
+    event_writer.mode = mode;
+    event_writer.events = 0;
+    event_writer.failed = 0;
+    if (mode != OUTPUT_NDJSON && mode != OUTPUT_BINARY) return 1;
+
+    event_writer.out = fopen(path, mode == OUTPUT_BINARY ? "wb" : "w");
+    event_writer.buffer = (char*)malloc(EVENT_BUFFER_SIZE);
+    if (event_writer.out == NULL || event_writer.buffer == NULL) {
+        event_writer_close();
+        return 0;
+    }
+
+    if (mode == OUTPUT_BINARY) {
+        int header[3] = {EVENT_MAGIC, EVENT_VERSION, (int)sizeof(SimEvent)};
+        if (fwrite(header, sizeof(header), 1, event_writer.out) != 1) event_writer.failed = 1;
+    }
+    return 1;
+}
+
+// Writes the buffered events out; after a failed write the rest are dropped
+void event_writer_flush() {
+    if (event_writer.out != NULL && event_writer.used > 0 && !event_writer.failed) {
+        if (fwrite(event_writer.buffer, 1, event_writer.used, event_writer.out) != event_writer.used) {
+            event_writer.failed = 1;
+        }
+    }
+    event_writer.used = 0;
+}
+
+// Returns 0 if any event could not be written (disk full, closed pipe)
+int event_writer_close() {
+    event_writer_flush();
+    if (event_writer.out != NULL && fclose(event_writer.out) != 0) event_writer.failed = 1;
+    int ok = !event_writer.failed;
+    free(event_writer.buffer);
+    event_writer.out = NULL;
+    event_writer.buffer = NULL;
+    event_writer.used = 0;
+    event_writer.mode = OUTPUT_DISPLAY;
+    event_writer.failed = 0;
+    return ok;
+}
+
+// Appends a decimal integer; avoids snprintf's format parsing on the hot path
+static char *append_int(char *p, int value) {
+    char digits[12];
+    int n = 0;
+    unsigned int v = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    if (value < 0) *p++ = '-';
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v > 0);
+    while (n > 0) *p++ = digits[--n];
+    return p;
+}
+
+static char *append_str(char *p, const char *str) {
+    while (*str) *p++ = *str++;
+    return p;
+}
+
+void emit_event(EventType type, int step, int pid, int page, int frame) {
+    static const char *type_names[] = {"hit", "fault", "evict", "tlb_hit", "tlb_miss"};
+
+    if (event_writer.out == NULL) return;
+    if (event_writer.used + 128 > EVENT_BUFFER_SIZE) event_writer_flush();
+
+    if (event_writer.mode == OUTPUT_BINARY) {
+        SimEvent ev;
+        ev.type = (unsigned char)type;
+        ev.pid = (unsigned char)pid;
+        ev.reserved = 0;
+        ev.frame = frame;
+        ev.step = step;
+        ev.page = page;
+        memcpy(event_writer.buffer + event_writer.used, &ev, sizeof(ev));
+        event_writer.used += sizeof(ev);
+    } else {
+        char *p = event_writer.buffer + event_writer.used;
+        p = append_str(p, "{\"ev\":\"");
+        p = append_str(p, type_names[type]);
+        p = append_str(p, "\",\"step\":");
+        p = append_int(p, step);
+        p = append_str(p, ",\"pid\":");
+        p = append_int(p, pid);
+        p = append_str(p, ",\"page\":");
+        p = append_int(p, page);
+        p = append_str(p, ",\"frame\":");
+        p = append_int(p, frame);
+        p = append_str(p, "}\n");
+        event_writer.used = p - event_writer.buffer;
+    }
+    event_writer.events++;
+}
+
+// A fault that replaced a page is written as an evict event followed by the fault
+void emit_reference_events(int step, int pid, int page_no, const ReferenceResult *r) {
+    if (r->hit) {
+        emit_event(EV_HIT, step, pid, page_no, r->frame_no);
+        return;
+    }
+    if (r->victim_page >= 0) emit_event(EV_EVICT, step, r->victim_pid, r->victim_page, r->frame_no);
+    emit_event(EV_FAULT, step, pid, page_no, r->frame_no);
+}
+
+// Simulation Server Function Implementations
+
+int tb_reserve(TextBuffer *tb, size_t extra) {
+    if (tb->len + extra + 1 <= tb->cap) return 1;
+    size_t cap = tb->cap > 0 ? tb->cap : 4096;
+    while (cap < tb->len + extra + 1) cap *= 2;
+    char *grown = (char*)realloc(tb->data, cap);
+    if (grown == NULL) return 0;
+    tb->data = grown;
+    tb->cap = cap;
+    return 1;
+}
+
+int tb_append(TextBuffer *tb, const char *data, size_t len) {
+    if (!tb_reserve(tb, len)) return 0;
+    memcpy(tb->data + tb->len, data, len);
+    tb->len += len;
+    tb->data[tb->len] = '\0';
+    return 1;
+}
+
+int tb_printf(TextBuffer *tb, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int needed = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (needed < 0 || !tb_reserve(tb, (size_t)needed)) return 0;
+
+    va_start(args, fmt);
+    vsnprintf(tb->data + tb->len, (size_t)needed + 1, fmt, args);
+    va_end(args);
+    tb->len += (size_t)needed;
+    return 1;
+}
+
+void tb_free(TextBuffer *tb) {
+    free(tb->data);
+    tb->data = NULL;
+    tb->len = 0;
+    tb->cap = 0;
+}
+
+// Runs a whole reference string on a fresh memory of the given size, through
+// the policy kernel when it can be used and the native engine otherwise.
+// Returns 0 if a page is outside 0..MAX_PAGES-1 or neither can allocate what
+// it needs.
+int run_policy(int algo_choice, int frames, const int *refs, int ref_length, int *hits, int *faults) {
+    for (int i = 0; i < ref_length; i++) {
+        if (refs[i] < 0 || refs[i] >= MAX_PAGES) return 0;
+    }
+    
+    KernelResult kr = {0, 0, NULL};
+    if (run_replacement_kernel(algo_choice, frames, refs, ref_length, &kr)) {
+        *hits = kr.hits;
+        *faults = kr.faults;
+        return 1;
+    }
+    
+    if (!resize_frames(frames)) return 0;
+    reset_replacement_state();
+    for (int i = 0; i < ref_length; i++) {
+        reference_page(algo_choice, 0, refs[i], refs, ref_length, i);
+    }
+    *hits = page_hits;
+    *faults = page_faults;
+    return 1;
+}
+
+#ifndef _WIN32
+
+// Minimal JSON field lookups for the small request bodies the web UI sends
+static const char *json_field(const char *body, const char *key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    const char *p = strstr(body, pattern);
+    if (p == NULL) return NULL;
+    p = strchr(p + strlen(pattern), ':');
+    if (p == NULL) return NULL;
+    p++;
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    return p;
+}
+
+static int json_int(const char *body, const char *key, int fallback) {
+    const char *p = json_field(body, key);
+    if (p == NULL) return fallback;
+    if (*p == 't') return 1; // true
+    if (*p == 'f') return 0; // false
+    return (int)strtol(p, NULL, 10);
+}
+
+static void json_string(const char *body, const char *key, char *out, size_t size) {
+    const char *p = json_field(body, key);
+    size_t n = 0;
+    out[0] = '\0';
+    if (p == NULL || *p != '"') return;
+    p++;
+    while (*p && *p != '"' && n + 1 < size) out[n++] = *p++;
+    out[n] = '\0';
+}
+
+// Parses "key": [1, 2, 3] into a malloc'd array
+static int *json_int_array(const char *body, const char *key, int *count) {
+    const char *p = json_field(body, key);
+    *count = 0;
+    if (p == NULL || *p != '[') return NULL;
+    p++;
+
+    int cap = 1024;
+    int *values = (int*)malloc(cap * sizeof(int));
+    while (values != NULL) {
+        char *end;
+        while (*p == ' ' || *p == ',' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+        if (*p == ']' || *p == '\0') break;
+        long v = strtol(p, &end, 10);
+        if (end == p) break;
+        if (*count == cap) {
+            int *grown = (int*)realloc(values, 2 * cap * sizeof(int));
+            if (grown == NULL) {
+                free(values);
+                return NULL;
+            }
+            values = grown;
+            cap *= 2;
+        }
+        values[(*count)++] = v < -1 || v > 2147483647L ? -1 : (int)v; // out of int range is never a page
+        p = end;
+    }
+    return values;
+}
+
+static int algo_from_name(const char *name) {
+    const char *names[] = {"FIFO", "LRU", "OPTIMAL", "CLOCK"};
+    for (int a = 0; a < 4; a++) {
+        int match = 1;
+        for (int i = 0; match && (name[i] || names[a][i]); i++) {
+            char c = name[i];
+            if (c >= 'a' && c <= 'z') c = (char)(c - 'a' + 'A');
+            match = c == names[a][i];
+        }
+        if (match) return a + 1;
+    }
+    return 0;
+}
+
+// Copies the value of a request header (case-insensitive name) into out, "" if absent
+static void server_header(const char *request, const char *name, char *out, size_t size) {
+    const char *end = strstr(request, "\r\n\r\n");
+    size_t name_len = strlen(name);
+    out[0] = '\0';
+    for (const char *line = request; end != NULL && line < end; ) {
+        size_t i = 0;
+        while (i < name_len && (line[i] | 0x20) == (name[i] | 0x20)) i++;
+        if (i == name_len && line[i] == ':') {
+            const char *v = line + i + 1;
+            while (*v == ' ' || *v == '\t') v++;
+            size_t n = 0;
+            while (v[n] != '\r' && v[n] != '\0' && n + 1 < size) n++;
+            memcpy(out, v, n);
+            out[n] = '\0';
+            return;
+        }
+        const char *next = strstr(line, "\r\n");
+        if (next == NULL) break;
+        line = next + 2;
+    }
+}
+
+// Browsers may call the server from a page on this machine or from the origin
+// given on the command line; any other site is refused so it cannot drive the
+// engine from a visitor's browser
+static int server_origin_allowed(const char *origin) {
+    static const char *local[] = {"http://localhost", "http://127.0.0.1", "http://[::1]"};
+    if (origin[0] == '\0') return 1; // not a browser request
+    if (server_ui_origin != NULL && strcmp(origin, server_ui_origin) == 0) return 1;
+    for (int i = 0; i < 3; i++) {
+        size_t n = strlen(local[i]);
+        if (strncmp(origin, local[i], n) == 0 && (origin[n] == '\0' || origin[n] == ':')) return 1;
+    }
+    return 0;
+}
+
+static void server_respond(ServerClient *c, int status, const char *reason, const TextBuffer *body) {
+    c->response.len = 0;
+    tb_printf(&c->response,
+              "HTTP/1.1 %d %s\r\n"
+              "Content-Type: application/json\r\n"
+              "Content-Length: %zu\r\n",
+              status, reason, body != NULL ? body->len : 0);
+    if (c->origin[0] != '\0') {
+        tb_printf(&c->response,
+                  "Access-Control-Allow-Origin: %s\r\n"
+                  "Vary: Origin\r\n"
+                  "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
+                  "Access-Control-Allow-Headers: Content-Type\r\n"
+                  "Access-Control-Allow-Private-Network: true\r\n",
+                  c->origin);
+    }
+    tb_printf(&c->response, "Connection: close\r\n\r\n");
+    if (body != NULL && body->len > 0) tb_append(&c->response, body->data, body->len);
+    c->sent = 0;
+    c->writing = 1;
+}
+
+static void server_error(ServerClient *c, int status, const char *reason, const char *message) {
+    TextBuffer body = {NULL, 0, 0};
+    tb_printf(&body, "{\"error\":\"%s\"}", message);
+    server_respond(c, status, reason, &body);
+    tb_free(&body);
+}
+
+static void server_handle_request(ServerClient *c) {
+    static const char *algo_names[] = {"FIFO", "LRU", "OPTIMAL", "CLOCK"};
+    char method[8] = "", path[64] = "";
+    sscanf(c->request.data, "%7s %63s", method, path);
+    const char *body = strstr(c->request.data, "\r\n\r\n");
+    body = body != NULL ? body + 4 : "";
+
+    server_header(c->request.data, "Origin", c->origin, sizeof(c->origin));
+    if (!server_origin_allowed(c->origin)) {
+        c->origin[0] = '\0';
+        server_error(c, 403, "Forbidden", "origin not allowed");
+        return;
+    }
+    if (strcmp(method, "OPTIONS") == 0) {
+        server_respond(c, 204, "No Content", NULL);
+        return;
+    }
+    if (strcmp(method, "GET") == 0 && strcmp(path, "/health") == 0) {
+        TextBuffer out = {NULL, 0, 0};
+        tb_printf(&out, "{\"status\":\"ok\",\"engine\":\"native\",\"algorithms\":[\"FIFO\",\"LRU\",\"OPTIMAL\",\"CLOCK\"]}");
+        server_respond(c, 200, "OK", &out);
+        tb_free(&out);
+        return;
+    }
+    if (strcmp(method, "POST") != 0 || (strcmp(path, "/simulate") != 0 && strcmp(path, "/compare") != 0)) {
+        server_error(c, 404, "Not Found", "unknown endpoint");
+        return;
+    }
+
+    int frames = json_int(body, "frames", 4);
+    int ref_length;
+    int *refs = json_int_array(body, "refs", &ref_length);
+    if (refs == NULL || ref_length == 0 || frames < 1 || frames > SERVER_MAX_FRAMES) {
+        free(refs);
+        server_error(c, 400, "Bad Request", "expected frames (1-4096) and a non-empty refs array");
+        return;
+    }
+    for (int i = 0; i < ref_length; i++) {
+        if (refs[i] < 0 || refs[i] >= MAX_PAGES) {
+            char message[64];
+            snprintf(message, sizeof(message), "refs must be page numbers from 0 to %d", MAX_PAGES - 1);
+            free(refs);
+            server_error(c, 400, "Bad Request", message);
+            return;
+        }
+    }
+
+    // The loop runs one request at a time, so a request's cost is everyone's
+    // wait: refuse ones above SERVER_MAX_WORK engine steps. The engine scans the
+    // frames on every reference and Optimal can scan the rest of the string on
+    // every fault; the /compare kernels only ever scan the resident pages.
+    char algo_name[16];
+    json_string(body, "algorithm", algo_name, sizeof(algo_name));
+    int algo = algo_from_name(algo_name);
+    long long work = strcmp(path, "/compare") == 0 ?
+                     4LL * ref_length * (frames < MAX_PAGES ? frames : MAX_PAGES) :
+                     (long long)ref_length * frames + (algo == 3 ? (long long)ref_length * ref_length : 0);
+    if (ref_length > SERVER_MAX_REFS || work > SERVER_MAX_WORK) {
+        free(refs);
+        server_error(c, 413, "Payload Too Large", "simulation too large; use fewer refs or frames");
+        return;
+    }
+
+    TextBuffer out = {NULL, 0, 0};
+    double start = get_time_seconds();
+    int ok = 1;
+
+    if (strcmp(path, "/compare") == 0) {
+        tb_printf(&out, "{\"frames\":%d,\"length\":%d,\"results\":[", frames, ref_length);
+        for (int a = 1; ok && a <= 4; a++) {
+            int hits = 0, faults = 0;
+            ok = run_policy(a, frames, refs, ref_length, &hits, &faults);
+            tb_printf(&out, "%s{\"algorithm\":\"%s\",\"hits\":%d,\"faults\":%d,\"hitRatio\":\"%.1f\"}",
+                      a > 1 ? "," : "", algo_names[a - 1], hits, faults, (double)hits / ref_length * 100);
+        }
+        tb_printf(&out, "],\"elapsedMs\":%.3f}", (get_time_seconds() - start) * 1000);
+    } else {
+        int with_steps = json_int(body, "steps", 0);
+        if (algo == 0) {
+            free(refs);
+            tb_free(&out);
+            server_error(c, 400, "Bad Request", "algorithm must be FIFO, LRU, OPTIMAL or CLOCK");
+            return;
+        }
+        if (!resize_frames(frames)) {
+            free(refs);
+            tb_free(&out);
+            server_error(c, 503, "Service Unavailable", "frame allocation failed");
+            return;
+        }
+
+        // Per-step results as parallel arrays: frame used, hit flag, evicted page
+        TextBuffer steps = {NULL, 0, 0};
+        reset_replacement_state();
+        if (with_steps) tb_append(&steps, ",\"steps\":{\"frame\":[", 19);
+        int *victims = with_steps ? (int*)malloc(ref_length * sizeof(int)) : NULL;
+        char *hit_flags = with_steps ? (char*)malloc(ref_length) : NULL;
+        with_steps = with_steps && victims != NULL && hit_flags != NULL;
+
+        for (int i = 0; i < ref_length; i++) {
+            ReferenceResult r = reference_page(algo, 0, refs[i], refs, ref_length, i);
+            if (with_steps) {
+                tb_printf(&steps, i > 0 ? ",%d" : "%d", r.frame_no);
+                hit_flags[i] = (char)r.hit;
+                victims[i] = r.victim_page;
+            }
+        }
+        if (with_steps) {
+            tb_append(&steps, "],\"hit\":[", 9);
+            for (int i = 0; i < ref_length; i++) tb_printf(&steps, i > 0 ? ",%d" : "%d", hit_flags[i]);
+            tb_append(&steps, "],\"victim\":[", 12);
+            for (int i = 0; i < ref_length; i++) tb_printf(&steps, i > 0 ? ",%d" : "%d", victims[i]);
+            tb_append(&steps, "]}", 2);
+        }
+        free(victims);
+        free(hit_flags);
+
+        tb_printf(&out, "{\"algorithm\":\"%s\",\"frames\":%d,\"length\":%d,\"hits\":%d,\"faults\":%d,"
+                        "\"hitRatio\":\"%.1f\",\"elapsedMs\":%.3f",
+                  algo_names[algo - 1], frames, ref_length, page_hits, page_faults,
+                  (double)page_hits / ref_length * 100, (get_time_seconds() - start) * 1000);
+        if (steps.len > 0) tb_append(&out, steps.data, steps.len);
+        tb_append(&out, "}", 1);
+        tb_free(&steps);
+    }
+
+    if (ok) server_respond(c, 200, "OK", &out);
+    else server_error(c, 500, "Internal Server Error", "frame allocation failed");
+    printf("%s %s frames=%d refs=%d %.3f ms\n", method, path, frames, ref_length,
+           (get_time_seconds() - start) * 1000);
+    fflush(stdout);
+    free(refs);
+    tb_free(&out);
+}
+
+// Returns 1 once the whole request (headers and Content-Length body) has arrived
+static int server_request_complete(const TextBuffer *req) {
+    if (req->data == NULL) return 0;
+    const char *end = strstr(req->data, "\r\n\r\n");
+    if (end == NULL) return 0;
+
+    long content_length = 0;
+    for (const char *line = req->data; line < end; ) {
+        const char *key = "content-length:";
+        int i = 0;
+        while (key[i] && (line[i] == key[i] || line[i] == key[i] - 'a' + 'A')) i++;
+        if (key[i] == '\0') content_length = strtol(line + i, NULL, 10);
+        const char *next = strstr(line, "\r\n");
+        if (next == NULL) break;
+        line = next + 2;
+    }
+    return (long)(req->len - (size_t)(end + 4 - req->data)) >= content_length;
+}
+
+static void server_close_client(ServerClient *c) {
+    close(c->fd);
+    c->fd = -1;
+    c->sent = 0;
+    c->writing = 0;
+    c->request.len = 0;
+    c->response.len = 0;
+}
+
+// Single-threaded event loop: poll() multiplexes every connection with
+// non-blocking sockets, and each complete request runs on the native engine.
+// Requests are bounded by SERVER_MAX_REQUEST bytes and SERVER_MAX_WORK engine
+// steps so none can hold the loop for long.
+int run_simulation_server(int port) {
+    static ServerClient clients[SERVER_MAX_CLIENTS];
+    struct pollfd fds[SERVER_MAX_CLIENTS + 1];
+    int slot_of[SERVER_MAX_CLIENTS + 1];
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        perror("socket");
+        return 0;
+    }
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)port);
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 64) < 0) {
+        perror("bind/listen");
+        close(listener);
+        return 0;
+    }
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+
+    for (int i = 0; i < SERVER_MAX_CLIENTS; i++) clients[i].fd = -1;
+    printf("Simulation server listening on http://127.0.0.1:%d (browser origins: localhost%s%s)\n", port,
+           server_ui_origin != NULL ? ", " : "", server_ui_origin != NULL ? server_ui_origin : "");
+    fflush(stdout);
+
+    for (;;) {
+        int nfds = 0;
+        fds[nfds].fd = listener;
+        fds[nfds].events = POLLIN;
+        slot_of[nfds++] = -1;
+        for (int i = 0; i < SERVER_MAX_CLIENTS; i++) {
+            if (clients[i].fd < 0) continue;
+            fds[nfds].fd = clients[i].fd;
+            fds[nfds].events = clients[i].writing ? POLLOUT : POLLIN;
+            slot_of[nfds++] = i;
+        }
+
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        for (int k = 1; k < nfds; k++) {
+            ServerClient *c = &clients[slot_of[k]];
+            if (fds[k].revents & (POLLERR | POLLNVAL)) {
+                server_close_client(c);
+                continue;
+            }
+
+            if (!c->writing && (fds[k].revents & (POLLIN | POLLHUP))) {
+                if (!tb_reserve(&c->request, 65536)) {
+                    server_close_client(c);
+                    continue;
+                }
+                ssize_t n = recv(c->fd, c->request.data + c->request.len, 65536, 0);
+                if (n <= 0) {
+                    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+                    server_close_client(c);
+                    continue;
+                }
+                c->request.len += (size_t)n;
+                c->request.data[c->request.len] = '\0';
+
+                if (c->request.len > SERVER_MAX_REQUEST) {
+                    server_error(c, 413, "Payload Too Large", "request too large");
+                } else if (server_request_complete(&c->request)) {
+                    server_handle_request(c);
+                }
+            } else if (c->writing && (fds[k].revents & POLLOUT)) {
+                ssize_t n = send(c->fd, c->response.data + c->sent, c->response.len - c->sent, 0);
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+                if (n <= 0) {
+                    server_close_client(c);
+                    continue;
+                }
+                c->sent += (size_t)n;
+                if (c->sent >= c->response.len) server_close_client(c);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            for (;;) {
+                int fd = accept(listener, NULL, NULL);
+                if (fd < 0) break;
+                int slot = -1;
+                for (int i = 0; i < SERVER_MAX_CLIENTS && slot < 0; i++) {
+                    if (clients[i].fd < 0) slot = i;
+                }
+                if (slot < 0) {
+                    close(fd); // at capacity; the client retries
+                    continue;
+                }
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                clients[slot].fd = fd;
+                clients[slot].writing = 0;
+                clients[slot].sent = 0;
+                clients[slot].request.len = 0;
+                clients[slot].origin[0] = '\0';
+            }
+        }
+    }
+
+    close(listener);
+    return 0;
+}
+
+#else
+
+int run_simulation_server(int port) {
+    (void)port;
+    printf("Server mode is not supported on Windows builds.\n");
+    return 0;
+}
+
+#endif
+
+// Prefetch Function Implementations
+
+// Synthetic traces with the structure readahead exploits. pattern: 1 = sequential
+// scans, 2 = strided scans, 3 = mixed scans, strides and random bursts, 4 = random
+void generate_prefetch_trace(int *refs, int length, int page_space, int pattern) {
+    int i = 0;
+    while (i < length) {
+        int kind = pattern;
+        if (pattern == 3) {
+            int roll = rand() % 4;
+            kind = roll < 2 ? 1 : (roll == 2 ? 2 : 4);
+        }
+
+        int page = rand() % page_space;
+        int stride = kind == 1 ? 1 : 2 + rand() % 4;
+        if (kind == 2 && rand() % 4 == 0) stride = -stride; // some scans run backwards
+        int run = kind == 4 ? 1 + rand() % 8 : 8 + rand() % 25;
+
+        for (int k = 0; k < run && i < length; k++) {
+            refs[i++] = page;
+            page = kind == 4 ? rand() % page_space : (page + stride + page_space) % page_space;
+        }
+    }
+}
+
+// Issues one speculative load and accounts for it. polluted[] marks pages a
+// prefetch evicted so a later demand fault on them can be attributed.
+static void prefetch_issue(Prefetcher *pf, PrefetchStats *stats, int algo_choice, int page_no,
+                           const int *refs, int length, int index, unsigned char *polluted) {
+    if (page_no < 0 || page_no >= pf->page_space) return;
+
+    ReferenceResult r = prefetch_page(algo_choice, 0, page_no, refs, length, index);
+    if (r.frame_no < 0) {
+        stats->redundant++;
+        return;
+    }
+
+    stats->issued++;
+    polluted[page_no] = 0;
+    if (r.victim_page >= 0) {
+        stats->evictions++;
+        if (r.victim_prefetched) {
+            stats->unused_evicted++;
+        } else if (r.victim_page < pf->page_space) {
+            polluted[r.victim_page] = 1;
+        }
+    }
+}
+
+// Decides what to read ahead after a demand reference and loads it through the
+// active replacement policy
+void prefetch_on_reference(Prefetcher *pf, PrefetchStats *stats, int algo_choice, int page_no,
+                           const ReferenceResult *r, const int *refs, int length, int index,
+                           unsigned char *polluted) {
+    int start = 0, step = 1, count = 0;
+    bool sequential = page_no == pf->last_page + 1;
+
+    switch (pf->policy) {
+        case PREFETCH_NONE:
+            break;
+        case PREFETCH_SEQUENTIAL:
+            if (!r->hit) {
+                start = page_no + 1;
+                count = pf->window;
+            }
+            break;
+        case PREFETCH_ADAPTIVE:
+            if (!r->hit) {
+                // A fault that continues a stream keeps growing; anything else starts over
+                pf->cur_window = sequential ? pf->cur_window * 2 : pf->window;
+                if (pf->cur_window > pf->max_window) pf->cur_window = pf->max_window;
+                start = page_no + 1;
+                count = pf->cur_window;
+                pf->ra_end = page_no + count;
+                pf->ra_marker = start;
+            } else if (r->prefetch_hit && page_no == pf->ra_marker) {
+                // The stream reached the last window: read the next, larger one while
+                // keeping no more than max_window pages ahead of the reader
+                pf->cur_window *= 2;
+                if (pf->cur_window > pf->max_window) pf->cur_window = pf->max_window;
+                start = pf->ra_end + 1;
+                count = pf->cur_window;
+                if (count > pf->max_window - (pf->ra_end - page_no)) {
+                    count = pf->max_window - (pf->ra_end - page_no);
+                }
+                if (count > 0) {
+                    pf->ra_marker = start;
+                    pf->ra_end += count;
+                }
+            }
+            break;
+        case PREFETCH_STRIDE: {
+            int stride = page_no - pf->last_page;
+            if (stride != 0 && stride == pf->last_stride) {
+                pf->stride_hits++;
+            } else {
+                pf->stride_hits = 0;
+                pf->last_stride = stride;
+            }
+            if (pf->stride_hits >= 1) {
+                start = page_no + stride;
+                step = stride;
+                count = pf->window;
+            }
+            break;
+        }
+    }
+    pf->last_page = page_no;
+
+    for (int k = 0; k < count; k++) {
+        prefetch_issue(pf, stats, algo_choice, start + k * step, refs, length, index, polluted);
+    }
+}
+
+// Runs a reference string from empty memory with the given policy and prefetcher
+void run_prefetch_simulation(int algo_choice, Prefetcher *pf, const int *refs, int length,
+                             PrefetchStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    pf->cur_window = pf->window;
+    pf->ra_end = -1;
+    pf->ra_marker = -1;
+    pf->last_page = -2;
+    pf->last_stride = 0;
+    pf->stride_hits = 0;
+
+    unsigned char *polluted = (unsigned char*)calloc(pf->page_space, 1);
+    if (polluted == NULL) return;
+
+    reset_replacement_state();
+    for (int i = 0; i < length; i++) {
+        ReferenceResult r = reference_page(algo_choice, 0, refs[i], refs, length, i);
+
+        if (r.hit) {
+            if (r.prefetch_hit) stats->useful++;
+        } else {
+            stats->demand_faults++;
+            if (r.victim_prefetched) stats->unused_evicted++;
+            if (polluted[refs[i]]) {
+                stats->pollution_faults++;
+                polluted[refs[i]] = 0;
+            }
+        }
+
+        if (pf->policy != PREFETCH_NONE) {
+            prefetch_on_reference(pf, stats, algo_choice, refs[i], &r, refs, length, i, polluted);
+        }
+    }
+
+    free(polluted);
+}
+
+void simulate_prefetching() {
+    if (physical_memory == NULL) {
+        printf(COLOR_RED "\nMemory not initialized! Please setup memory frames first.\n" COLOR_RESET);
+        printf("Press Enter to continue...");
+        getchar();
+        return;
+    }
+
+    term_clear();
+    display_header("PREFETCH / READAHEAD SIMULATION");
+
+    const char *algo_names[] = {"FIFO", "LRU", "Optimal", "Clock"};
+    const char *pattern_names[] = {"Sequential scans", "Strided scans", "Mixed", "Random"};
+    const char *prefetch_names[] = {"None", "Sequential", "Adaptive", "Stride"};
+
+    printf("\n" COLOR_CYAN "Replacement algorithm (1=FIFO 2=LRU 3=Optimal 4=Clock): " COLOR_RESET);
+    int algo_choice;
+    if (scanf("%d", &algo_choice) != 1) algo_choice = 2;
+    clear_input_buffer();
+    if (algo_choice < 1 || algo_choice > 4) algo_choice = 2;
+
+    printf(COLOR_CYAN "Access pattern (1=Sequential 2=Strided 3=Mixed 4=Random): " COLOR_RESET);
+    int pattern;
+    if (scanf("%d", &pattern) != 1) pattern = 3;
+    clear_input_buffer();
+    if (pattern < 1 || pattern > 4) pattern = 3;
+
+    printf(COLOR_CYAN "Reference string length (100-%d): " COLOR_RESET, MAX_STREAM_REFS);
+    int ref_length;
+    if (scanf("%d", &ref_length) != 1) ref_length = 10000;
+    clear_input_buffer();
+    if (ref_length < 100) ref_length = 100;
+    if (ref_length > MAX_STREAM_REFS) ref_length = MAX_STREAM_REFS;
+
+    printf(COLOR_CYAN "Pages in the address space (%d-65536): " COLOR_RESET, frame_count);
+    int page_space;
+    if (scanf("%d", &page_space) != 1) page_space = 64;
+    clear_input_buffer();
+    if (page_space < frame_count) page_space = frame_count;
+    if (page_space > 65536) page_space = 65536;
+
+    // A trigger may not read more than memory minus the page just faulted in
+    int window_limit = frame_count - 1;
+    printf(COLOR_CYAN "Readahead window in pages (1-%d): " COLOR_RESET, window_limit);
+    int window;
+    if (scanf("%d", &window) != 1) window = 2;
+    clear_input_buffer();
+    if (window < 1) window = 1;
+    if (window > window_limit) window = window_limit;
+
+    printf(COLOR_CYAN "Adaptive maximum window (%d-%d): " COLOR_RESET, window, window_limit);
+    int max_window;
+    if (scanf("%d", &max_window) != 1) max_window = frame_count / 2;
+    clear_input_buffer();
+    if (max_window < window) max_window = window;
+    if (max_window > window_limit) max_window = window_limit;
+
+    int *refs = (int*)malloc(ref_length * sizeof(int));
+    if (refs == NULL) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        return;
+    }
+    generate_prefetch_trace(refs, ref_length, page_space, pattern);
+
+    // Keep the user's state so it can be put back afterwards
+    SimState user_state;
+    if (!sim_state_capture(&user_state)) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        free(refs);
+        return;
+    }
+
+    PrefetchStats results[4];
+    double elapsed[4];
+    for (int p = PREFETCH_NONE; p <= PREFETCH_STRIDE; p++) {
+        Prefetcher pf = {(PrefetchPolicy)p, window, max_window, page_space, 0, 0, 0, 0, 0, 0};
+        double t0 = get_time_seconds();
+        run_prefetch_simulation(algo_choice, &pf, refs, ref_length, &results[p]);
+        elapsed[p] = get_time_seconds() - t0;
+    }
+
+    sim_state_restore(&user_state);
+
+    long baseline = results[PREFETCH_NONE].demand_faults;
+
+    printf("\n" COLOR_GREEN "================================================================\n");
+    printf("                    PREFETCH SIMULATION RESULTS\n");
+    printf("================================================================\n" COLOR_RESET);
+    printf("Trace: %d references, %s over %d pages\n", ref_length, pattern_names[pattern - 1], page_space);
+    printf("Policy: %s on %d frames | window %d, adaptive up to %d\n\n",
+           algo_names[algo_choice - 1], frame_count, window, max_window);
+
+    printf(COLOR_YELLOW "%-11s %9s %9s %8s %9s %9s %9s %9s %9s\n" COLOR_RESET, "Prefetcher", "Faults",
+           "Change", "Issued", "Accuracy", "Coverage", "Unused", "Evicted", "Polluted");
+    for (int p = PREFETCH_NONE; p <= PREFETCH_STRIDE; p++) {
+        const PrefetchStats *s = &results[p];
+        long change = s->demand_faults - baseline;
+        float accuracy = s->issued ? (float)s->useful / s->issued * 100 : 0;
+        float coverage = s->useful + s->demand_faults ?
+                         (float)s->useful / (s->useful + s->demand_faults) * 100 : 0;
+        const char *color = change < 0 ? COLOR_GREEN : (change > 0 ? COLOR_RED : COLOR_RESET);
+
+        printf("%-11s %9ld %s%+9ld" COLOR_RESET " %8ld %8.1f%% %8.1f%% %9ld %9ld %9ld\n",
+               prefetch_names[p], s->demand_faults, color, change, s->issued, accuracy, coverage,
+               s->unused_evicted, s->evictions, s->pollution_faults);
+    }
+
+    printf("\n" COLOR_CYAN "Columns:" COLOR_RESET "\n");
+    printf("Change:   demand faults relative to demand paging (%ld faults)\n", baseline);
+    printf("Accuracy: prefetched pages referenced before eviction / prefetches issued\n");
+    printf("Coverage: references served by a prefetch / (those + remaining demand faults)\n");
+    printf("Unused:   prefetched pages evicted without ever being referenced\n");
+    printf("Evicted:  resident pages evicted to make room for prefetches\n");
+    printf("Polluted: demand faults on pages that a prefetch had evicted\n");
+
+    printf("\n" COLOR_CYAN "Simulation time:" COLOR_RESET);
+    for (int p = PREFETCH_NONE; p <= PREFETCH_STRIDE; p++) {
+        printf(" %s %.1f ms%s", prefetch_names[p], elapsed[p] * 1000, p < PREFETCH_STRIDE ? " |" : "\n");
+    }
+
+    free(refs);
+
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+// Backing Store Function Implementations
+
+static void io_heap_push(IoEvent *heap, int *n, IoEvent ev) {
+    int i = (*n)++;
+    while (i > 0 && heap[(i - 1) / 2].time > ev.time) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = ev;
+}
+
+static IoEvent io_heap_pop(IoEvent *heap, int *n) {
+    IoEvent top = heap[0];
+    IoEvent last = heap[--(*n)];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= *n) break;
+        if (child + 1 < *n && heap[child + 1].time < heap[child].time) child++;
+        if (heap[child].time >= last.time) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*n > 0) heap[i] = last;
+    return top;
+}
+
+// Discrete-event run of processes[0..nproc-1], each replaying its own reference
+// string on a single CPU that shares frame_count frames and one backing store.
+// A fault blocks its process until the page read completes while the CPU runs
+// other processes, so faults overlap on the device up to its queue depth. Dirty
+// victims add a write-back that competes for the device. Optimal only looks
+// ahead in the faulting process's string.
+int run_backing_store_simulation(int algo_choice, int nproc, int **refs, int length,
+                                 const BackingStoreModel *dev, double cpu_ns, int quantum,
+                                 BackingStoreResults *out) {
+    memset(out, 0, sizeof(*out));
+    IoEvent *heap = (IoEvent*)malloc((dev->queue_depth + 1) * sizeof(IoEvent));
+    int pending_cap = 64, pending_head = 0, pending_count = 0;
+    IoEvent *pending = (IoEvent*)malloc(pending_cap * sizeof(IoEvent)); // queued requests, FIFO ring
+    int *pos = (int*)calloc(nproc, sizeof(int));
+    int *ready = (int*)malloc(nproc * sizeof(int));
+    if (heap == NULL || pending == NULL || pos == NULL || ready == NULL) {
+        free(heap); free(pending); free(pos); free(ready);
+        return 0;
+    }
+
+    double latency_ns = dev->latency_us * 1000.0;
+    double transfer_ns = PAGE_BYTES / (dev->bandwidth_mbs * 1e6) * 1e9;
+    double bus_free = 0, wait_total = 0;
+    int heap_size = 0, in_service = 0, cpu_busy = 0;
+    int ready_head = 0, ready_count = 0;
+
+    for (int p = 0; p < nproc; p++) ready[ready_count++] = p;
+    reset_replacement_state();
+
+    double now = 0;
+    for (;;) {
+        // Hand the CPU to the next ready process; its run ends at a fault or after a quantum
+        if (!cpu_busy && ready_count > 0) {
+            int p = ready[ready_head];
+            ready_head = (ready_head + 1) % nproc;
+            ready_count--;
+
+            IoEvent ev = {now, IO_EV_CPU_DONE, p, 0, 0};
+            for (int k = 0; k < quantum && pos[p] < length; k++) {
+                ReferenceResult r = reference_page(algo_choice, p, refs[p][pos[p]], refs[p], length, pos[p]);
+                pos[p]++;
+                ev.time += cpu_ns;
+                out->references++;
+                if (!r.hit) {
+                    ev.faulted = 1 + r.victim_dirty; // 2: write back the victim too
+                    break;
+                }
+            }
+            out->cpu_busy_ns += ev.time - now;
+            io_heap_push(heap, &heap_size, ev);
+            cpu_busy = 1;
+        }
+
+        if (heap_size == 0) break;
+        IoEvent ev = io_heap_pop(heap, &heap_size);
+        now = ev.time;
+
+        if (ev.type == IO_EV_CPU_DONE) {
+            cpu_busy = 0;
+            if (ev.faulted) {
+                // Queue the write-back (if any) and the read; the process blocks on the read
+                for (int w = ev.faulted - 1; w >= 0; w--) {
+                    IoEvent req = {0, IO_EV_IO_DONE, w ? -1 : ev.proc, 0, now};
+                    if (w) out->writebacks++; else out->faults++;
+                    if (pending_count == pending_cap) {
+                        IoEvent *grown = (IoEvent*)malloc(2 * pending_cap * sizeof(IoEvent));
+                        if (grown == NULL) break;
+                        for (int i = 0; i < pending_count; i++) {
+                            grown[i] = pending[(pending_head + i) % pending_cap];
+                        }
+                        free(pending);
+                        pending = grown;
+                        pending_head = 0;
+                        pending_cap *= 2;
+                    }
+                    pending[(pending_head + pending_count++) % pending_cap] = req;
+                }
+                if (pending_count > out->max_queued) out->max_queued = pending_count;
+            } else if (pos[ev.proc] < length) {
+                ready[(ready_head + ready_count++) % nproc] = ev.proc;
+            }
+        } else {
+            in_service--;
+            if (ev.proc >= 0) {
+                latency_record(&out->fault_latency, (unsigned long long)(now - ev.submitted + 0.5));
+                if (pos[ev.proc] < length) ready[(ready_head + ready_count++) % nproc] = ev.proc;
+            }
+        }
+
+        // Start queued requests while the device has free slots. Access latency
+        // overlaps across slots; transfers share the bandwidth one at a time.
+        while (in_service < dev->queue_depth && pending_count > 0) {
+            IoEvent req = pending[pending_head];
+            pending_head = (pending_head + 1) % pending_cap;
+            pending_count--;
+
+            double start = now + latency_ns;
+            if (bus_free > start) start = bus_free;
+            req.time = start + transfer_ns;
+            bus_free = req.time;
+            if (req.proc >= 0) wait_total += now - req.submitted;
+            io_heap_push(heap, &heap_size, req);
+            in_service++;
+        }
+    }
+
+    out->makespan_ns = now;
+    if (out->fault_latency.total > 0) out->mean_wait_ns = wait_total / out->fault_latency.total;
+
+    free(heap); free(pending); free(pos); free(ready);
+    return 1;
+}
+
+void simulate_backing_store() {
+    if (physical_memory == NULL) {
+        printf(COLOR_RED "\nMemory not initialized! Please setup memory frames first.\n" COLOR_RESET);
+        printf("Press Enter to continue...");
+        getchar();
+        return;
+    }
+
+    term_clear();
+    display_header("BACKING STORE & OVERLAPPING FAULTS");
+
+    const char *algo_names[] = {"FIFO", "LRU", "Optimal", "Clock"};
+    int nproc = process_count;
+
+    printf("\n" COLOR_CYAN "Replacement algorithm (1=FIFO 2=LRU 3=Optimal 4=Clock): " COLOR_RESET);
+    int algo_choice;
+    if (scanf("%d", &algo_choice) != 1) algo_choice = 2;
+    clear_input_buffer();
+    if (algo_choice < 1 || algo_choice > 4) algo_choice = 2;
+
+    printf(COLOR_CYAN "References per process (100-1000000): " COLOR_RESET);
+    int length;
+    if (scanf("%d", &length) != 1) length = 20000;
+    clear_input_buffer();
+    if (length < 100) length = 100;
+    if (length > 1000000) length = 1000000;
+
+    printf(COLOR_CYAN "Distinct pages per process (2-1000): " COLOR_RESET);
+    int page_range;
+    if (scanf("%d", &page_range) != 1) page_range = 16;
+    clear_input_buffer();
+    if (page_range < 2) page_range = 2;
+    if (page_range > 1000) page_range = 1000;
+
+    printf(COLOR_CYAN "CPU time per reference in ns (1-100000): " COLOR_RESET);
+    double cpu_ns;
+    if (scanf("%lf", &cpu_ns) != 1) cpu_ns = 200;
+    clear_input_buffer();
+    if (cpu_ns < 1) cpu_ns = 1;
+    if (cpu_ns > 100000) cpu_ns = 100000;
+
+    BackingStoreModel dev;
+    printf(COLOR_CYAN "Device latency in us (1-20000): " COLOR_RESET);
+    if (scanf("%lf", &dev.latency_us) != 1) dev.latency_us = 100;
+    clear_input_buffer();
+    if (dev.latency_us < 1) dev.latency_us = 1;
+    if (dev.latency_us > 20000) dev.latency_us = 20000;
+
+    printf(COLOR_CYAN "Device bandwidth in MB/s (1-20000): " COLOR_RESET);
+    if (scanf("%lf", &dev.bandwidth_mbs) != 1) dev.bandwidth_mbs = 500;
+    clear_input_buffer();
+    if (dev.bandwidth_mbs < 1) dev.bandwidth_mbs = 1;
+    if (dev.bandwidth_mbs > 20000) dev.bandwidth_mbs = 20000;
+
+    printf(COLOR_CYAN "Device queue depth (1-256): " COLOR_RESET);
+    if (scanf("%d", &dev.queue_depth) != 1) dev.queue_depth = 4;
+    clear_input_buffer();
+    if (dev.queue_depth < 1) dev.queue_depth = 1;
+    if (dev.queue_depth > 256) dev.queue_depth = 256;
+
+    printf(COLOR_CYAN "Speed-up of the faster device (2-100): " COLOR_RESET);
+    double speedup;
+    if (scanf("%lf", &speedup) != 1) speedup = 4;
+    clear_input_buffer();
+    if (speedup < 2) speedup = 2;
+    if (speedup > 100) speedup = 100;
+
+    printf(COLOR_CYAN "Extra frames for the more-RAM configuration (1-%d): " COLOR_RESET, SERVER_MAX_FRAMES);
+    int extra_frames;
+    if (scanf("%d", &extra_frames) != 1) extra_frames = frame_count;
+    clear_input_buffer();
+    if (extra_frames < 1) extra_frames = 1;
+    if (extra_frames > SERVER_MAX_FRAMES) extra_frames = SERVER_MAX_FRAMES;
+
+    int *refs[MAX_PROCESSES];
+    int ok = 1;
+    for (int p = 0; p < nproc; p++) {
+        refs[p] = (int*)malloc(length * sizeof(int));
+        if (refs[p] == NULL) ok = 0;
+        else fill_reference_string(refs[p], length, page_range);
+    }
+
+    // Keep the user's state so it can be put back afterwards
+    SimState user_state;
+    if (!ok || !sim_state_capture(&user_state)) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        for (int p = 0; p < nproc; p++) free(refs[p]);
+        return;
+    }
+
+    const char *config_names[] = {"Baseline", "Queue depth 1", "Faster device", "More RAM"};
+    BackingStoreModel models[4] = {dev, dev, dev, dev};
+    int frames[4] = {frame_count, frame_count, frame_count, frame_count + extra_frames};
+    models[1].queue_depth = 1;
+    models[2].latency_us /= speedup;
+    models[2].bandwidth_mbs *= speedup;
+
+    BackingStoreResults results[4];
+    for (int c = 0; c < 4 && ok; c++) {
+        ok = sim_state_activate(&user_state) && resize_frames(frames[c]) &&
+             run_backing_store_simulation(algo_choice, nproc, refs, length, &models[c], cpu_ns, 1000, &results[c]);
+    }
+    sim_state_restore(&user_state);
+    for (int p = 0; p < nproc; p++) free(refs[p]);
+
+    if (!ok) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        printf("\nPress Enter to continue...");
+        getchar();
+        return;
+    }
+
+    printf("\n" COLOR_GREEN "================================================================\n");
+    printf("                   BACKING STORE RESULTS\n");
+    printf("================================================================\n" COLOR_RESET);
+    printf("Workload: %d processes x %d references over %d pages each, %s, %.0f ns CPU/ref\n",
+           nproc, length, page_range, algo_names[algo_choice - 1], cpu_ns);
+    printf("Device:   %.1f us latency, %.0f MB/s, queue depth %d (%.1f us per %d KB page transfer)\n\n",
+           dev.latency_us, dev.bandwidth_mbs, dev.queue_depth,
+           PAGE_BYTES / (dev.bandwidth_mbs * 1e6) * 1e6, PAGE_SIZE);
+
+    printf(COLOR_YELLOW "%-14s %6s %8s %8s %8s %11s\n" COLOR_RESET, "Config", "Frames",
+           "Faults", "Writes", "CPU %", "Refs/sec");
+    for (int c = 0; c < 4; c++) {
+        const BackingStoreResults *r = &results[c];
+        double seconds = r->makespan_ns * 1e-9;
+        printf("%-14s %6d %8ld %8ld %7.1f%% %11.0f\n", config_names[c], frames[c],
+               r->faults, r->writebacks, r->makespan_ns > 0 ? r->cpu_busy_ns / r->makespan_ns * 100 : 0,
+               seconds > 0 ? r->references / seconds : 0);
+    }
+
+    printf("\n" COLOR_CYAN "Fault latency (fault to page ready):" COLOR_RESET "\n");
+    display_latency_header("Config");
+    for (int c = 0; c < 4; c++) display_latency_row(config_names[c], &results[c].fault_latency);
+
+    printf("\n" COLOR_CYAN "Device queue:" COLOR_RESET "\n");
+    for (int c = 0; c < 4; c++) {
+        printf("%-14s mean wait before service %.1f us, deepest backlog %d requests\n", config_names[c],
+               results[c].mean_wait_ns / 1000, results[c].max_queued);
+    }
+
+    double base_rate = results[0].makespan_ns > 0 ? results[0].references / results[0].makespan_ns : 0;
+    double device_rate = results[2].makespan_ns > 0 ? results[2].references / results[2].makespan_ns : 0;
+    double ram_rate = results[3].makespan_ns > 0 ? results[3].references / results[3].makespan_ns : 0;
+    if (base_rate > 0) {
+        printf("\n" COLOR_CYAN "Verdict:" COLOR_RESET " %.0fx faster device gives %.2fx throughput, "
+               "+%d frames gives %.2fx -> %s helps more\n", speedup, device_rate / base_rate,
+               extra_frames, ram_rate / base_rate, device_rate > ram_rate ? "the faster device" : "more RAM");
+    }
+
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+// Swap Function Implementations
+
+int swap_init(SwapArea *s, int slot_count) {
+    memset(s, 0, sizeof(*s));
+    s->slot_used = (unsigned char*)calloc(slot_count, 1);
+    if (s->slot_used == NULL) return 0;
+    s->slot_count = slot_count;
+    s->cluster_next = -1;
+    s->last_out_slot = -2;
+    return 1;
+}
+
+void swap_destroy(SwapArea *s) {
+    free(s->slot_used);
+    memset(s, 0, sizeof(*s));
+}
+
+// Frees every slot and clears the counters; the caller clears the page tables
+void swap_reset(SwapArea *s) {
+    if (s->slot_used != NULL) memset(s->slot_used, 0, s->slot_count);
+    s->used = 0;
+    s->cluster_next = -1;
+    s->cluster_end = 0;
+    s->last_out_slot = -2;
+    s->swap_ins = 0;
+    s->swap_outs = 0;
+    s->sequential_outs = 0;
+    s->clean_evictions = 0;
+    s->scattered_allocs = 0;
+    s->dropped = 0;
+}
+
+// Recomputes the slot map from the swap_slot fields of the page tables
+void swap_rebuild(SwapArea *s) {
+    memset(s->slot_used, 0, s->slot_count);
+    s->used = 0;
+    for (int p = 0; p < process_count; p++) {
+        for (int i = 0; i < processes[p].page_count; i++) {
+            int slot = processes[p].page_table[i].swap_slot;
+            if (slot >= 0 && slot < s->slot_count && !s->slot_used[slot]) {
+                s->slot_used[slot] = 1;
+                s->used++;
+            } else {
+                processes[p].page_table[i].swap_slot = -1;
+            }
+        }
+    }
+}
+
+// Hands out slots one after another inside a cluster that was entirely free
+// when it was picked, so a burst of swap-outs is written sequentially. When no
+// free cluster is left, any free slot is used and counted as scattered.
+int swap_alloc_slot(SwapArea *s) {
+    if (s->used >= s->slot_count) return -1;
+
+    while (s->cluster_next >= 0 && s->cluster_next < s->cluster_end) {
+        int slot = s->cluster_next++;
+        if (!s->slot_used[slot]) {
+            s->slot_used[slot] = 1;
+            s->used++;
+            return slot;
+        }
+    }
+
+    // Next fully free cluster, searching onwards from the previous one
+    int clusters = (s->slot_count + SWAP_CLUSTER - 1) / SWAP_CLUSTER;
+    int first = s->cluster_end / SWAP_CLUSTER;
+    for (int k = 0; k < clusters; k++) {
+        int base = ((first + k) % clusters) * SWAP_CLUSTER;
+        int end = base + SWAP_CLUSTER < s->slot_count ? base + SWAP_CLUSTER : s->slot_count;
+        int free_cluster = 1;
+        for (int i = base; i < end && free_cluster; i++) {
+            if (s->slot_used[i]) free_cluster = 0;
+        }
+        if (free_cluster) {
+            s->cluster_next = base + 1;
+            s->cluster_end = end;
+            s->slot_used[base] = 1;
+            s->used++;
+            return base;
+        }
+    }
+
+    for (int i = 0; i < s->slot_count; i++) {
+        if (!s->slot_used[i]) {
+            s->slot_used[i] = 1;
+            s->used++;
+            s->scattered_allocs++;
+            return i;
+        }
+    }
+    return -1;
+}
+
+void swap_free_slot(SwapArea *s, int slot) {
+    if (slot < 0 || slot >= s->slot_count || !s->slot_used[slot]) return;
+    s->slot_used[slot] = 0;
+    s->used--;
+}
+
+// Called when a page leaves memory. A clean page is dropped: either its swap
+// copy is still valid or it was never written and can be recreated. A dirty
+// page is written to its slot, allocating one if needed.
+void swap_evict(SwapArea *s, PageTableEntry *pte, int dirty) {
+    if (!dirty) {
+        s->clean_evictions++;
+        return;
+    }
+    if (pte->swap_slot < 0) {
+        pte->swap_slot = swap_alloc_slot(s);
+        if (pte->swap_slot < 0) {
+            s->dropped++;
+            return;
+        }
+    }
+    s->swap_outs++;
+    if (pte->swap_slot == s->last_out_slot + 1) s->sequential_outs++;
+    s->last_out_slot = pte->swap_slot;
+}
+
+// Called when a page is brought into memory. Reading it from its slot is a
+// swap-in; if the page is dirtied the swap copy is stale and its slot is freed.
+void swap_load(SwapArea *s, PageTableEntry *pte, int dirty) {
+    if (pte->swap_slot < 0) return;
+    s->swap_ins++;
+    if (dirty) {
+        swap_free_slot(s, pte->swap_slot);
+        pte->swap_slot = -1;
+    }
+}
+
+// Share of free slots that lie outside completely free clusters, i.e. free
+// space that can no longer take a sequential cluster of swap-outs
+float swap_fragmentation(const SwapArea *s) {
+    int free_slots = s->slot_count - s->used;
+    if (free_slots == 0) return 0;
+
+    int clustered = 0;
+    for (int base = 0; base < s->slot_count; base += SWAP_CLUSTER) {
+        int end = base + SWAP_CLUSTER < s->slot_count ? base + SWAP_CLUSTER : s->slot_count;
+        int free_cluster = 1;
+        for (int i = base; i < end && free_cluster; i++) {
+            if (s->slot_used[i]) free_cluster = 0;
+        }
+        if (free_cluster) clustered += end - base;
+    }
+    return (float)(free_slots - clustered) / free_slots * 100;
+}
+
+void display_swap_stats(const SwapArea *s) {
+    printf("Swap-ins: %ld | Swap-outs: %ld | Clean evictions: %ld", s->swap_ins, s->swap_outs,
+           s->clean_evictions);
+    if (s->dropped > 0) printf(COLOR_RED " | Dropped (swap full): %ld" COLOR_RESET, s->dropped);
+    printf("\n");
+    printf("Swap I/O: %ld KB read, %ld KB written\n", s->swap_ins * PAGE_SIZE, s->swap_outs * PAGE_SIZE);
+    printf("Swap Slots: %d/%d used | Fragmentation: %.1f%% | Sequential swap-outs: %.1f%% | Scattered allocations: %ld\n",
+           s->used, s->slot_count, swap_fragmentation(s),
+           s->swap_outs > 0 ? (float)s->sequential_outs / s->swap_outs * 100 : 0, s->scattered_allocs);
+}
+
+// NUMA Function Implementations
+
+// Frames are split into contiguous, equally sized node ranges
+int numa_node_of_frame(int frame_no, int node_count) {
+    return (int)((long)frame_no * node_count / frame_count);
+}
+
+// Least recently used frame of a node (reclaim stays node-local)
+static int numa_lru_frame(int node, int node_count) {
+    int best = -1;
+    for (int f = 0; f < frame_count; f++) {
+        if (numa_node_of_frame(f, node_count) != node) continue;
+        if (best < 0 || physical_memory[f].load_time < physical_memory[best].load_time) best = f;
+    }
+    return best;
+}
+
+// Frame for a new page on the target node. Falls back to the nearest node with a
+// free frame; when memory is full the target node reclaims its LRU page.
+static int numa_alloc_frame(const NumaConfig *cfg, int target, ReferenceResult *r) {
+    int tried[MAX_NUMA_NODES] = {0};
+    for (int k = 0; k < cfg->node_count; k++) {
+        int node = -1;
+        for (int n = 0; n < cfg->node_count; n++) {
+            if (!tried[n] && (node < 0 || cfg->latency_ns[target][n] < cfg->latency_ns[target][node])) node = n;
+        }
+        tried[node] = 1;
+        for (int f = 0; f < frame_count; f++) {
+            if (!physical_memory[f].occupied && numa_node_of_frame(f, cfg->node_count) == node) return f;
+        }
+    }
+
+    r->frame_no = numa_lru_frame(target, cfg->node_count);
+    evict_frame(r);
+    return r->frame_no;
+}
+
+// Moves the page in frame src to a frame on node dst: a free one if available,
+// otherwise it trades places with dst's least recently used page. Returns the
+// number of pages copied.
+static int numa_migrate(const NumaConfig *cfg, int src, int dst, int *sample_node) {
+    int target = -1;
+    for (int f = 0; f < frame_count && target < 0; f++) {
+        if (!physical_memory[f].occupied && numa_node_of_frame(f, cfg->node_count) == dst) target = f;
+    }
+    int exchange = target < 0;
+    if (exchange) target = numa_lru_frame(dst, cfg->node_count);
+    if (target < 0 || target == src) return 0;
+
+    Frame moved = physical_memory[src];
+    physical_memory[src] = physical_memory[target];
+    physical_memory[target] = moved;
+    physical_memory[src].frame_no = src;
+    physical_memory[target].frame_no = target;
+    sample_node[src] = sample_node[target] = -1;
+
+    int pair[2] = {src, target};
+    for (int k = 0; k < 2; k++) {
+        Frame *fr = &physical_memory[pair[k]];
+        PageTableEntry *pte = fr->occupied ? find_pte(fr->process_id, fr->page_no) : NULL;
+        if (pte != NULL) pte->frame_no = pair[k];
+    }
+    return exchange ? 2 : 1;
+}
+
+// Replays one reference string per process, round-robin in slices of 100
+// references, on frames split into NUMA nodes. Every access is charged the
+// latency from the node the process is running on to the node holding the page.
+int run_numa_simulation(const NumaConfig *cfg, int nproc, int **refs, int length, NumaStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    int *sample_node = (int*)malloc(frame_count * sizeof(int)); // node of the last remote sample
+    if (sample_node == NULL) return 0;
+    for (int f = 0; f < frame_count; f++) sample_node[f] = -1;
+
+    int cpu_node[MAX_PROCESSES];
+    for (int p = 0; p < nproc; p++) cpu_node[p] = cfg->home_node[p];
+
+    reset_replacement_state();
+    for (int base = 0; base < length; base += 100) {
+        for (int p = 0; p < nproc; p++) {
+            int pid = processes[p].pid;
+            int end = base + 100 < length ? base + 100 : length;
+
+            for (int i = base; i < end; i++) {
+                int page_no = refs[p][i];
+                time_counter++;
+
+                if (cfg->sched_interval > 0 && i > 0 && i % cfg->sched_interval == 0) {
+                    cpu_node[p] = (cpu_node[p] + 1) % cfg->node_count;
+                }
+
+                int f = find_resident_frame(pid, page_no);
+                if (f < 0) {
+                    stats->faults++;
+                    page_faults++;
+                    int target = cfg->placement == NUMA_FIRST_TOUCH ? cpu_node[p] :
+                                 cfg->placement == NUMA_INTERLEAVE ? page_no % cfg->node_count :
+                                 cfg->home_node[p];
+                    ReferenceResult r = {0, -1, -1, -1, 0, 0, 0, 0, 0};
+                    f = numa_alloc_frame(cfg, target, &r);
+
+                    physical_memory[f].occupied = 1;
+                    physical_memory[f].page_no = page_no;
+                    physical_memory[f].process_id = pid;
+                    physical_memory[f].modify_bit = rand() % 2;
+                    physical_memory[f].prefetched = 0;
+                    physical_memory[f].share_count = 1;
+                    sample_node[f] = -1;
+
+                    PageTableEntry *pte = find_pte(pid, page_no);
+                    if (pte != NULL) {
+                        pte->valid = 1;
+                        pte->frame_no = f;
+                        swap_load(&swap_area, pte, physical_memory[f].modify_bit);
+                    }
+                } else {
+                    page_hits++;
+                }
+                physical_memory[f].reference_bit = 1;
+                physical_memory[f].load_time = time_counter;
+
+                int node = numa_node_of_frame(f, cfg->node_count);
+                stats->accesses++;
+                stats->latency_ns += cfg->latency_ns[cpu_node[p]][node];
+                if (node != cpu_node[p]) stats->remote++;
+
+                // Hinting-fault style sampling: migrate after two remote samples in a
+                // row from the same node, so one stray access does not move a page
+                if (cfg->migrate && (i + 1) % cfg->sample_interval == 0) {
+                    stats->samples++;
+                    if (node == cpu_node[p]) {
+                        sample_node[f] = -1;
+                    } else if (sample_node[f] != cpu_node[p]) {
+                        sample_node[f] = cpu_node[p];
+                    } else {
+                        int moved = numa_migrate(cfg, f, cpu_node[p], sample_node);
+                        stats->migrations += moved;
+                        stats->migration_ns += moved * cfg->migrate_ns;
+                    }
+                }
+            }
+        }
+    }
+
+    free(sample_node);
+    return 1;
+}
+
+void simulate_numa() {
+    if (physical_memory == NULL) {
+        printf(COLOR_RED "\nMemory not initialized! Please setup memory frames first.\n" COLOR_RESET);
+        printf("Press Enter to continue...");
+        getchar();
+        return;
+    }
+
+    if (process_count < 1) {
+        printf(COLOR_RED "\nNo processes! Please add processes first.\n" COLOR_RESET);
+        printf("Press Enter to continue...");
+        getchar();
+        return;
+    }
+
+    term_clear();
+    display_header("NUMA PLACEMENT & MIGRATION");
+
+    NumaConfig cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    int nproc = process_count;
+    int max_nodes = frame_count < MAX_NUMA_NODES ? frame_count : MAX_NUMA_NODES;
+
+    printf("\n" COLOR_CYAN "Number of NUMA nodes (2-%d): " COLOR_RESET, max_nodes);
+    if (scanf("%d", &cfg.node_count) != 1) cfg.node_count = 2;
+    clear_input_buffer();
+    if (cfg.node_count < 2) cfg.node_count = 2;
+    if (cfg.node_count > max_nodes) cfg.node_count = max_nodes;
+
+    printf(COLOR_CYAN "Local access latency in ns (1-10000): " COLOR_RESET);
+    int local_ns;
+    if (scanf("%d", &local_ns) != 1) local_ns = 80;
+    clear_input_buffer();
+    if (local_ns < 1) local_ns = 1;
+    if (local_ns > 10000) local_ns = 10000;
+
+    printf(COLOR_CYAN "Extra latency per interconnect hop in ns (0-10000): " COLOR_RESET);
+    int hop_ns;
+    if (scanf("%d", &hop_ns) != 1) hop_ns = 60;
+    clear_input_buffer();
+    if (hop_ns < 0) hop_ns = 0;
+    if (hop_ns > 10000) hop_ns = 10000;
+
+    // Nodes sit on a ring; a custom matrix can override the distances
+    for (int i = 0; i < cfg.node_count; i++) {
+        for (int j = 0; j < cfg.node_count; j++) {
+            int d = i > j ? i - j : j - i;
+            if (cfg.node_count - d < d) d = cfg.node_count - d;
+            cfg.latency_ns[i][j] = local_ns + d * hop_ns;
+        }
+    }
+
+    printf(COLOR_CYAN "Enter a custom latency matrix? (y/n): " COLOR_RESET);
+    char choice = getchar();
+    clear_input_buffer();
+    if (choice == 'y' || choice == 'Y') {
+        for (int i = 0; i < cfg.node_count; i++) {
+            printf(COLOR_CYAN "Row for CPU node %d (%d values in ns): " COLOR_RESET, i, cfg.node_count);
+            for (int j = 0; j < cfg.node_count; j++) {
+                int v;
+                if (scanf("%d", &v) == 1 && v > 0) cfg.latency_ns[i][j] = v;
+            }
+            clear_input_buffer();
+        }
+    }
+
+    for (int p = 0; p < nproc; p++) {
+        printf(COLOR_CYAN "Home node for %s (0-%d): " COLOR_RESET, processes[p].name, cfg.node_count - 1);
+        if (scanf("%d", &cfg.home_node[p]) != 1) cfg.home_node[p] = p % cfg.node_count;
+        clear_input_buffer();
+        if (cfg.home_node[p] < 0 || cfg.home_node[p] >= cfg.node_count) cfg.home_node[p] = p % cfg.node_count;
+    }
+
+    printf(COLOR_CYAN "References per process (100-1000000): " COLOR_RESET);
+    int length;
+    if (scanf("%d", &length) != 1) length = 50000;
+    clear_input_buffer();
+    if (length < 100) length = 100;
+    if (length > 1000000) length = 1000000;
+
+    printf(COLOR_CYAN "Distinct pages per process (1-%d): " COLOR_RESET, MAX_PAGES);
+    int page_range;
+    if (scanf("%d", &page_range) != 1) page_range = frame_count / nproc;
+    clear_input_buffer();
+    if (page_range < 1) page_range = 1;
+    if (page_range > MAX_PAGES) page_range = MAX_PAGES;
+
+    printf(COLOR_CYAN "References between scheduler moves to another node (0 = never): " COLOR_RESET);
+    if (scanf("%d", &cfg.sched_interval) != 1) cfg.sched_interval = 10000;
+    clear_input_buffer();
+    if (cfg.sched_interval < 0) cfg.sched_interval = 0;
+
+    printf(COLOR_CYAN "Migration sampling interval in references (1-10000): " COLOR_RESET);
+    if (scanf("%d", &cfg.sample_interval) != 1) cfg.sample_interval = 16;
+    clear_input_buffer();
+    if (cfg.sample_interval < 1) cfg.sample_interval = 1;
+    if (cfg.sample_interval > 10000) cfg.sample_interval = 10000;
+
+    printf(COLOR_CYAN "Page migration cost in ns (0-1000000): " COLOR_RESET);
+    if (scanf("%lf", &cfg.migrate_ns) != 1) cfg.migrate_ns = 2000;
+    clear_input_buffer();
+    if (cfg.migrate_ns < 0) cfg.migrate_ns = 0;
+    if (cfg.migrate_ns > 1000000) cfg.migrate_ns = 1000000;
+
+    int *refs[MAX_PROCESSES];
+    int ok = 1;
+    for (int p = 0; p < nproc; p++) {
+        refs[p] = (int*)malloc(length * sizeof(int));
+        if (refs[p] == NULL) ok = 0;
+        else fill_reference_string(refs[p], length, page_range);
+    }
+
+    // Keep the user's state so it can be put back afterwards
+    SimState user_state;
+    if (!ok || !sim_state_capture(&user_state)) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        for (int p = 0; p < nproc; p++) free(refs[p]);
+        return;
+    }
+
+    const char *placement_names[] = {"First-touch", "Interleave", "Preferred"};
+    NumaStats results[3][2];
+    for (int pl = NUMA_FIRST_TOUCH; pl <= NUMA_PREFERRED && ok; pl++) {
+        for (int m = 0; m <= 1 && ok; m++) {
+            cfg.placement = (NumaPlacement)pl;
+            cfg.migrate = m;
+            ok = run_numa_simulation(&cfg, nproc, refs, length, &results[pl][m]);
+        }
+    }
+    sim_state_restore(&user_state);
+    for (int p = 0; p < nproc; p++) free(refs[p]);
+
+    if (!ok) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        printf("\nPress Enter to continue...");
+        getchar();
+        return;
+    }
+
+    printf("\n" COLOR_GREEN "================================================================\n");
+    printf("                      NUMA RESULTS\n");
+    printf("================================================================\n" COLOR_RESET);
+    printf("%d frames over %d nodes, %d processes x %d references over %d pages\n",
+           frame_count, cfg.node_count, nproc, length, page_range);
+    printf("\nLatency matrix (ns, CPU node x memory node):\n");
+    for (int i = 0; i < cfg.node_count; i++) {
+        printf("  node %d:", i);
+        for (int j = 0; j < cfg.node_count; j++) printf(" %6d", cfg.latency_ns[i][j]);
+        printf("\n");
+    }
+    printf("\n");
+
+    printf(COLOR_YELLOW "%-12s %-9s %10s %9s %8s %11s %12s\n" COLOR_RESET, "Placement", "Migration",
+           "Avg ns", "Remote %", "Faults", "Migrations", "Effective ns");
+    for (int pl = NUMA_FIRST_TOUCH; pl <= NUMA_PREFERRED; pl++) {
+        for (int m = 0; m <= 1; m++) {
+            const NumaStats *st = &results[pl][m];
+            double n = st->accesses > 0 ? (double)st->accesses : 1;
+            printf("%-12s %-9s %10.1f %8.1f%% %8ld %11ld %12.1f\n", placement_names[pl], m ? "Sampled" : "Off",
+                   st->latency_ns / n, st->remote / n * 100, st->faults, st->migrations,
+                   (st->latency_ns + st->migration_ns) / n);
+        }
+    }
+    printf("\nEffective ns adds the page copy cost of migrations, spread over all accesses.\n");
+
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+// Replacement Kernel Function Implementations
+
+// Each kernel runs a whole reference string for one policy with everything
+// inlined: hit detection is one load from a page -> frame table, frames fill in
+// order like get_free_frame(), and the victim choice reproduces the interactive
+// policies exactly (including Optimal's lowest-frame tie break), so results
+// match reference_page() reference for reference. There is no output, no
+// eviction bookkeeping and no policy switch inside the loop.
+//
+// Policy state lives in scratch (2 * frames ints); ON_HIT, ON_LOAD and
+// PICK_VICTIM are statement blocks that see i, f, frames, scratch and next_use.
+#define DEFINE_REPLACEMENT_KERNEL(name, ON_HIT, ON_LOAD, PICK_VICTIM)                     \
+static void name(int frames, const int *refs, int length, int base, int *frame_of,          \
+                 int *frame_page, int *scratch, const int *next_use, KernelResult *out) {   \
+    int hits = 0, used = 0, hand = 0, head = -1, tail = -1;                                   \
+    (void)scratch; (void)next_use; (void)hand; (void)head; (void)tail;                        \
+    for (int i = 0; i < length; i++) {                                                        \
+        int page = refs[i] - base;                                                            \
+        int f = frame_of[page];                                                               \
+        if (f >= 0) {                                                                         \
+            hits++;                                                                           \
+            ON_HIT                                                                            \
+            continue;                                                                         \
+        }                                                                                     \
+        if (used < frames) {                                                                  \
+            f = used++;                                                                       \
+        } else {                                                                              \
+            PICK_VICTIM                                                                       \
+            frame_of[frame_page[f]] = -1;                                                     \
+        }                                                                                     \
+        frame_page[f] = page;                                                                 \
+        frame_of[page] = f;                                                                   \
+        ON_LOAD                                                                               \
+    }                                                                                         \
+    out->hits = hits;                                                                         \
+    out->faults = length - hits;                                                              \
+}
+
+// LRU keeps frames on a doubly linked list, most recent at head:
+// scratch[f] is the previous frame, scratch[frames + f] the next
+#define LRU_UNLINK(f)                                                                         \
+    do {                                                                                      \
+        int p_ = scratch[f], n_ = scratch[frames + (f)];                                      \
+        if (p_ >= 0) scratch[frames + p_] = n_; else head = n_;                               \
+        if (n_ >= 0) scratch[n_] = p_; else tail = p_;                                        \
+    } while (0)
+#define LRU_PUSH(f)                                                                           \
+    do {                                                                                      \
+        scratch[f] = -1;                                                                      \
+        scratch[frames + (f)] = head;                                                         \
+        if (head >= 0) scratch[head] = (f); else tail = (f);                                  \
+        head = (f);                                                                           \
+    } while (0)
+
+DEFINE_REPLACEMENT_KERNEL(fifo_kernel,
+    ,
+    ,
+    f = hand; hand = hand + 1 == frames ? 0 : hand + 1;)
+
+DEFINE_REPLACEMENT_KERNEL(lru_kernel,
+    if (f != head) { LRU_UNLINK(f); LRU_PUSH(f); },
+    LRU_PUSH(f);,
+    f = tail; LRU_UNLINK(f);)
+
+// scratch[f] is the index at which the page in frame f is next referenced
+DEFINE_REPLACEMENT_KERNEL(optimal_kernel,
+    scratch[f] = next_use[i];,
+    scratch[f] = next_use[i];,
+    f = 0; for (int k = 1; k < frames; k++) if (scratch[k] > scratch[f]) f = k;)
+
+// scratch[f] is the reference bit of frame f
+DEFINE_REPLACEMENT_KERNEL(clock_kernel,
+    scratch[f] = 1;,
+    scratch[f] = 1;,
+    while (scratch[hand]) { scratch[hand] = 0; hand = hand + 1 == frames ? 0 : hand + 1; }
+    f = hand; hand = hand + 1 == frames ? 0 : hand + 1;)
+
+// Runs refs through the kernel for algo_choice (1=FIFO 2=LRU 3=Optimal 4=Clock)
+// on frames empty frames. Returns 0 if a page is outside 0..KERNEL_MAX_PAGES-1
+// or memory runs out.
+int run_replacement_kernel(int algo_choice, int frames, const int *refs, int length, KernelResult *out) {
+    if (frames < 1 || length < 0 || algo_choice < 1 || algo_choice > 4) return 0;
+    
+    // The direct-mapped lookup table covers only the pages actually used
+    int lo = 0, hi = 0;
+    for (int i = 0; i < length; i++) {
+        if (refs[i] < 0 || refs[i] >= KERNEL_MAX_PAGES) return 0;
+        if (i == 0 || refs[i] < lo) lo = refs[i];
+        if (i == 0 || refs[i] > hi) hi = refs[i];
+    }
+    long span = (long)hi - lo + 1;
+    
+    int *frame_of = (int*)malloc(span * sizeof(int));
+    int *frame_page = (int*)malloc(frames * sizeof(int));
+    int *scratch = (int*)calloc(2 * (size_t)frames, sizeof(int));
+    int *next_use = algo_choice == 3 ? (int*)malloc((length > 0 ? length : 1) * sizeof(int)) : NULL;
+    if (frame_of == NULL || frame_page == NULL || scratch == NULL || (algo_choice == 3 && next_use == NULL)) {
+        free(frame_of);
+        free(frame_page);
+        free(scratch);
+        free(next_use);
+        return 0;
+    }
+    
+    // Optimal: next_use[i] is the next index referencing refs[i], or length if none
+    // (frame_of doubles as the last-seen table while this is built)
+    if (next_use != NULL) {
+        for (long p = 0; p < span; p++) frame_of[p] = length;
+        for (int i = length - 1; i >= 0; i--) {
+            next_use[i] = frame_of[refs[i] - lo];
+            frame_of[refs[i] - lo] = i;
+        }
+    }
+    for (long p = 0; p < span; p++) frame_of[p] = -1;
+    for (int f = 0; f < frames; f++) frame_page[f] = -1;
+    
+    switch (algo_choice) {
+        case 1:
+            fifo_kernel(frames, refs, length, lo, frame_of, frame_page, scratch, next_use, out);
+            break;
+        case 2:
+            lru_kernel(frames, refs, length, lo, frame_of, frame_page, scratch, next_use, out);
+            break;
+        case 3:
+            optimal_kernel(frames, refs, length, lo, frame_of, frame_page, scratch, next_use, out);
+            break;
+        default:
+            clock_kernel(frames, refs, length, lo, frame_of, frame_page, scratch, next_use, out);
+    }
+    
+    if (out->frame_pages != NULL) {
+        for (int f = 0; f < frames; f++) {
+            out->frame_pages[f] = frame_page[f] >= 0 ? frame_page[f] + lo : -1;
+        }
+    }
+    
+    free(frame_of);
+    free(frame_page);
+    free(scratch);
+    free(next_use);
+    return 1;
+}
+
+// Times reference_page() against the policy kernels on the same generated
+// string and checks that hits, faults and final frame contents agree.
+void benchmark_replacement_kernels() {
+    if (physical_memory == NULL) {
+        printf(COLOR_RED "\nMemory not initialized! Please setup memory frames first.\n" COLOR_RESET);
+        printf("Press Enter to continue...");
+        getchar();
+        return;
+    }
+    
+    term_clear();
+    display_header("REPLACEMENT KERNEL BENCHMARK");
+    
+    printf("\n" COLOR_CYAN "Reference string length (1000-%d): " COLOR_RESET, MAX_STREAM_REFS);
+    int ref_length;
+    if (scanf("%d", &ref_length) != 1) ref_length = 1000000;
+    clear_input_buffer();
+    if (ref_length < 1000) ref_length = 1000;
+    if (ref_length > MAX_STREAM_REFS) ref_length = MAX_STREAM_REFS;
+    
+    printf(COLOR_CYAN "Page range (2-%d): " COLOR_RESET, KERNEL_MAX_PAGES);
+    int page_space;
+    if (scanf("%d", &page_space) != 1) page_space = 4 * frame_count;
+    clear_input_buffer();
+    if (page_space < 2) page_space = 2;
+    if (page_space > KERNEL_MAX_PAGES) page_space = KERNEL_MAX_PAGES;
+    
+    int *refs = (int*)malloc(ref_length * sizeof(int));
+    int *engine_pages = (int*)malloc(frame_count * sizeof(int));
+    int *kernel_pages = (int*)malloc(frame_count * sizeof(int));
+    if (refs == NULL || engine_pages == NULL || kernel_pages == NULL) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        free(refs);
+        free(engine_pages);
+        free(kernel_pages);
+        return;
+    }
+    fill_reference_string(refs, ref_length, page_space);
+    
+    SimState user_state;
+    if (!sim_state_capture(&user_state)) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        free(refs);
+        free(engine_pages);
+        free(kernel_pages);
+        return;
+    }
+    
+    const char *algo_names[] = {"FIFO", "LRU", "Optimal", "Clock"};
+    printf("\n" COLOR_GREEN "================================================================\n");
+    printf("                  REPLACEMENT KERNEL BENCHMARK\n");
+    printf("================================================================\n" COLOR_RESET);
+    printf("%d frames, %d references over %d pages\n\n", frame_count, ref_length, page_space);
+    printf(COLOR_YELLOW "%-8s %10s %14s %14s %9s %7s\n" COLOR_RESET,
+           "Policy", "Faults", "Engine ns/ref", "Kernel ns/ref", "Speedup", "Match");
+    
+    for (int a = 1; a <= 4; a++) {
+        reset_replacement_state();
+        double t0 = get_time_seconds();
+        for (int i = 0; i < ref_length; i++) {
+            reference_page(a, 0, refs[i], refs, ref_length, i);
+        }
+        double engine_time = get_time_seconds() - t0;
+        for (int f = 0; f < frame_count; f++) {
+            engine_pages[f] = physical_memory[f].occupied ? physical_memory[f].page_no : -1;
+        }
+        
+        KernelResult kr = {0, 0, kernel_pages};
+        t0 = get_time_seconds();
+        int ok = run_replacement_kernel(a, frame_count, refs, ref_length, &kr);
+        double kernel_time = get_time_seconds() - t0;
+        
+        int match = ok && kr.hits == page_hits && kr.faults == page_faults &&
+                    memcmp(engine_pages, kernel_pages, frame_count * sizeof(int)) == 0;
+        printf("%-8s %10d %14.1f %14.1f %8.1fx %s%7s" COLOR_RESET "\n", algo_names[a - 1], page_faults,
+               engine_time / ref_length * 1e9, kernel_time / ref_length * 1e9,
+               kernel_time > 0 ? engine_time / kernel_time : 0.0,
+               match ? COLOR_GREEN : COLOR_RED, match ? "yes" : "NO");
+    }
+    printf("\nKernel time includes its setup (lookup table, Optimal's next-use pass).\n");
+    
+    sim_state_restore(&user_state);
+    free(refs);
+    free(engine_pages);
+    free(kernel_pages);
+    
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+// Belady Sweep Function Implementations
+
+// One FIFO or Clock memory of a fixed size, resumable block by block
+typedef struct {
+    int frames;
+    int used;
+    int hand;
+    int faults;
+    int *frame_of;   // page -> frame or -1
+    int *frame_page;
+    unsigned char *ref_bit;
+} SweepMemory;
+
+static void sweep_run_block(SweepMemory *m, int algo_choice, const int *refs, int count) {
+    int frames = m->frames, used = m->used, hand = m->hand, faults = m->faults;
+    int *frame_of = m->frame_of, *frame_page = m->frame_page;
+    unsigned char *ref_bit = m->ref_bit;
+    
+    if (algo_choice == 1) {
+        for (int i = 0; i < count; i++) {
+            int page = refs[i];
+            if (frame_of[page] >= 0) continue;
+            faults++;
+            int f;
+            if (used < frames) {
+                f = used++;
+            } else {
+                f = hand;
+                hand = hand + 1 == frames ? 0 : hand + 1;
+                frame_of[frame_page[f]] = -1;
+            }
+            frame_page[f] = page;
+            frame_of[page] = f;
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            int page = refs[i];
+            int f = frame_of[page];
+            if (f >= 0) {
+                ref_bit[f] = 1;
+                continue;
+            }
+            faults++;
+            if (used < frames) {
+                f = used++;
+            } else {
+                while (ref_bit[hand]) {
+                    ref_bit[hand] = 0;
+                    hand = hand + 1 == frames ? 0 : hand + 1;
+                }
+                f = hand;
+                hand = hand + 1 == frames ? 0 : hand + 1;
+                frame_of[frame_page[f]] = -1;
+            }
+            frame_page[f] = page;
+            frame_of[page] = f;
+            ref_bit[f] = 1;
+        }
+    }
+    
+    m->used = used;
+    m->hand = hand;
+    m->faults = faults;
+}
+
+// Runs every frame count assigned to the job over the trace in one pass: each
+// block of SWEEP_BLOCK references is fed to all of the job's memories while it
+// is still in cache, then the next block is read.
+static void *frame_sweep_worker(void *arg) {
+    FrameSweepJob *job = (FrameSweepJob*)arg;
+    int count = 0;
+    for (int k = job->min_frames + job->first; k <= job->max_frames; k += job->stride) count++;
+    job->ok = 1;
+    if (count == 0) return NULL;
+    
+    SweepMemory *mem = (SweepMemory*)calloc(count, sizeof(SweepMemory));
+    int *frame_of = (int*)malloc((size_t)count * job->page_span * sizeof(int));
+    int *frame_page = (int*)malloc((size_t)count * job->max_frames * sizeof(int));
+    unsigned char *ref_bit = (unsigned char*)calloc((size_t)count * job->max_frames, 1);
+    if (mem == NULL || frame_of == NULL || frame_page == NULL || ref_bit == NULL) {
+        job->ok = 0;
+    } else {
+        for (long p = 0; p < (long)count * job->page_span; p++) frame_of[p] = -1;
+        for (int c = 0; c < count; c++) {
+            mem[c].frames = job->min_frames + job->first + c * job->stride;
+            mem[c].frame_of = frame_of + (size_t)c * job->page_span;
+            mem[c].frame_page = frame_page + (size_t)c * job->max_frames;
+            mem[c].ref_bit = ref_bit + (size_t)c * job->max_frames;
+        }
+        
+        for (int start = 0; start < job->length; start += SWEEP_BLOCK) {
+            int block = job->length - start < SWEEP_BLOCK ? job->length - start : SWEEP_BLOCK;
+            for (int c = 0; c < count; c++) {
+                sweep_run_block(&mem[c], job->algo_choice, job->refs + start, block);
+            }
+        }
+        for (int c = 0; c < count; c++) {
+            job->faults[mem[c].frames - job->min_frames] = mem[c].faults;
+        }
+    }
+    
+    free(mem);
+    free(frame_of);
+    free(frame_page);
+    free(ref_bit);
+    return NULL;
+}
+
+// Fault counts for FIFO (1) or Clock (4) at every frame count in
+// [min_frames, max_frames], split across up to threads workers (frame counts
+// interleaved so each gets a similar mix of sizes). On Windows the workers run
+// one after another. Returns 0 if memory runs out.
+int run_frame_sweep(int algo_choice, const int *refs, int length, int min_frames, int max_frames,
+                    int threads, int *faults) {
+    int lo = 0, hi = 0;
+    for (int i = 0; i < length; i++) {
+        if (i == 0 || refs[i] < lo) lo = refs[i];
+        if (i == 0 || refs[i] > hi) hi = refs[i];
+    }
+    int *rebased = (int*)malloc((length > 0 ? length : 1) * sizeof(int));
+    if (rebased == NULL) return 0;
+    for (int i = 0; i < length; i++) rebased[i] = refs[i] - lo;
+    
+    int configs = max_frames - min_frames + 1;
+    if (threads > configs) threads = configs;
+    if (threads > SWEEP_MAX_THREADS) threads = SWEEP_MAX_THREADS;
+    if (threads < 1) threads = 1;
+    
+    FrameSweepJob jobs[SWEEP_MAX_THREADS];
+    for (int t = 0; t < threads; t++) {
+        jobs[t].algo_choice = algo_choice;
+        jobs[t].refs = rebased;
+        jobs[t].length = length;
+        jobs[t].page_span = hi - lo + 1;
+        jobs[t].min_frames = min_frames;
+        jobs[t].first = t;
+        jobs[t].stride = threads;
+        jobs[t].max_frames = max_frames;
+        jobs[t].faults = faults;
+        jobs[t].ok = 0;
+    }
+    
+#ifdef _WIN32
+    for (int t = 0; t < threads; t++) frame_sweep_worker(&jobs[t]);
+#else
+    pthread_t tids[SWEEP_MAX_THREADS];
+    int started[SWEEP_MAX_THREADS];
+    for (int t = 0; t < threads; t++) {
+        started[t] = pthread_create(&tids[t], NULL, frame_sweep_worker, &jobs[t]) == 0;
+        if (!started[t]) frame_sweep_worker(&jobs[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+        if (started[t]) pthread_join(tids[t], NULL);
+    }
+#endif
+    
+    int ok = 1;
+    for (int t = 0; t < threads; t++) ok = ok && jobs[t].ok;
+    free(rebased);
+    return ok;
+}
+
+static int online_cpus() {
+#ifdef _WIN32
+    return 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+// Lists every frame count k where faults(k + 1) > faults(k). Returns how many.
+static int report_fault_rises(const char *name, const int *faults, int min_frames, int max_frames) {
+    int rises = 0;
+    for (int k = min_frames; k < max_frames; k++) {
+        int before = faults[k - min_frames], after = faults[k + 1 - min_frames];
+        if (after > before) {
+            if (rises == 0) printf(COLOR_RED "%s anomalies:\n" COLOR_RESET, name);
+            printf("  %3d -> %3d frames: %d -> %d faults (+%d)\n", k, k + 1, before, after, after - before);
+            rises++;
+        }
+    }
+    if (rises == 0) printf(COLOR_GREEN "%s: faults never rise with more frames in this range.\n" COLOR_RESET, name);
+    return rises;
+}
+
+void detect_belady_anomaly() {
+    term_clear();
+    display_header("BELADY'S ANOMALY DETECTOR");
+    
+    printf("\n" COLOR_YELLOW "Reference String:\n" COLOR_RESET);
+    printf(COLOR_CYAN "1." COLOR_RESET " Classic (1 2 3 4 1 2 5 1 2 3 4 5)\n");
+    printf(COLOR_CYAN "2." COLOR_RESET " Random uniform\n");
+    printf(COLOR_CYAN "3." COLOR_RESET " Random with locality\n");
+    printf(COLOR_CYAN "4." COLOR_RESET " Enter manually\n");
+    printf("\n" COLOR_YELLOW "Enter your choice (1-4): " COLOR_RESET);
+    int source;
+    if (scanf("%d", &source) != 1) source = 1;
+    clear_input_buffer();
+    if (source < 1 || source > 4) source = 1;
+    
+    static const int classic[] = {1, 2, 3, 4, 1, 2, 5, 1, 2, 3, 4, 5};
+    int ref_length = 12, page_space = 5;
+    if (source != 1) {
+        int max_length = source == 4 ? 100 : MAX_STREAM_REFS;
+        printf(COLOR_CYAN "Reference string length (5-%d): " COLOR_RESET, max_length);
+        if (scanf("%d", &ref_length) != 1) ref_length = source == 4 ? 12 : 100000;
+        clear_input_buffer();
+        if (ref_length < 5) ref_length = 5;
+        if (ref_length > max_length) ref_length = max_length;
+    }
+    if (source == 2 || source == 3) {
+        printf(COLOR_CYAN "Page range (2-10000): " COLOR_RESET);
+        if (scanf("%d", &page_space) != 1) page_space = 16;
+        clear_input_buffer();
+        if (page_space < 2) page_space = 2;
+        if (page_space > 10000) page_space = 10000;
+    }
+    
+    int *refs = (int*)malloc(ref_length * sizeof(int));
+    if (refs == NULL) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        return;
+    }
+    if (source == 1) {
+        memcpy(refs, classic, sizeof(classic));
+    } else if (source == 2) {
+        for (int i = 0; i < ref_length; i++) refs[i] = rand() % page_space;
+    } else if (source == 3) {
+        fill_reference_string(refs, ref_length, page_space);
+    } else {
+        printf(COLOR_CYAN "Enter %d page numbers (0-9999): \n" COLOR_RESET, ref_length);
+        for (int i = 0; i < ref_length; i++) {
+            if (scanf("%d", &refs[i]) != 1) refs[i] = 0;
+            if (refs[i] < 0) refs[i] = 0;
+            if (refs[i] > 9999) refs[i] = 9999;
+        }
+        clear_input_buffer();
+    }
+    
+    int distinct_hi = 0;
+    for (int i = 0; i < ref_length; i++) if (refs[i] + 1 > distinct_hi) distinct_hi = refs[i] + 1;
+    int min_frames = 1, max_frames = distinct_hi < SWEEP_MAX_FRAMES ? distinct_hi : SWEEP_MAX_FRAMES;
+    printf(COLOR_CYAN "Frame count range, from (1-%d): " COLOR_RESET, SWEEP_MAX_FRAMES);
+    if (scanf("%d", &min_frames) != 1) min_frames = 1;
+    clear_input_buffer();
+    if (min_frames < 1) min_frames = 1;
+    if (min_frames > SWEEP_MAX_FRAMES - 1) min_frames = SWEEP_MAX_FRAMES - 1;
+    printf(COLOR_CYAN "                        to (%d-%d): " COLOR_RESET, min_frames + 1, SWEEP_MAX_FRAMES);
+    int to;
+    if (scanf("%d", &to) == 1) max_frames = to;
+    clear_input_buffer();
+    if (max_frames <= min_frames) max_frames = min_frames + 1;
+    if (max_frames > SWEEP_MAX_FRAMES) max_frames = SWEEP_MAX_FRAMES;
+    
+    int configs = max_frames - min_frames + 1;
+    int *fifo_faults = (int*)malloc(configs * sizeof(int));
+    int *clock_faults = (int*)malloc(configs * sizeof(int));
+    int threads = online_cpus();
+    double t0 = get_time_seconds();
+    int ok = fifo_faults != NULL && clock_faults != NULL &&
+             run_frame_sweep(1, refs, ref_length, min_frames, max_frames, threads, fifo_faults) &&
+             run_frame_sweep(4, refs, ref_length, min_frames, max_frames, threads, clock_faults);
+    double elapsed = get_time_seconds() - t0;
+    
+    if (!ok) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+    } else {
+        printf("\n" COLOR_GREEN "================================================================\n");
+        printf("                  BELADY'S ANOMALY SWEEP RESULTS\n");
+        printf("================================================================\n" COLOR_RESET);
+        int workers = threads < configs ? threads : configs;
+        if (workers > SWEEP_MAX_THREADS) workers = SWEEP_MAX_THREADS;
+        printf("%d references, frames %d-%d, %d worker%s, %.3f s\n\n", ref_length, min_frames, max_frames,
+               workers, workers == 1 ? "" : "s", elapsed);
+        
+        if (configs <= 64) {
+            printf(COLOR_YELLOW "%-8s %12s %12s\n" COLOR_RESET, "Frames", "FIFO Faults", "Clock Faults");
+            for (int k = min_frames; k <= max_frames; k++) {
+                int i = k - min_frames;
+                int fifo_rise = i > 0 && fifo_faults[i] > fifo_faults[i - 1];
+                int clock_rise = i > 0 && clock_faults[i] > clock_faults[i - 1];
+                printf("%-8d %s%12d" COLOR_RESET " %s%12d" COLOR_RESET "\n", k,
+                       fifo_rise ? COLOR_RED : "", fifo_faults[i], clock_rise ? COLOR_RED : "", clock_faults[i]);
+            }
+            printf("\n");
+        }
+        report_fault_rises("FIFO", fifo_faults, min_frames, max_frames);
+        report_fault_rises("Clock", clock_faults, min_frames, max_frames);
+    }
+    
+    free(refs);
+    free(fifo_faults);
+    free(clock_faults);
+    
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+// Trace Import Function Implementations
+
+int fold_map_init(PageFoldMap *m, int capacity) {
+    m->keys = (unsigned long long*)malloc(capacity * sizeof(unsigned long long));
+    m->ids = (int*)malloc(capacity * sizeof(int));
+    if (m->keys == NULL || m->ids == NULL) {
+        free(m->keys);
+        free(m->ids);
+        return 0;
+    }
+    for (int i = 0; i < capacity; i++) m->ids[i] = -1;
+    m->capacity = capacity;
+    m->count = 0;
+    return 1;
+}
+
+void fold_map_free(PageFoldMap *m) {
+    free(m->keys);
+    free(m->ids);
+    memset(m, 0, sizeof(*m));
+}
+
+static unsigned int fold_hash(unsigned long long page) {
+    page ^= page >> 33;
+    page *= 0xff51afd7ed558ccdULL;
+    page ^= page >> 33;
+    return (unsigned int)page;
+}
+
+// Dense id of a page number, assigning the next id to pages not seen before.
+// Distinct pages stay distinct, so the engines' int page numbers lose nothing.
+// Returns -1 if the table cannot grow.
+int fold_page(PageFoldMap *m, unsigned long long page) {
+    unsigned int mask = (unsigned int)m->capacity - 1;
+    unsigned int i = fold_hash(page) & mask;
+    while (m->ids[i] >= 0) {
+        if (m->keys[i] == page) return m->ids[i];
+        i = (i + 1) & mask;
+    }
+
+    // Keep the load factor under 1/2
+    if ((m->count + 1) * 2 > m->capacity) {
+        PageFoldMap grown;
+        if (m->capacity > (1 << 29) || !fold_map_init(&grown, m->capacity * 2)) return -1;
+        unsigned int gmask = (unsigned int)grown.capacity - 1;
+        for (int k = 0; k < m->capacity; k++) {
+            if (m->ids[k] < 0) continue;
+            unsigned int j = fold_hash(m->keys[k]) & gmask;
+            while (grown.ids[j] >= 0) j = (j + 1) & gmask;
+            grown.keys[j] = m->keys[k];
+            grown.ids[j] = m->ids[k];
+        }
+        grown.count = m->count;
+        fold_map_free(m);
+        *m = grown;
+        return fold_page(m, page);
+    }
+
+    m->keys[i] = page;
+    m->ids[i] = m->count++;
+    return m->ids[i];
+}
+
+// Parses a hex number with or without 0x; end receives the first unparsed character
+static int parse_hex(const char *p, unsigned long long *value, const char **end) {
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) p += 2;
+    unsigned long long v = 0;
+    int digits = 0;
+    for (;; p++, digits++) {
+        int c = *p;
+        if (c >= '0' && c <= '9') v = (v << 4) | (unsigned long long)(c - '0');
+        else if (c >= 'a' && c <= 'f') v = (v << 4) | (unsigned long long)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v = (v << 4) | (unsigned long long)(c - 'A' + 10);
+        else break;
+    }
+    *value = v;
+    if (end != NULL) *end = p;
+    return digits > 0 && digits <= 16;
+}
+
+static int is_token_end(char c) {
+    return c == '\0' || c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Extracts one memory access from a trace line. op is 'R', 'W' or 'I' (Lackey
+// instruction fetch). Returns 0 for lines that carry no access (headers,
+// comments, tool messages).
+int parse_trace_line(TraceFormat format, const char *line, unsigned long long *addr, char *op) {
+    const char *p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '\0' || *p == '\n' || *p == '#' || *p == '=') return 0;
+
+    if (format == TRACE_LACKEY) {
+        // "I  0400d7d4,8" / " S 1ffefffd50,8" / " L ..." / " M ..." (modify = load + store)
+        char kind = *p++;
+        if (kind != 'I' && kind != 'L' && kind != 'S' && kind != 'M') return 0;
+        while (*p == ' ') p++;
+        const char *end;
+        if (!parse_hex(p, addr, &end) || *end != ',') return 0;
+        *op = kind == 'I' ? 'I' : (kind == 'L' ? 'R' : 'W');
+        return 1;
+    }
+
+    if (format == TRACE_PLAIN) {
+        char kind = *p++;
+        if (kind == 'r') kind = 'R';
+        if (kind == 'w') kind = 'W';
+        if ((kind != 'R' && kind != 'W') || (*p != ' ' && *p != '\t')) return 0;
+        while (*p == ' ' || *p == '\t') p++;
+        const char *end;
+        if (!parse_hex(p, addr, &end) || !is_token_end(*end)) return 0;
+        *op = kind;
+        return 1;
+    }
+
+    // perf script: "comm pid [cpu] time: event: addr ..." - the data address is the
+    // first plain hex token after the event name (the token ending in ':' that
+    // contains letters). perf mem report -D: "pid tid 0xip 0xaddr ..." - second 0x token.
+    int seen_event = 0, hex_tokens = 0;
+    char kind = 'R';
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t') p++;
+        const char *start = p;
+        while (!is_token_end(*p)) p++;
+        size_t len = (size_t)(p - start);
+        if (len == 0) break;
+
+        if (start[len - 1] == ':') {
+            int letters = 0;
+            for (size_t k = 0; k < len; k++) {
+                if ((start[k] >= 'a' && start[k] <= 'z') || (start[k] >= 'A' && start[k] <= 'Z')) letters = 1;
+            }
+            if (letters) {
+                seen_event = 1;
+                for (size_t k = 0; k + 5 <= len; k++) {
+                    if (strncmp(start + k, "store", 5) == 0) kind = 'W';
+                }
+            }
+            continue;
+        }
+
+        const char *end;
+        unsigned long long value;
+        if (!parse_hex(start, &value, &end) || end != p) continue;
+        int prefixed = start[0] == '0' && (start[1] == 'x' || start[1] == 'X');
+        if (seen_event || (prefixed && ++hex_tokens == 2)) {
+            *addr = value;
+            *op = kind;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Streams a trace through the replacement engine (processes[0], given policy)
+// and the TLB, one line at a time; only the page id table grows with the
+// trace, and only with its distinct pages. Optimal needs the future and is not
+// available here.
+int replay_trace(FILE *in, TraceFormat format, int page_shift, int algo_choice, int with_instructions,
+                 TraceStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    PageFoldMap map;
+    if (!fold_map_init(&map, 1024)) return 0;
+
+    reset_replacement_state();
+    init_tlb();
+
+    char line[TRACE_LINE_MAX];
+    int ok = 1;
+    while (fgets(line, sizeof(line), in) != NULL) {
+        size_t len = strlen(line);
+        int complete = len > 0 && line[len - 1] == '\n';
+        stats->lines++;
+
+        unsigned long long addr;
+        char op;
+        int parsed = parse_trace_line(format, line, &addr, &op);
+
+        // Drop the rest of an overlong line
+        if (!complete && !feof(in)) {
+            int c;
+            while ((c = fgetc(in)) != '\n' && c != EOF);
+        }
+
+        if (!parsed) {
+            stats->skipped++;
+            continue;
+        }
+        if (op == 'I') {
+            stats->instructions++;
+            if (!with_instructions) continue;
+        } else if (op == 'W') {
+            stats->writes++;
+        } else {
+            stats->reads++;
+        }
+
+        int page = fold_page(&map, addr >> page_shift);
+        if (page < 0) {
+            ok = 0;
+            break;
+        }
+        stats->references++;
+        int step = (int)(stats->references & 0x7fffffff);
+
+        int tlb_index = search_tlb(page);
+        ReferenceResult r = reference_page(algo_choice, 0, page, NULL, 0, 0);
+        // Dirtiness comes from the trace, not from the engine's random modify bit
+        if (!r.hit) physical_memory[r.frame_no].modify_bit = 0;
+        if (op == 'W') physical_memory[r.frame_no].modify_bit = 1;
+        if (r.victim_dirty) stats->writebacks++;
+
+        // Shoot down the translation of an evicted page
+        if (r.victim_page >= 0) {
+            int stale = search_tlb(r.victim_page);
+            if (stale >= 0) tlb[stale].valid = 0;
+        }
+
+        if (tlb_index >= 0) {
+            stats->tlb_hits++;
+            tlb[tlb_index].last_used = step;
+        } else {
+            stats->tlb_misses++;
+            update_tlb(page, r.frame_no, step);
+        }
+        
+        AccessKind kind = !r.hit ? (r.victim_dirty ? ACCESS_WRITEBACK : ACCESS_FAULT) :
+                          tlb_index >= 0 ? ACCESS_TLB_HIT : ACCESS_WALK;
+        latency_record(&stats->latency[kind], access_latency(&trace_access_costs, kind));
+    }
+
+    stats->faults = page_faults;
+    stats->hits = page_hits;
+    stats->distinct_pages = map.count;
+    fold_map_free(&map);
+    return ok;
+}
+
+void display_trace_stats(const TraceStats *stats, double elapsed) {
+    long refs = stats->references > 0 ? stats->references : 1;
+    printf("Lines Read:        %ld (%ld without a memory access)\n", stats->lines, stats->skipped);
+    printf("References:        %ld (%ld reads, %ld writes", stats->references, stats->reads, stats->writes);
+    if (stats->instructions > 0) printf(", %ld instruction fetches", stats->instructions);
+    printf(")\n");
+    printf("Distinct Pages:    %d\n", stats->distinct_pages);
+    printf("Page Hits:         %ld\n", stats->hits);
+    printf("Page Faults:       %ld (%.2f%%)\n", stats->faults, (float)stats->faults / refs * 100);
+    printf("TLB Hits/Misses:   %ld / %ld (hit ratio %.2f%%, %d entries)\n", stats->tlb_hits,
+           stats->tlb_misses, (float)stats->tlb_hits / refs * 100, tlb_size);
+    printf("Dirty Write-backs: %ld\n", stats->writebacks);
+    printf("Elapsed:           %.3f s (%.0f lines/s)\n", elapsed, elapsed > 0 ? stats->lines / elapsed : 0);
+    
+    printf("\nAccess latency (%.0f ns TLB, %.0f ns walk, %.0f us fault, %.0f us write-back):\n",
+           trace_access_costs.tlb_ns, trace_access_costs.walk_ns,
+           trace_access_costs.fault_ns / 1000, trace_access_costs.writeback_ns / 1000);
+    display_access_latencies(stats->latency);
+}
+
+static int page_shift_for_kb(int page_kb) {
+    int shift = 10;
+    while ((1 << (shift - 10)) < page_kb && shift < 30) shift++;
+    return shift;
+}
+
+void simulate_trace_replay() {
+    if (physical_memory == NULL) {
+        printf(COLOR_RED "\nMemory not initialized! Please setup memory frames first.\n" COLOR_RESET);
+        printf("Press Enter to continue...");
+        getchar();
+        return;
+    }
+
+    term_clear();
+    display_header("REPLAY PROFILER TRACE");
+
+    const char *format_names[] = {"Valgrind Lackey", "perf script / perf mem", "Plain R/W"};
+    const char *algo_names[] = {"FIFO", "LRU", "Optimal", "Clock"};
+
+    printf("\n" COLOR_YELLOW "Trace Format:\n" COLOR_RESET);
+    printf(COLOR_CYAN "1." COLOR_RESET " Valgrind Lackey (--tool=lackey --trace-mem=yes)\n");
+    printf(COLOR_CYAN "2." COLOR_RESET " perf script (with addr field) / perf mem report -D\n");
+    printf(COLOR_CYAN "3." COLOR_RESET " Plain 'R <address>' / 'W <address>'\n");
+    printf("\n" COLOR_YELLOW "Enter your choice (1-3): " COLOR_RESET);
+    int format;
+    if (scanf("%d", &format) != 1) format = 3;
+    clear_input_buffer();
+    if (format < 1 || format > 3) format = 3;
+
+    printf(COLOR_CYAN "Trace file: " COLOR_RESET);
+    char path[256];
+    if (scanf("%255s", path) != 1) strcpy(path, "trace.txt");
+    clear_input_buffer();
+
+    printf(COLOR_CYAN "Page size in KB (power of two, 1-1048576): " COLOR_RESET);
+    int page_kb;
+    if (scanf("%d", &page_kb) != 1) page_kb = PAGE_SIZE;
+    clear_input_buffer();
+    if (page_kb < 1) page_kb = 1;
+    if (page_kb > 1048576) page_kb = 1048576;
+    int page_shift = page_shift_for_kb(page_kb);
+
+    printf(COLOR_CYAN "Replacement algorithm (1=FIFO 2=LRU 4=Clock): " COLOR_RESET);
+    int algo_choice;
+    if (scanf("%d", &algo_choice) != 1) algo_choice = 2;
+    clear_input_buffer();
+    if (algo_choice < 1 || algo_choice > 4 || algo_choice == 3) {
+        printf(COLOR_YELLOW "Optimal needs the whole future trace; using LRU.\n" COLOR_RESET);
+        algo_choice = 2;
+    }
+
+    printf(COLOR_CYAN "TLB size (2-32): " COLOR_RESET);
+    if (scanf("%d", &tlb_size) != 1) tlb_size = 16;
+    clear_input_buffer();
+    if (tlb_size < 2) tlb_size = 2;
+    if (tlb_size > 32) tlb_size = 32;
+
+    int with_instructions = 0;
+    if (format == 1) {
+        printf(COLOR_CYAN "Include instruction fetches? (y/n): " COLOR_RESET);
+        char choice = getchar();
+        clear_input_buffer();
+        with_instructions = choice == 'y' || choice == 'Y';
+    }
+
+    FILE *in = fopen(path, "r");
+    if (in == NULL) {
+        printf(COLOR_RED "Cannot open '%s'.\n" COLOR_RESET, path);
+        printf("\nPress Enter to continue...");
+        getchar();
+        return;
+    }
+
+    SimState user_state;
+    if (!sim_state_capture(&user_state)) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        fclose(in);
+        printf("\nPress Enter to continue...");
+        getchar();
+        return;
+    }
+
+    TraceStats stats;
+    double t0 = get_time_seconds();
+    int ok = replay_trace(in, (TraceFormat)(format - 1), page_shift, algo_choice, with_instructions, &stats);
+    double elapsed = get_time_seconds() - t0;
+    fclose(in);
+
+    sim_state_restore(&user_state);
+
+    printf("\n" COLOR_GREEN "================================================================\n");
+    printf("                     TRACE REPLAY RESULTS\n");
+    printf("================================================================\n" COLOR_RESET);
+    if (!ok) printf(COLOR_RED "Page table full, replay stopped early.\n" COLOR_RESET);
+    printf("Trace:             %s (%s)\n", path, format_names[format - 1]);
+    printf("Configuration:     %s, %d frames, %d KB pages\n", algo_names[algo_choice - 1], frame_count,
+           1 << (page_shift - 10));
+    display_trace_stats(&stats, elapsed);
+
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+// see --replay <lackey|perf|plain> <file|-> [frames] [page_kb] [algo 1|2|4] [--instructions]
+int run_trace_replay_cli(int argc, char *argv[]) {
+    // Lackey 'I' records are only replayed when asked for, as in the menu
+    int with_instructions = 0;
+    if (argc > 1 && strcmp(argv[argc - 1], "--instructions") == 0) {
+        with_instructions = 1;
+        argc--;
+    }
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s --replay <lackey|perf|plain> <file|-> [frames] [page_kb] [algo] [--instructions]\n",
+                argv[0]);
+        return 1;
+    }
+
+    TraceFormat format;
+    if (strcmp(argv[2], "lackey") == 0) format = TRACE_LACKEY;
+    else if (strcmp(argv[2], "perf") == 0) format = TRACE_PERF;
+    else if (strcmp(argv[2], "plain") == 0) format = TRACE_PLAIN;
+    else {
+        fprintf(stderr, "unknown trace format '%s'\n", argv[2]);
+        return 1;
+    }
+
+    int frames = argc > 4 ? atoi(argv[4]) : 64;
+    int page_kb = argc > 5 ? atoi(argv[5]) : PAGE_SIZE;
+    int algo_choice = argc > 6 ? atoi(argv[6]) : 2;
+    if (frames < 1) frames = 1;
+    if (frames > SERVER_MAX_FRAMES) frames = SERVER_MAX_FRAMES;
+    if (page_kb < 1) page_kb = PAGE_SIZE;
+    if (algo_choice != 1 && algo_choice != 4) algo_choice = 2;
+    tlb_size = 32;
+
+    FILE *in = strcmp(argv[3], "-") == 0 ? stdin : fopen(argv[3], "r");
+    if (in == NULL) {
+        fprintf(stderr, "cannot open '%s': %s\n", argv[3], strerror(errno));
+        return 1;
+    }
+    if (!resize_frames(frames)) {
+        fprintf(stderr, "cannot allocate %d frames\n", frames);
+        if (in != stdin) fclose(in);
+        return 1;
+    }
+
+    TraceStats stats;
+    double t0 = get_time_seconds();
+    int ok = replay_trace(in, format, page_shift_for_kb(page_kb), algo_choice, with_instructions, &stats);
+    double elapsed = get_time_seconds() - t0;
+    if (in != stdin) fclose(in);
+
+    printf("Configuration:     %s, %d frames, %d KB pages\n",
+           algo_choice == 1 ? "FIFO" : (algo_choice == 4 ? "Clock" : "LRU"), frame_count,
+           1 << (page_shift_for_kb(page_kb) - 10));
+    display_trace_stats(&stats, elapsed);
+    return ok ? 0 : 1;
+}
+
+// Sampled Miss-Ratio Curve Function Implementations
+
+// SHARDS: pages are sampled by a hash of their number, so a sampled page has all
+// of its references sampled and stack distances among the sample, scaled by
+// 1 / rate, estimate the full-trace LRU stack distances. The fixed-size variant
+// keeps at most max_samples pages: when one more would enter, the page with the
+// largest hash leaves and the threshold drops to its hash, and the histogram is
+// rescaled to the new rate. Distances come from a Fenwick tree over last-access
+// times that is renumbered when its time range fills, so memory is fixed.
+
+static unsigned long long shards_hash(unsigned long long page) {
+    page += 0x9e3779b97f4a7c15ULL;
+    page = (page ^ (page >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    page = (page ^ (page >> 27)) * 0x94d049bb133111ebULL;
+    return (page ^ (page >> 31)) & (SHARDS_MODULUS - 1);
+}
+
+int shards_init(ShardsSampler *s, int max_samples, double initial_rate, long max_cache) {
+    memset(s, 0, sizeof(*s));
+    if (max_samples < 1) max_samples = 1;
+    if (initial_rate <= 0 || initial_rate > 1) initial_rate = 1;
+    s->max_samples = max_samples;
+    s->threshold = (unsigned long long)(initial_rate * SHARDS_MODULUS);
+    if (s->threshold < 1) s->threshold = 1;
+    
+    int map_size = 1;
+    while (map_size < 2 * max_samples) map_size <<= 1;
+    s->map_mask = map_size - 1;
+    s->time_capacity = 4 * max_samples;
+    s->bucket_width = max_cache > SHARDS_BUCKETS ? (double)max_cache / SHARDS_BUCKETS : 1;
+    
+    s->entries = (ShardsEntry*)malloc((max_samples + 1) * sizeof(ShardsEntry));
+    s->free_slots = (int*)malloc((max_samples + 1) * sizeof(int));
+    s->map = (int*)malloc(map_size * sizeof(int));
+    s->heap = (int*)malloc((max_samples + 1) * sizeof(int));
+    s->fenwick = (int*)calloc(s->time_capacity + 1, sizeof(int));
+    s->time_owner = (int*)malloc(s->time_capacity * sizeof(int));
+    s->histogram = (double*)calloc(SHARDS_BUCKETS + 1, sizeof(double));
+    if (s->entries == NULL || s->free_slots == NULL || s->map == NULL || s->heap == NULL ||
+        s->fenwick == NULL || s->time_owner == NULL || s->histogram == NULL) {
+        shards_free(s);
+        return 0;
+    }
+    
+    for (int i = 0; i <= max_samples; i++) s->free_slots[i] = max_samples - i;
+    s->free_count = max_samples + 1;
+    for (int i = 0; i < map_size; i++) s->map[i] = -1;
+    for (int t = 0; t < s->time_capacity; t++) s->time_owner[t] = -1;
+    return 1;
+}
+
+void shards_free(ShardsSampler *s) {
+    free(s->entries);
+    free(s->free_slots);
+    free(s->map);
+    free(s->heap);
+    free(s->fenwick);
+    free(s->time_owner);
+    free(s->histogram);
+    memset(s, 0, sizeof(*s));
+}
+
+double shards_rate(const ShardsSampler *s) {
+    return (double)s->threshold / SHARDS_MODULUS;
+}
+
+size_t shards_memory(const ShardsSampler *s) {
+    return (size_t)(s->max_samples + 1) * (sizeof(ShardsEntry) + 2 * sizeof(int)) +
+           (size_t)(s->map_mask + 1) * sizeof(int) +
+           (size_t)(2 * s->time_capacity + 1) * sizeof(int) +
+           (SHARDS_BUCKETS + 1) * sizeof(double);
+}
+
+static void fenwick_add(ShardsSampler *s, int t, int delta) {
+    for (int i = t + 1; i <= s->time_capacity; i += i & -i) s->fenwick[i] += delta;
+}
+
+static int fenwick_prefix(const ShardsSampler *s, int t) { // live entries with time <= t
+    int sum = 0;
+    for (int i = t + 1; i > 0; i -= i & -i) sum += s->fenwick[i];
+    return sum;
+}
+
+// Packs live access times into 0..live-1 (keeping their order) and rebuilds the tree
+static void shards_renumber(ShardsSampler *s) {
+    int next = 0;
+    for (int t = 0; t < s->time_capacity; t++) {
+        int e = s->time_owner[t];
+        if (e < 0) continue;
+        s->time_owner[t] = -1;
+        s->time_owner[next] = e;
+        s->entries[e].time = next++;
+    }
+    for (int i = 1; i <= s->time_capacity; i++) {
+        s->fenwick[i] = i <= next ? 1 : 0;
+    }
+    // Linear-time Fenwick build from the counts
+    for (int i = 1; i <= s->time_capacity; i++) {
+        int parent = i + (i & -i);
+        if (parent <= s->time_capacity) s->fenwick[parent] += s->fenwick[i];
+    }
+    s->clock = next;
+}
+
+static int shards_map_find(const ShardsSampler *s, unsigned long long page, unsigned long long hash) {
+    int i = (int)(hash & (unsigned long long)s->map_mask);
+    while (s->map[i] >= 0) {
+        if (s->entries[s->map[i]].page == page) return i;
+        i = (i + 1) & s->map_mask;
+    }
+    return i;
+}
+
+// Removes map slot i, shifting later entries of the probe run back
+static void shards_map_delete(ShardsSampler *s, int i) {
+    int j = i;
+    for (;;) {
+        s->map[i] = -1;
+        for (;;) {
+            j = (j + 1) & s->map_mask;
+            if (s->map[j] < 0) return;
+            int home = (int)(s->entries[s->map[j]].hash & (unsigned long long)s->map_mask);
+            // Move map[j] into the hole unless its home lies cyclically in (i, j]
+            if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) break;
+        }
+        s->map[i] = s->map[j];
+        i = j;
+    }
+}
+
+static void shards_heap_push(ShardsSampler *s, int e) {
+    int i = s->heap_size++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (s->entries[s->heap[parent]].hash >= s->entries[e].hash) break;
+        s->heap[i] = s->heap[parent];
+        i = parent;
+    }
+    s->heap[i] = e;
+}
+
+static int shards_heap_pop(ShardsSampler *s) {
+    int top = s->heap[0];
+    int last = s->heap[--s->heap_size];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= s->heap_size) break;
+        if (child + 1 < s->heap_size && s->entries[s->heap[child + 1]].hash > s->entries[s->heap[child]].hash) child++;
+        if (s->entries[s->heap[child]].hash <= s->entries[last].hash) break;
+        s->heap[i] = s->heap[child];
+        i = child;
+    }
+    if (s->heap_size > 0) s->heap[i] = last;
+    return top;
+}
+
+// Lowers the threshold to the largest sampled hash and drops every page at or above it
+static void shards_shrink(ShardsSampler *s) {
+    unsigned long long old_threshold = s->threshold;
+    s->threshold = s->entries[s->heap[0]].hash;
+    while (s->heap_size > 0 && s->entries[s->heap[0]].hash >= s->threshold) {
+        int e = shards_heap_pop(s);
+        shards_map_delete(s, shards_map_find(s, s->entries[e].page, s->entries[e].hash));
+        fenwick_add(s, s->entries[e].time, -1);
+        s->time_owner[s->entries[e].time] = -1;
+        s->entries[e].time = -1;
+        s->free_slots[s->free_count++] = e;
+        s->live--;
+    }
+    
+    // Counts gathered at the old rate stand for fewer references at the new one
+    double scale = (double)s->threshold / old_threshold;
+    for (int b = 0; b <= SHARDS_BUCKETS; b++) s->histogram[b] *= scale;
+    s->cold *= scale;
+    s->rate_drops++;
+}
+
+void shards_access(ShardsSampler *s, unsigned long long page) {
+    s->references++;
+    unsigned long long hash = shards_hash(page);
+    if (hash >= s->threshold) return;
+    s->sampled_refs++;
+    
+    int slot = shards_map_find(s, page, hash);
+    int e = s->map[slot];
+    if (e >= 0) {
+        // Stack distance = distinct sampled pages touched since, plus this one
+        int t = s->entries[e].time;
+        int distance = s->live - fenwick_prefix(s, t) + 1;
+        fenwick_add(s, t, -1);
+        s->time_owner[t] = -1;
+        
+        double scaled = distance / shards_rate(s);
+        long bucket = (long)((scaled - 1) / s->bucket_width);
+        if (bucket > SHARDS_BUCKETS) bucket = SHARDS_BUCKETS;
+        s->histogram[bucket] += 1;
+    } else {
+        e = s->free_slots[--s->free_count];
+        s->entries[e].page = page;
+        s->entries[e].hash = hash;
+        s->map[slot] = e;
+        shards_heap_push(s, e);
+        s->live++;
+        s->sampled_pages++;
+        s->cold += 1;
+    }
+    
+    if (s->clock == s->time_capacity) shards_renumber(s);
+    s->entries[e].time = s->clock;
+    s->time_owner[s->clock] = e;
+    fenwick_add(s, s->clock, 1);
+    s->clock++;
+    
+    if (s->live > s->max_samples) shards_shrink(s);
+}
+
+// Estimated LRU miss ratio for a cache of cache_pages pages. The gap between
+// the references the rate predicts and those sampled is credited to the
+// smallest distance bucket (the SHARDS_adj correction).
+double shards_miss_ratio(const ShardsSampler *s, long cache_pages) {
+    double expected = s->references * shards_rate(s);
+    if (expected <= 0) return 0;
+    
+    double counted = s->cold, misses = s->cold;
+    long first_miss = (long)(cache_pages / s->bucket_width);
+    for (long b = 0; b <= SHARDS_BUCKETS; b++) {
+        counted += s->histogram[b];
+        if (b >= first_miss) misses += s->histogram[b];
+    }
+    if (first_miss == 0) misses += expected - counted;
+    
+    double ratio = misses / expected;
+    return ratio < 0 ? 0 : (ratio > 1 ? 1 : ratio);
+}
+
+// Newton's method square root, so the tool does not need libm
+static double sqrt_approx(double x) {
+    if (x <= 0) return 0;
+    double r = x > 1 ? x : 1;
+    for (int i = 0; i < 60; i++) {
+        double next = 0.5 * (r + x / r);
+        if (next >= r) break;
+        r = next;
+    }
+    return r;
+}
+
+// Deterministic generator for a production-shaped stream: a skewed hot set
+// mixed with sequential scans over a large page universe
+static unsigned long long mrc_next(unsigned long long *state, unsigned long long universe,
+                                   unsigned long long *scan) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    double u = (double)(*state >> 11) / (double)(1ULL << 53);
+    if (u < 0.15) {
+        *scan = (*scan + 1) % universe;
+        return *scan;
+    }
+    double v = (u - 0.15) / 0.85;
+    return (unsigned long long)(v * v * v * v * (double)universe);
+}
+
+void simulate_shards_mrc() {
+    term_clear();
+    display_header("SAMPLED MISS-RATIO CURVE");
+    
+    printf("\n" COLOR_YELLOW "Trace Source:\n" COLOR_RESET);
+    printf(COLOR_CYAN "1." COLOR_RESET " Generated (skewed hot set + scans)\n");
+    printf(COLOR_CYAN "2." COLOR_RESET " Trace file (Lackey / perf / R-W)\n");
+    printf("\n" COLOR_YELLOW "Enter your choice (1-2): " COLOR_RESET);
+    int source;
+    if (scanf("%d", &source) != 1) source = 1;
+    clear_input_buffer();
+    if (source != 2) source = 1;
+    
+    long long length = 10000000;
+    long long universe = 1000000;
+    int page_shift = 12, format = 3, with_exact = 0;
+    char path[256] = "";
+    
+    if (source == 1) {
+        printf(COLOR_CYAN "References (1000-2000000000): " COLOR_RESET);
+        if (scanf("%lld", &length) != 1) length = 10000000;
+        clear_input_buffer();
+        if (length < 1000) length = 1000;
+        if (length > 2000000000LL) length = 2000000000LL;
+        
+        printf(COLOR_CYAN "Distinct pages in the universe (100-100000000): " COLOR_RESET);
+        if (scanf("%lld", &universe) != 1) universe = 1000000;
+        clear_input_buffer();
+        if (universe < 100) universe = 100;
+        if (universe > 100000000LL) universe = 100000000LL;
+        
+        printf(COLOR_CYAN "Also compute the exact curve to measure the error? (y/n): " COLOR_RESET);
+        char choice = getchar();
+        clear_input_buffer();
+        with_exact = choice == 'y' || choice == 'Y';
+    } else {
+        printf(COLOR_CYAN "Format (1=Lackey 2=perf 3=plain R/W): " COLOR_RESET);
+        if (scanf("%d", &format) != 1) format = 3;
+        clear_input_buffer();
+        if (format < 1 || format > 3) format = 3;
+        
+        printf(COLOR_CYAN "Trace file: " COLOR_RESET);
+        if (scanf("%255s", path) != 1) strcpy(path, "trace.txt");
+        clear_input_buffer();
+        
+        printf(COLOR_CYAN "Page size in KB (power of two): " COLOR_RESET);
+        int page_kb;
+        if (scanf("%d", &page_kb) != 1) page_kb = PAGE_SIZE;
+        clear_input_buffer();
+        if (page_kb < 1) page_kb = 1;
+        if (page_kb > 1048576) page_kb = 1048576;
+        page_shift = page_shift_for_kb(page_kb);
+    }
+    
+    printf(COLOR_CYAN "Largest cache size on the curve, in pages: " COLOR_RESET);
+    long max_cache;
+    if (scanf("%ld", &max_cache) != 1) max_cache = source == 1 ? (long)universe : 1000000;
+    clear_input_buffer();
+    if (max_cache < 10) max_cache = 10;
+    
+    printf(COLOR_CYAN "Sample size in pages (64-1000000): " COLOR_RESET);
+    int max_samples;
+    if (scanf("%d", &max_samples) != 1) max_samples = 8192;
+    clear_input_buffer();
+    if (max_samples < 64) max_samples = 64;
+    if (max_samples > 1000000) max_samples = 1000000;
+    
+    printf(COLOR_CYAN "Initial sampling rate (0.0001-1): " COLOR_RESET);
+    double rate;
+    if (scanf("%lf", &rate) != 1) rate = 0.1;
+    clear_input_buffer();
+    if (rate < 0.0001) rate = 0.0001;
+    if (rate > 1) rate = 1;
+    
+    ShardsSampler sampler, exact;
+    memset(&exact, 0, sizeof(exact));
+    if (!shards_init(&sampler, max_samples, rate, max_cache) ||
+        (with_exact && !shards_init(&exact, (int)universe, 1.0, max_cache))) {
+        shards_free(&sampler);
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        printf("\nPress Enter to continue...");
+        getchar();
+        return;
+    }
+    
+    double sample_time = 0, exact_time = 0;
+    long long skipped = 0;
+    if (source == 1) {
+        unsigned long long state = 88172645463325252ULL, scan = 0;
+        double t0 = get_time_seconds();
+        for (long long i = 0; i < length; i++) {
+            shards_access(&sampler, mrc_next(&state, (unsigned long long)universe, &scan));
+        }
+        sample_time = get_time_seconds() - t0;
+        
+        if (with_exact) {
+            state = 88172645463325252ULL;
+            scan = 0;
+            t0 = get_time_seconds();
+            for (long long i = 0; i < length; i++) {
+                shards_access(&exact, mrc_next(&state, (unsigned long long)universe, &scan));
+            }
+            exact_time = get_time_seconds() - t0;
+        }
+    } else {
+        FILE *in = fopen(path, "r");
+        if (in == NULL) {
+            shards_free(&sampler);
+            printf(COLOR_RED "Cannot open '%s'.\n" COLOR_RESET, path);
+            printf("\nPress Enter to continue...");
+            getchar();
+            return;
+        }
+        char line[TRACE_LINE_MAX];
+        double t0 = get_time_seconds();
+        while (fgets(line, sizeof(line), in) != NULL) {
+            unsigned long long addr;
+            char op;
+            size_t len = strlen(line);
+            int parsed = parse_trace_line((TraceFormat)(format - 1), line, &addr, &op);
+            if (len > 0 && line[len - 1] != '\n' && !feof(in)) {
+                int c;
+                while ((c = fgetc(in)) != '\n' && c != EOF);
+            }
+            if (!parsed || op == 'I') {
+                skipped++;
+                continue;
+            }
+            shards_access(&sampler, addr >> page_shift);
+        }
+        sample_time = get_time_seconds() - t0;
+        fclose(in);
+    }
+    
+    long long refs = sampler.references > 0 ? sampler.references : 1;
+    printf("\n" COLOR_GREEN "================================================================\n");
+    printf("                  SAMPLED LRU MISS-RATIO CURVE\n");
+    printf("================================================================\n" COLOR_RESET);
+    printf("References:        %lld", sampler.references);
+    if (skipped > 0) printf(" (%lld lines skipped)", skipped);
+    printf("\nSampled:           %lld references, %lld distinct pages (%d held at the end)\n",
+           sampler.sampled_refs, sampler.sampled_pages, sampler.live);
+    printf("Final Rate:        %.6f (started at %.4f, lowered %d times)\n", shards_rate(&sampler), rate,
+           sampler.rate_drops);
+    printf("Sampler Memory:    %.1f KB (fixed)", shards_memory(&sampler) / 1024.0);
+    if (with_exact) printf(", exact: %.1f KB", shards_memory(&exact) / 1024.0);
+    printf("\nThroughput:        %.1f ns/reference", sample_time / refs * 1e9);
+    if (with_exact) printf(" (exact: %.1f ns/reference)", exact_time / refs * 1e9);
+    printf("\n\n");
+    
+    // The sample is a set of pages, so the binomial error of a miss ratio
+    // estimated from them shrinks with the number of sampled pages.
+    double n = sampler.sampled_pages > 1 ? (double)sampler.sampled_pages : 1;
+    if (with_exact) {
+        printf(COLOR_YELLOW "%12s %12s %10s %12s %10s\n" COLOR_RESET, "Cache Pages", "SHARDS Miss", "95% Bound",
+               "Exact Miss", "Error");
+    } else {
+        printf(COLOR_YELLOW "%12s %12s %10s\n" COLOR_RESET, "Cache Pages", "SHARDS Miss", "95% Bound");
+    }
+    for (int k = 1; k <= 16; k++) {
+        long cache = (long)((double)max_cache * k / 16);
+        double m = shards_miss_ratio(&sampler, cache);
+        double bound = 1.96 * sqrt_approx(m * (1 - m) / n);
+        printf("%12ld %11.2f%% %9.2f%%", cache, m * 100, bound * 100);
+        if (with_exact) {
+            double x = shards_miss_ratio(&exact, cache);
+            printf(" %11.2f%% %9.2f%%", x * 100, (m - x) * 100);
+        }
+        printf("\n");
+    }
+    
+    if (with_exact) {
+        double total_error = 0, worst = 0;
+        for (int b = 1; b <= SHARDS_BUCKETS; b++) {
+            long cache = (long)(b * sampler.bucket_width);
+            double err = shards_miss_ratio(&sampler, cache) - shards_miss_ratio(&exact, cache);
+            if (err < 0) err = -err;
+            total_error += err;
+            if (err > worst) worst = err;
+        }
+        printf("\nMean absolute error over %d points: %.3f%% (worst %.3f%%)\n", SHARDS_BUCKETS,
+               total_error / SHARDS_BUCKETS * 100, worst * 100);
+        shards_free(&exact);
+    }
+    shards_free(&sampler);
+    
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+// Copy-on-Write Fork Function Implementations
+
+// Creates a child of processes[parent_index] with a copy of its page table.
+// With copy_on_write the child maps the parent's resident frames, both sides
+// write-protected and in one share group per page; otherwise every resident
+// page is copied into a frame of its own at fork time, through the
+// replacement policy. Returns the child's index, or -1 if the process table
+// is full.
+int fork_process(int parent_index, int copy_on_write, int algo_choice, ForkStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (process_count >= MAX_PROCESSES || physical_memory == NULL) return -1;
+    
+    // Share groups are numbered above any still in use
+    int next_group = 1;
+    for (int p = 0; p < process_count; p++) {
+        for (int i = 0; i < processes[p].page_count; i++) {
+            if (processes[p].page_table[i].cow >= next_group) next_group = processes[p].page_table[i].cow + 1;
+        }
+    }
+    
+    int child_index = process_count;
+    Process *parent = &processes[parent_index];
+    Process *child = &processes[child_index];
+    char parent_name[sizeof(parent->name)];
+    memcpy(parent_name, parent->name, sizeof(parent_name));
+    *child = *parent;
+    child->pid = process_count + 1;
+    snprintf(child->name, sizeof(child->name), "%.13s-child", parent_name);
+    process_count++;
+    
+    for (int i = 0; i < child->page_count; i++) {
+        PageTableEntry *pte = &child->page_table[i];
+        // Swapped-out pages are not carried over; the child faults them in fresh
+        pte->swap_slot = -1;
+        if (!parent->page_table[i].valid) {
+            pte->valid = 0;
+            pte->frame_no = -1;
+            pte->cow = 0;
+            continue;
+        }
+        
+        int source = parent->page_table[i].frame_no;
+        if (copy_on_write) {
+            if (parent->page_table[i].cow == 0) parent->page_table[i].cow = next_group++;
+            pte->cow = parent->page_table[i].cow;
+            if (physical_memory[source].share_count < 1) physical_memory[source].share_count = 1;
+            physical_memory[source].share_count++;
+            continue;
+        }
+        
+        ReferenceResult r = {0, -1, -1, -1, 0, 0, 0, 0, 0};
+        time_counter++;
+        select_frame(algo_choice == 3 ? 2 : algo_choice, child->pid, i, NULL, 0, 0, &r);
+        if (r.victim_page >= 0) stats->fork_evictions++;
+        stats->frames_copied++;
+        
+        physical_memory[r.frame_no].occupied = 1;
+        physical_memory[r.frame_no].page_no = i;
+        physical_memory[r.frame_no].process_id = child->pid;
+        physical_memory[r.frame_no].reference_bit = 1;
+        physical_memory[r.frame_no].modify_bit = 1;
+        physical_memory[r.frame_no].load_time = time_counter;
+        physical_memory[r.frame_no].prefetched = 0;
+        physical_memory[r.frame_no].share_count = 1;
+        pte->valid = 1;
+        pte->frame_no = r.frame_no;
+        pte->cow = 0;
+        pte->last_used = time_counter;
+    }
+    
+    for (int f = 0; f < frame_count; f++) {
+        if (physical_memory[f].occupied && physical_memory[f].share_count > 1) stats->shared_frames++;
+    }
+    return child_index;
+}
+
+// Resident mappings minus occupied frames: the frames copies would need
+int frames_saved_by_sharing() {
+    int saved = 0;
+    for (int f = 0; f < frame_count; f++) {
+        if (physical_memory[f].occupied && physical_memory[f].share_count > 1) {
+            saved += physical_memory[f].share_count - 1;
+        }
+    }
+    return saved;
+}
+
+static unsigned int fork_rand(unsigned long long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (unsigned int)(*state >> 32);
+}
+
+typedef struct {
+    ForkStats fork;
+    int saved_at_fork;
+    int saved_at_end;
+    int faults;
+    int cow_faults;
+    int shared_evictions;  // evictions of frames that were still shared
+    int mappings_lost;     // sharer mappings those evictions took down
+} ForkRunResults;
+
+// A parent warms its pages, forks children (eagerly or copy-on-write), then
+// all processes run in 10-reference slices with the given share of stores
+static void run_fork_workload(int algo_choice, int copy_on_write, int parent_pages, int children,
+                              int refs_per_process, int write_percent, ForkRunResults *out) {
+    memset(out, 0, sizeof(*out));
+    unsigned long long seed = 0x2545F4914F6CDD1DULL + (unsigned long long)write_percent;
+    
+    process_count = 1;
+    Process *parent = &processes[0];
+    parent->pid = 1;
+    strcpy(parent->name, "server");
+    parent->page_count = parent_pages;
+    parent->seg_count = 0;
+    for (int i = 0; i < parent_pages; i++) {
+        parent->page_table[i].page_no = i;
+        parent->page_table[i].modify_bit = 0;
+    }
+    reset_replacement_state();
+    
+    for (int i = 0; i < parent_pages; i++) reference_page(algo_choice, 0, i, NULL, 0, 0);
+    
+    for (int c = 0; c < children; c++) {
+        ForkStats fs;
+        if (fork_process(0, copy_on_write, algo_choice, &fs) < 0) break;
+        out->fork.frames_copied += fs.frames_copied;
+        out->fork.fork_evictions += fs.fork_evictions;
+        out->fork.shared_frames = fs.shared_frames;
+    }
+    out->saved_at_fork = frames_saved_by_sharing();
+    page_faults = 0;
+    page_hits = 0;
+    
+    int last_page[MAX_PROCESSES];
+    for (int p = 0; p < process_count; p++) last_page[p] = (int)(fork_rand(&seed) % parent_pages);
+    
+    for (int base = 0; base < refs_per_process; base += 10) {
+        for (int p = 0; p < process_count; p++) {
+            for (int i = base; i < base + 10 && i < refs_per_process; i++) {
+                int page = last_page[p];
+                if (fork_rand(&seed) % 3 != 0) {
+                    page += (int)(fork_rand(&seed) % 3) - 1;
+                    if (page < 0) page = 0;
+                    if (page >= parent_pages) page = parent_pages - 1;
+                } else {
+                    page = (int)(fork_rand(&seed) % parent_pages);
+                }
+                last_page[p] = page;
+                
+                ReferenceResult r = (int)(fork_rand(&seed) % 100) < write_percent ?
+                                    write_page(algo_choice, p, page, NULL, 0, 0) :
+                                    reference_page(algo_choice, p, page, NULL, 0, 0);
+                if (r.cow_copy) out->cow_faults++;
+                if (r.victim_sharers > 0) {
+                    out->shared_evictions++;
+                    out->mappings_lost += r.victim_sharers;
+                }
+            }
+        }
+    }
+    out->faults = page_faults;
+    out->saved_at_end = frames_saved_by_sharing();
+}
+
+void simulate_cow_fork() {
+    if (physical_memory == NULL) {
+        printf(COLOR_RED "\nMemory not initialized! Please setup memory frames first.\n" COLOR_RESET);
+        printf("Press Enter to continue...");
+        getchar();
+        return;
+    }
+    
+    term_clear();
+    display_header("FORK: EAGER COPY VS COPY-ON-WRITE");
+    
+    printf("\n" COLOR_CYAN "Replacement algorithm (1=FIFO 2=LRU 4=Clock): " COLOR_RESET);
+    int algo_choice;
+    if (scanf("%d", &algo_choice) != 1) algo_choice = 2;
+    clear_input_buffer();
+    if (algo_choice < 1 || algo_choice > 4 || algo_choice == 3) algo_choice = 2;
+    
+    printf(COLOR_CYAN "Parent pages (2-%d): " COLOR_RESET, MAX_PAGES);
+    int parent_pages;
+    if (scanf("%d", &parent_pages) != 1) parent_pages = frame_count / 2;
+    clear_input_buffer();
+    if (parent_pages < 2) parent_pages = 2;
+    if (parent_pages > MAX_PAGES) parent_pages = MAX_PAGES;
+    
+    printf(COLOR_CYAN "Children to fork (1-%d): " COLOR_RESET, MAX_PROCESSES - 1);
+    int children;
+    if (scanf("%d", &children) != 1) children = 2;
+    clear_input_buffer();
+    if (children < 1) children = 1;
+    if (children > MAX_PROCESSES - 1) children = MAX_PROCESSES - 1;
+    
+    printf(COLOR_CYAN "References per process after fork (10-1000000): " COLOR_RESET);
+    int refs_per_process;
+    if (scanf("%d", &refs_per_process) != 1) refs_per_process = 2000;
+    clear_input_buffer();
+    if (refs_per_process < 10) refs_per_process = 10;
+    if (refs_per_process > 1000000) refs_per_process = 1000000;
+    
+    SimState user_state;
+    if (!sim_state_capture(&user_state)) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        return;
+    }
+    
+    const char *algo_names[] = {"FIFO", "LRU", "Optimal", "Clock"};
+    static const int write_percents[] = {0, 1, 5, 25, 100};
+    printf("\n" COLOR_GREEN "================================================================\n");
+    printf("                     FORK SIMULATION RESULTS\n");
+    printf("================================================================\n" COLOR_RESET);
+    printf("%s, %d frames, parent with %d pages, %d children, %d references each\n\n",
+           algo_names[algo_choice - 1], frame_count, parent_pages, children, refs_per_process);
+    printf(COLOR_YELLOW "%-6s %6s %8s %9s %9s %8s %8s %9s %9s\n" COLOR_RESET, "Fork", "Writes", "Copied",
+           "Fork Evct", "Saved@Fork", "Saved@End", "Faults", "COW Flts", "Shr Evct");
+    
+    for (int w = 0; w < 5; w++) {
+        for (int mode = 0; mode <= 1; mode++) {
+            ForkRunResults res;
+            run_fork_workload(algo_choice, mode, parent_pages, children, refs_per_process,
+                              write_percents[w], &res);
+            printf("%-6s %5d%% %8d %9d %9d %9d %8d %8d %5d/%-3d\n", mode ? "COW" : "Eager",
+                   write_percents[w], res.fork.frames_copied, res.fork.fork_evictions, res.saved_at_fork,
+                   res.saved_at_end, res.faults, res.cow_faults, res.shared_evictions, res.mappings_lost);
+        }
+    }
+    printf("\nSaved = frames separate copies would need. Shr Evct = evictions of shared\n");
+    printf("frames / sharer mappings they took down (each sharer then faults its own copy).\n");
+    
+    sim_state_restore(&user_state);
+    
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+void fork_menu() {
+    term_clear();
+    display_header("FORK & COPY-ON-WRITE");
+    
+    printf("\n" COLOR_YELLOW "Options:\n" COLOR_RESET);
+    printf(COLOR_CYAN "1." COLOR_RESET " Fork a process (copy-on-write)\n");
+    printf(COLOR_CYAN "2." COLOR_RESET " Compare eager and copy-on-write fork under load\n");
+    printf(COLOR_CYAN "0." COLOR_RESET " Back\n");
+    printf("\n" COLOR_YELLOW "Enter your choice: " COLOR_RESET);
+    
+    int choice;
+    if (scanf("%d", &choice) != 1) choice = 0;
+    clear_input_buffer();
+    
+    if (choice == 1) {
+        if (physical_memory == NULL || process_count < 1 || process_count >= MAX_PROCESSES) {
+            printf(COLOR_RED "%s\n" COLOR_RESET, physical_memory == NULL ?
+                   "Memory not initialized! Please setup memory frames first." :
+                   process_count < 1 ? "No processes! Please add processes first." : "Process table is full.");
+            printf("\nPress Enter to continue...");
+            getchar();
+            return;
+        }
+        
+        printf(COLOR_CYAN "Parent process ID (1-%d): " COLOR_RESET, process_count);
+        int pid;
+        if (scanf("%d", &pid) != 1) pid = 1;
+        clear_input_buffer();
+        int parent_index = -1;
+        for (int p = 0; p < process_count; p++) {
+            if (processes[p].pid == pid) parent_index = p;
+        }
+        if (parent_index < 0) {
+            printf(COLOR_RED "No process with ID %d.\n" COLOR_RESET, pid);
+            printf("\nPress Enter to continue...");
+            getchar();
+            return;
+        }
+        
+        ForkStats fs;
+        int child_index = fork_process(parent_index, 1, 2, &fs);
+        printf(COLOR_GREEN "\nForked P%d (%s) from P%d: %d frames shared, %d frames saved in total\n" COLOR_RESET,
+               processes[child_index].pid, processes[child_index].name, processes[parent_index].pid,
+               fs.shared_frames, frames_saved_by_sharing());
+        display_memory();
+        printf("\nPress Enter to continue...");
+        getchar();
+    } else if (choice == 2) {
+        simulate_cow_fork();
+    }
+}
+
+// Same-Page Merging Function Implementations
+
+static int ksm_index_init(KsmIndex *idx, int capacity) {
+    idx->keys = (unsigned int*)malloc(capacity * sizeof(unsigned int));
+    idx->frames = (int*)malloc(capacity * sizeof(int));
+    idx->capacity = capacity;
+    idx->count = 0;
+    if (idx->keys == NULL || idx->frames == NULL) return 0;
+    for (int i = 0; i < capacity; i++) idx->frames[i] = -1;
+    return 1;
+}
+
+static void ksm_index_clear(KsmIndex *idx) {
+    for (int i = 0; i < idx->capacity; i++) idx->frames[i] = -1;
+    idx->count = 0;
+}
+
+static int ksm_index_slot(const KsmIndex *idx, unsigned int content) {
+    int mask = idx->capacity - 1;
+    int i = (int)((content * 2654435761u) >> 7) & mask;
+    while (idx->frames[i] >= 0 && idx->keys[i] != content) i = (i + 1) & mask;
+    return i;
+}
+
+static void ksm_index_put(KsmIndex *idx, unsigned int content, int frame) {
+    int i = ksm_index_slot(idx, content);
+    if (idx->frames[i] < 0) idx->count++;
+    idx->keys[i] = content;
+    idx->frames[i] = frame;
+}
+
+// Content of the page in frame f, read through its owner's page table entry.
+// Returns 0 for free frames and pages outside any page table.
+static int ksm_frame_content(int f, unsigned int *content) {
+    if (!physical_memory[f].occupied) return 0;
+    PageTableEntry *pte = find_pte(physical_memory[f].process_id, physical_memory[f].page_no);
+    if (pte == NULL || !pte->valid || pte->frame_no != f) return 0;
+    *content = pte->content;
+    return 1;
+}
+
+// Frame the index holds for content, if it still holds that content
+static int ksm_index_get(const KsmIndex *idx, unsigned int content) {
+    int f = idx->frames[ksm_index_slot(idx, content)];
+    unsigned int current;
+    return f >= 0 && ksm_frame_content(f, &current) && current == content ? f : -1;
+}
+
+int ksm_init(KsmScanner *k, const KsmConfig *cfg) {
+    memset(k, 0, sizeof(*k));
+    k->cfg = *cfg;
+    int capacity = 16;
+    while (capacity < 4 * frame_count) capacity <<= 1;
+    k->last_checksum = (unsigned int*)calloc(frame_count, sizeof(unsigned int));
+    k->seen = (unsigned char*)calloc(frame_count, 1);
+    if (!ksm_index_init(&k->stable, capacity) || !ksm_index_init(&k->unstable, capacity) ||
+        k->last_checksum == NULL || k->seen == NULL) {
+        ksm_free(k);
+        return 0;
+    }
+    return 1;
+}
+
+void ksm_free(KsmScanner *k) {
+    free(k->stable.keys);
+    free(k->stable.frames);
+    free(k->unstable.keys);
+    free(k->unstable.frames);
+    free(k->last_checksum);
+    free(k->seen);
+    memset(k, 0, sizeof(*k));
+}
+
+// Maps every page table entry of frame dup onto frame keep (identical content),
+// write-protects all of them in one share group and frees dup. Returns the
+// number of mappings moved.
+int ksm_merge_frames(int keep, int dup) {
+    int group = 0, next_group = 1;
+    for (int p = 0; p < process_count; p++) {
+        for (int i = 0; i < processes[p].page_count; i++) {
+            PageTableEntry *pte = &processes[p].page_table[i];
+            if (pte->cow >= next_group) next_group = pte->cow + 1;
+            if (pte->valid && pte->frame_no == keep && pte->cow) group = pte->cow;
+        }
+    }
+    if (group == 0) group = next_group;
+    
+    int moved = 0;
+    for (int p = 0; p < process_count; p++) {
+        for (int i = 0; i < processes[p].page_count; i++) {
+            PageTableEntry *pte = &processes[p].page_table[i];
+            if (!pte->valid) continue;
+            if (pte->frame_no == keep) {
+                pte->cow = group;
+            } else if (pte->frame_no == dup) {
+                pte->frame_no = keep;
+                pte->cow = group;
+                moved++;
+            }
+        }
+    }
+    
+    Frame *k = &physical_memory[keep], *d = &physical_memory[dup];
+    if (k->share_count < 1) k->share_count = 1;
+    k->share_count += moved;
+    k->reference_bit |= d->reference_bit;
+    k->modify_bit |= d->modify_bit;
+    if (d->load_time > k->load_time) k->load_time = d->load_time;
+    
+    d->occupied = 0;
+    d->page_no = -1;
+    d->process_id = -1;
+    d->reference_bit = 0;
+    d->modify_bit = 0;
+    d->load_time = -1;
+    d->prefetched = 0;
+    d->share_count = 0;
+    return moved;
+}
+
+// One wake-up of the scanner: examines the next pages_per_scan frames. A page
+// matching a stable (already merged) page is merged into it at once. Otherwise
+// it must be unchanged since the previous pass to be a candidate; two
+// unchanged pages with the same content in the unstable index are merged and
+// the survivor becomes stable. The unstable index starts over every pass.
+void ksm_scan(KsmScanner *k) {
+    for (int n = 0; n < k->cfg.pages_per_scan; n++) {
+        int f = k->cursor;
+        if (++k->cursor >= frame_count) {
+            k->cursor = 0;
+            k->passes++;
+            ksm_index_clear(&k->unstable);
+        }
+        
+        unsigned int content;
+        if (!ksm_frame_content(f, &content)) continue;
+        k->scanned++;
+        k->cpu_ns += k->cfg.checksum_ns;
+        
+        int stable = ksm_index_get(&k->stable, content);
+        if (stable == f) continue;
+        if (stable >= 0) {
+            k->compares++;
+            k->cpu_ns += k->cfg.compare_ns + k->cfg.merge_ns;
+            ksm_merge_frames(stable, f);
+            k->merges++;
+            k->stable_merges++;
+            continue;
+        }
+        
+        if (!k->seen[f] || k->last_checksum[f] != content) {
+            k->seen[f] = 1;
+            k->last_checksum[f] = content;
+            k->volatile_skips++;
+            continue;
+        }
+        
+        int candidate = ksm_index_get(&k->unstable, content);
+        if (candidate >= 0 && candidate != f) {
+            k->compares++;
+            k->cpu_ns += k->cfg.compare_ns + k->cfg.merge_ns;
+            ksm_merge_frames(candidate, f);
+            k->merges++;
+            
+            // Keep the stable index small: drop entries whose frame has moved on
+            if (k->stable.count * 2 >= k->stable.capacity) {
+                KsmIndex *st = &k->stable;
+                int live[SERVER_MAX_FRAMES];
+                unsigned int keys[SERVER_MAX_FRAMES];
+                int kept = 0;
+                for (int i = 0; i < st->capacity && kept < SERVER_MAX_FRAMES; i++) {
+                    if (st->frames[i] >= 0 && ksm_index_get(st, st->keys[i]) == st->frames[i]) {
+                        live[kept] = st->frames[i];
+                        keys[kept++] = st->keys[i];
+                    }
+                }
+                ksm_index_clear(st);
+                for (int i = 0; i < kept; i++) ksm_index_put(st, keys[i], live[i]);
+            }
+            ksm_index_put(&k->stable, content, candidate);
+        } else if (candidate < 0) {
+            ksm_index_put(&k->unstable, content, f);
+        }
+    }
+}
+
+typedef struct {
+    int faults;
+    int cow_faults;       // stores to merged pages
+    long merges;
+    long scanned;
+    int saved_end;
+    double saved_avg;
+    int saved_peak;
+    double cpu_ns;
+} KsmRunResults;
+
+// Processes run in 10-reference slices with the given share of stores to
+// private pages; the scanner (if k is not NULL) wakes every scan_interval references
+static void run_ksm_workload(int algo_choice, int nproc, int pages, const unsigned int *contents,
+                             int refs_per_process, int write_percent, KsmScanner *k, KsmRunResults *out) {
+    memset(out, 0, sizeof(*out));
+    unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+    
+    process_count = nproc;
+    for (int p = 0; p < nproc; p++) {
+        processes[p].pid = p + 1;
+        snprintf(processes[p].name, sizeof(processes[p].name), "svc-%d", p + 1);
+        processes[p].page_count = pages;
+        processes[p].seg_count = 0;
+        for (int i = 0; i < pages; i++) {
+            processes[p].page_table[i].page_no = i;
+            processes[p].page_table[i].modify_bit = 0;
+            processes[p].page_table[i].content = contents[p * MAX_PAGES + i];
+        }
+    }
+    reset_replacement_state();
+    
+    int last_page[MAX_PROCESSES];
+    for (int p = 0; p < nproc; p++) last_page[p] = (int)(fork_rand(&seed) % pages);
+    long samples = 0, steps = 0;
+    double saved_sum = 0;
+    
+    for (int base = 0; base < refs_per_process; base += 10) {
+        for (int p = 0; p < nproc; p++) {
+            for (int i = base; i < base + 10 && i < refs_per_process; i++) {
+                int page = last_page[p];
+                if (fork_rand(&seed) % 16 != 0) {
+                    page += (int)(fork_rand(&seed) % 3) - 1;
+                    if (page < 0) page = 0;
+                    if (page >= pages) page = pages - 1;
+                } else {
+                    page = (int)(fork_rand(&seed) % pages);
+                }
+                last_page[p] = page;
+                
+                // Common pages (code, zero fill) take a tenth of the stores private data does
+                int store_chance = contents[p * MAX_PAGES + page] & 0x80000000u ? write_percent * 10 : write_percent;
+                ReferenceResult r = (int)(fork_rand(&seed) % 1000) < store_chance ?
+                                    write_page(algo_choice, p, page, NULL, 0, 0) :
+                                    reference_page(algo_choice, p, page, NULL, 0, 0);
+                if (r.cow_copy) out->cow_faults++;
+                
+                if (k != NULL && ++steps % k->cfg.scan_interval == 0) {
+                    ksm_scan(k);
+                    int saved = frames_saved_by_sharing();
+                    saved_sum += saved;
+                    samples++;
+                    if (saved > out->saved_peak) out->saved_peak = saved;
+                }
+            }
+        }
+    }
+    
+    out->faults = page_faults;
+    out->saved_end = frames_saved_by_sharing();
+    out->saved_avg = samples > 0 ? saved_sum / samples : 0;
+    if (k != NULL) {
+        out->merges = k->merges;
+        out->scanned = k->scanned;
+        out->cpu_ns = k->cpu_ns;
+    }
+}
+
+void simulate_ksm() {
+    if (physical_memory == NULL) {
+        printf(COLOR_RED "\nMemory not initialized! Please setup memory frames first.\n" COLOR_RESET);
+        printf("Press Enter to continue...");
+        getchar();
+        return;
+    }
+    
+    term_clear();
+    display_header("SAME-PAGE MERGING (KSM)");
+    
+    printf("\n" COLOR_CYAN "Processes (2-%d): " COLOR_RESET, MAX_PROCESSES);
+    int nproc;
+    if (scanf("%d", &nproc) != 1) nproc = 4;
+    clear_input_buffer();
+    if (nproc < 2) nproc = 2;
+    if (nproc > MAX_PROCESSES) nproc = MAX_PROCESSES;
+    
+    printf(COLOR_CYAN "Pages per process (4-%d): " COLOR_RESET, MAX_PAGES);
+    int pages;
+    if (scanf("%d", &pages) != 1) pages = 40;
+    clear_input_buffer();
+    if (pages < 4) pages = 4;
+    if (pages > MAX_PAGES) pages = MAX_PAGES;
+    
+    printf(COLOR_CYAN "Frames for the run (2-%d): " COLOR_RESET, SERVER_MAX_FRAMES);
+    int frames;
+    if (scanf("%d", &frames) != 1) frames = nproc * pages / 2;
+    clear_input_buffer();
+    if (frames < 2) frames = 2;
+    if (frames > SERVER_MAX_FRAMES) frames = SERVER_MAX_FRAMES;
+    
+    printf("\n" COLOR_YELLOW "Page Contents:\n" COLOR_RESET);
+    printf(COLOR_CYAN "1." COLOR_RESET " Synthetic (shared libraries, zero pages, private data)\n");
+    printf(COLOR_CYAN "2." COLOR_RESET " Load 'pid page hash' lines from a file\n");
+    printf("\n" COLOR_YELLOW "Enter your choice (1-2): " COLOR_RESET);
+    int source;
+    if (scanf("%d", &source) != 1) source = 1;
+    clear_input_buffer();
+    
+    static unsigned int contents[MAX_PROCESSES * MAX_PAGES];
+    unsigned long long seed = 0xD1B54A32D192ED03ULL;
+    int dup_percent = 40;
+    for (int p = 0; p < MAX_PROCESSES; p++) {
+        for (int i = 0; i < MAX_PAGES; i++) {
+            // Private pages get contents no other page has
+            contents[p * MAX_PAGES + i] = 0x80000000u | (unsigned int)(p * MAX_PAGES + i + 1);
+        }
+    }
+    
+    if (source == 2) {
+        char path[256];
+        printf(COLOR_CYAN "Content file: " COLOR_RESET);
+        if (scanf("%255s", path) != 1) strcpy(path, "contents.txt");
+        clear_input_buffer();
+        FILE *in = fopen(path, "r");
+        int loaded = 0;
+        if (in != NULL) {
+            int pid, page;
+            unsigned int hash;
+            while (fscanf(in, "%d %d %x", &pid, &page, &hash) == 3) {
+                if (pid >= 1 && pid <= nproc && page >= 0 && page < pages) {
+                    contents[(pid - 1) * MAX_PAGES + page] = hash;
+                    loaded++;
+                }
+            }
+            fclose(in);
+        }
+        printf("%d page contents loaded from %s\n", loaded, path);
+    } else {
+        printf(COLOR_CYAN "Share of pages with common content (0-100%%): " COLOR_RESET);
+        if (scanf("%d", &dup_percent) != 1) dup_percent = 40;
+        clear_input_buffer();
+        if (dup_percent < 0) dup_percent = 0;
+        if (dup_percent > 100) dup_percent = 100;
+        
+        // Common pages come from a small pool (library text, zeroed memory) and
+        // tend to sit at the same addresses in every process
+        int pool = pages / 4 > 1 ? pages / 4 : 1;
+        for (int p = 0; p < nproc; p++) {
+            for (int i = 0; i < pages; i++) {
+                if ((int)(fork_rand(&seed) % 100) >= dup_percent) continue;
+                int roll = (int)(fork_rand(&seed) % 4);
+                contents[p * MAX_PAGES + i] = roll == 0 ? 0 :
+                                              roll == 1 ? 1 + (unsigned int)(fork_rand(&seed) % pool) :
+                                              1 + (unsigned int)(i % pool);
+            }
+        }
+    }
+    
+    printf(COLOR_CYAN "Share of references that are stores (0-100%%): " COLOR_RESET);
+    int write_percent;
+    if (scanf("%d", &write_percent) != 1) write_percent = 2;
+    clear_input_buffer();
+    if (write_percent < 0) write_percent = 0;
+    if (write_percent > 100) write_percent = 100;
+    
+    printf(COLOR_CYAN "References per process (100-1000000): " COLOR_RESET);
+    int refs_per_process;
+    if (scanf("%d", &refs_per_process) != 1) refs_per_process = 20000;
+    clear_input_buffer();
+    if (refs_per_process < 100) refs_per_process = 100;
+    if (refs_per_process > 1000000) refs_per_process = 1000000;
+    
+    KsmConfig cfg = {16, 100, 1000.0, 500.0, 2000.0};
+    printf(COLOR_CYAN "Pages scanned per wake-up (1-%d): " COLOR_RESET, SERVER_MAX_FRAMES);
+    if (scanf("%d", &cfg.pages_per_scan) != 1) cfg.pages_per_scan = 16;
+    clear_input_buffer();
+    if (cfg.pages_per_scan < 1) cfg.pages_per_scan = 1;
+    if (cfg.pages_per_scan > SERVER_MAX_FRAMES) cfg.pages_per_scan = SERVER_MAX_FRAMES;
+    
+    printf(COLOR_CYAN "References between wake-ups (1-100000): " COLOR_RESET);
+    if (scanf("%d", &cfg.scan_interval) != 1) cfg.scan_interval = 100;
+    clear_input_buffer();
+    if (cfg.scan_interval < 1) cfg.scan_interval = 1;
+    if (cfg.scan_interval > 100000) cfg.scan_interval = 100000;
+    
+    SimState user_state;
+    if (!sim_state_capture(&user_state)) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        return;
+    }
+    int ok = resize_frames(frames);
+    
+    printf("\n" COLOR_GREEN "================================================================\n");
+    printf("                     SAME-PAGE MERGING RESULTS\n");
+    printf("================================================================\n" COLOR_RESET);
+    printf("LRU, %d processes x %d pages in %d frames, %d%% stores, %d references each\n",
+           nproc, pages, frames, write_percent, refs_per_process);
+    printf("Scanner cost model: %.1f us checksum, %.1f us compare, %.1f us merge per page\n\n",
+           cfg.checksum_ns / 1000, cfg.compare_ns / 1000, cfg.merge_ns / 1000);
+    printf(COLOR_YELLOW "%-12s %9s %7s %9s %9s %9s %8s %8s %10s\n" COLOR_RESET, "Scan Rate", "Scanned",
+           "Merges", "Saved End", "Saved Avg", "Peak", "Faults", "COW Flts", "Scan CPU");
+    
+    static const int rate_scale[] = {0, 1, 4, 16};
+    for (int row = 0; ok && row < 4; row++) {
+        KsmScanner scanner;
+        KsmConfig run_cfg = cfg;
+        KsmRunResults res;
+        char label[24];
+        if (row == 0) {
+            strcpy(label, "Off");
+            run_ksm_workload(2, nproc, pages, contents, refs_per_process, write_percent, NULL, &res);
+        } else {
+            run_cfg.pages_per_scan = cfg.pages_per_scan * rate_scale[row] / 4;
+            if (run_cfg.pages_per_scan < 1) run_cfg.pages_per_scan = 1;
+            snprintf(label, sizeof(label), "%d/%d refs", run_cfg.pages_per_scan, run_cfg.scan_interval);
+            if (!ksm_init(&scanner, &run_cfg)) {
+                ok = 0;
+                break;
+            }
+            run_ksm_workload(2, nproc, pages, contents, refs_per_process, write_percent, &scanner, &res);
+            ksm_free(&scanner);
+        }
+        printf("%-12s %9ld %7ld %9d %9.1f %9d %8d %8d %8.2f ms\n", label, res.scanned, res.merges,
+               res.saved_end, res.saved_avg, res.saved_peak, res.faults, res.cow_faults, res.cpu_ns / 1e6);
+    }
+    if (!ok) printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+    printf("\nSaved = frames freed by merging (mappings sharing a frame beyond the first).\n");
+    printf("COW Flts = stores that had to un-merge a page.\n");
+    
+    sim_state_restore(&user_state);
+    
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+// Load Control Function Implementations
+
+// Swaps out every page processes[process_index] has resident, leaving frames
+// it shares with other processes in place. Returns the number of frames freed
+// and, through dirty_pages, how many had to be written back.
+int swap_out_process(int process_index, int *dirty_pages) {
+    int pid = processes[process_index].pid;
+    int freed = 0;
+    *dirty_pages = 0;
+    
+    for (int f = 0; f < frame_count; f++) {
+        Frame *frame = &physical_memory[f];
+        if (!frame->occupied || frame->process_id != pid || frame->share_count > 1) continue;
+        
+        ReferenceResult r = {0, -1, -1, -1, 0, 0, 0, 0, 0};
+        r.frame_no = f;
+        evict_frame(&r);
+        if (r.victim_dirty) (*dirty_pages)++;
+        
+        frame->occupied = 0;
+        frame->page_no = -1;
+        frame->process_id = -1;
+        frame->reference_bit = 0;
+        frame->modify_bit = 0;
+        frame->load_time = -1;
+        frame->prefetched = 0;
+        freed++;
+    }
+    return freed;
+}
+
+// Pages referenced within the last window references of the process
+int working_set_size(const int *last_ref, int page_count, int virtual_time, int window) {
+    int size = 0;
+    for (int i = 0; i < page_count; i++) {
+        if (last_ref[i] >= 0 && virtual_time - last_ref[i] < window) size++;
+    }
+    return size;
+}
+
+// Runs nproc processes on one CPU and one paging device. A reference takes one
+// tick; a fault blocks the process for fault_service ticks (twice that when the
+// victim is dirty), queued behind other transfers, while the CPU runs whoever
+// is ready. With cfg set, every window references the controller compares the
+// fault rate and the summed working sets with memory: when both say memory is
+// overcommitted it suspends the most recently admitted process and swaps it
+// out; when faults are rare and a suspended working set fits, it brings the
+// longest-waiting one back with its working set prepaged. cfg NULL disables
+// load control.
+void run_load_control(int nproc, int pages, int locality, int refs_per_process, int fault_service,
+                      const LoadControlConfig *cfg, LoadControlStats *out) {
+    static int last_ref[MAX_PROCESSES][MAX_PAGES];
+    int remaining[MAX_PROCESSES], suspended[MAX_PROCESSES], virtual_time[MAX_PROCESSES];
+    int base[MAX_PROCESSES], saved_ws[MAX_PROCESSES];
+    long blocked_until[MAX_PROCESSES], suspended_at[MAX_PROCESSES], admitted_at[MAX_PROCESSES];
+    unsigned long long seed = 0xA0761D6478BD642FULL;
+    int phase = 2000; // references between locality shifts
+    
+    memset(out, 0, sizeof(*out));
+    process_count = nproc;
+    for (int p = 0; p < nproc; p++) {
+        processes[p].pid = p + 1;
+        snprintf(processes[p].name, sizeof(processes[p].name), "job-%d", p + 1);
+        processes[p].page_count = pages;
+        processes[p].seg_count = 0;
+        for (int i = 0; i < pages; i++) {
+            processes[p].page_table[i].page_no = i;
+            last_ref[p][i] = -1;
+        }
+        remaining[p] = refs_per_process;
+        suspended[p] = 0;
+        virtual_time[p] = 0;
+        base[p] = (int)(fork_rand(&seed) % pages);
+        saved_ws[p] = 0;
+        blocked_until[p] = 0;
+        suspended_at[p] = 0;
+        admitted_at[p] = 0;
+    }
+    reset_replacement_state();
+    
+    long now = 0, device_free = 0, window_refs = 0, window_faults = 0, active_ticks = 0;
+    int current = 0, done = 0;
+    
+    while (done < nproc) {
+        int p = -1, active = 0;
+        for (int k = 0; k < nproc; k++) {
+            int q = (current + k) % nproc;
+            if (remaining[q] == 0 || suspended[q]) continue;
+            active++;
+            if (p < 0 && blocked_until[q] <= now) p = q;
+        }
+        
+        if (p < 0) {
+            long wake = -1;
+            for (int q = 0; q < nproc; q++) {
+                if (remaining[q] > 0 && !suspended[q] && (wake < 0 || blocked_until[q] < wake)) wake = blocked_until[q];
+            }
+            if (wake < 0) {
+                // Everyone left is suspended: readmit the longest waiting
+                int oldest = -1;
+                for (int q = 0; q < nproc; q++) {
+                    if (remaining[q] > 0 && (oldest < 0 || suspended_at[q] < suspended_at[oldest])) oldest = q;
+                }
+                suspended[oldest] = 0;
+                admitted_at[oldest] = now;
+                out->resumptions++;
+                continue;
+            }
+            active_ticks += (wake - now) * active;
+            now = wake;
+            continue;
+        }
+        
+        // Run p for a quantum of 10 references or until it faults
+        for (int q = 0; q < 10 && remaining[p] > 0; q++) {
+            if (virtual_time[p] % phase == 0) base[p] = (int)(fork_rand(&seed) % pages);
+            int page = fork_rand(&seed) % 50 != 0 ? (base[p] + (int)(fork_rand(&seed) % locality)) % pages :
+                                                    (int)(fork_rand(&seed) % pages);
+            ReferenceResult r = reference_page(2, p, page, NULL, 0, 0);
+            last_ref[p][page] = virtual_time[p]++;
+            remaining[p]--;
+            now++;
+            active_ticks += active;
+            out->cpu_busy++;
+            out->useful_refs++;
+            window_refs++;
+            
+            if (!r.hit) {
+                out->faults++;
+                window_faults++;
+                long start = device_free > now ? device_free : now;
+                device_free = start + fault_service * (r.victim_dirty ? 2 : 1);
+                blocked_until[p] = device_free;
+                break;
+            }
+        }
+        if (remaining[p] == 0) done++;
+        current = (p + 1) % nproc;
+        
+        if (cfg == NULL || window_refs < cfg->window) continue;
+        
+        double fault_rate = (double)window_faults / window_refs;
+        window_refs = 0;
+        window_faults = 0;
+        int demand = 0, newest = -1, waiting = -1;
+        for (int q = 0; q < nproc; q++) {
+            if (remaining[q] == 0) continue;
+            if (suspended[q]) {
+                if (waiting < 0 || suspended_at[q] < suspended_at[waiting]) waiting = q;
+                continue;
+            }
+            demand += working_set_size(last_ref[q], pages, virtual_time[q], cfg->ws_window);
+            if (newest < 0 || admitted_at[q] >= admitted_at[newest]) newest = q;
+        }
+        
+        if (fault_rate > cfg->high_fault_rate && demand > frame_count && active > 1 && newest >= 0) {
+            int dirty;
+            saved_ws[newest] = working_set_size(last_ref[newest], pages, virtual_time[newest], cfg->ws_window);
+            swap_out_process(newest, &dirty);
+            suspended[newest] = 1;
+            suspended_at[newest] = now;
+            out->suspensions++;
+            // Dirty pages go out as one transfer behind whatever is queued
+            if (dirty > 0) device_free = (device_free > now ? device_free : now) + fault_service + dirty;
+        } else if (fault_rate < cfg->low_fault_rate && waiting >= 0 && demand + saved_ws[waiting] <= frame_count) {
+            suspended[waiting] = 0;
+            admitted_at[waiting] = now;
+            out->resumptions++;
+            
+            // Swap the working set back in as one sequential read
+            int loaded = 0;
+            for (int i = 0; i < pages; i++) {
+                if (last_ref[waiting][i] >= 0 && virtual_time[waiting] - last_ref[waiting][i] < cfg->ws_window &&
+                    prefetch_page(2, waiting, i, NULL, 0, 0).frame_no >= 0) {
+                    loaded++;
+                }
+            }
+            if (loaded > 0) {
+                device_free = (device_free > now ? device_free : now) + fault_service + loaded;
+                blocked_until[waiting] = device_free;
+            }
+        }
+    }
+    
+    out->ticks = now > device_free ? now : device_free;
+    out->avg_active = out->ticks > 0 ? (double)active_ticks / out->ticks : 0;
+}
+
+void simulate_load_control() {
+    if (physical_memory == NULL) {
+        printf(COLOR_RED "\nMemory not initialized! Please setup memory frames first.\n" COLOR_RESET);
+        printf("Press Enter to continue...");
+        getchar();
+        return;
+    }
+    
+    term_clear();
+    display_header("THRASHING & LOAD CONTROL");
+    
+    printf("\n" COLOR_CYAN "Processes (2-%d): " COLOR_RESET, MAX_PROCESSES);
+    int nproc;
+    if (scanf("%d", &nproc) != 1) nproc = MAX_PROCESSES;
+    clear_input_buffer();
+    if (nproc < 2) nproc = 2;
+    if (nproc > MAX_PROCESSES) nproc = MAX_PROCESSES;
+    
+    printf(COLOR_CYAN "Pages per process (4-%d): " COLOR_RESET, MAX_PAGES);
+    int pages;
+    if (scanf("%d", &pages) != 1) pages = 40;
+    clear_input_buffer();
+    if (pages < 4) pages = 4;
+    if (pages > MAX_PAGES) pages = MAX_PAGES;
+    
+    printf(COLOR_CYAN "Locality size in pages (1-%d): " COLOR_RESET, pages);
+    int locality;
+    if (scanf("%d", &locality) != 1) locality = 10;
+    clear_input_buffer();
+    if (locality < 1) locality = 1;
+    if (locality > pages) locality = pages;
+    
+    printf(COLOR_CYAN "Frames (2-%d): " COLOR_RESET, nproc * pages);
+    int frames;
+    if (scanf("%d", &frames) != 1) frames = 3 * locality;
+    clear_input_buffer();
+    if (frames < 2) frames = 2;
+    if (frames > nproc * pages) frames = nproc * pages;
+    
+    printf(COLOR_CYAN "References per process (1000-1000000): " COLOR_RESET);
+    int refs_per_process;
+    if (scanf("%d", &refs_per_process) != 1) refs_per_process = 20000;
+    clear_input_buffer();
+    if (refs_per_process < 1000) refs_per_process = 1000;
+    if (refs_per_process > 1000000) refs_per_process = 1000000;
+    
+    printf(COLOR_CYAN "Fault service time in references (1-10000): " COLOR_RESET);
+    int fault_service;
+    if (scanf("%d", &fault_service) != 1) fault_service = 20;
+    clear_input_buffer();
+    if (fault_service < 1) fault_service = 1;
+    if (fault_service > 10000) fault_service = 10000;
+    
+    LoadControlConfig cfg = {500, 500, 0.05, 0.02};
+    
+    SimState user_state;
+    if (!sim_state_capture(&user_state)) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        return;
+    }
+    
+    if (!resize_frames(frames)) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+    } else {
+        printf("\n" COLOR_GREEN "================================================================\n");
+        printf("                     LOAD CONTROL RESULTS\n");
+        printf("================================================================\n" COLOR_RESET);
+        printf("LRU, %d frames, %d pages per process, locality %d, fault service %d\n",
+               frames, pages, locality, fault_service);
+        printf("Controller: every %d refs, working-set window %d, suspend above %.0f%% faults, resume below %.0f%%\n\n",
+               cfg.window, cfg.ws_window, cfg.high_fault_rate * 100, cfg.low_fault_rate * 100);
+        printf(COLOR_YELLOW "%-4s | %-28s | %-40s\n" COLOR_RESET, "", "No Load Control", "With Load Control");
+        printf(COLOR_YELLOW "%-4s | %10s %6s %9s | %10s %6s %9s %6s %6s\n" COLOR_RESET, "MPL",
+               "Refs/ktick", "CPU", "Faults", "Refs/ktick", "CPU", "Faults", "Susp", "Active");
+        
+        int best_plain = 1, best_controlled = 1;
+        double best_plain_rate = 0, best_controlled_rate = 0;
+        for (int mpl = 1; mpl <= nproc; mpl++) {
+            LoadControlStats plain, controlled;
+            run_load_control(mpl, pages, locality, refs_per_process, fault_service, NULL, &plain);
+            run_load_control(mpl, pages, locality, refs_per_process, fault_service, &cfg, &controlled);
+            
+            double plain_rate = 1000.0 * plain.useful_refs / plain.ticks;
+            double controlled_rate = 1000.0 * controlled.useful_refs / controlled.ticks;
+            if (plain_rate > best_plain_rate) {
+                best_plain_rate = plain_rate;
+                best_plain = mpl;
+            }
+            if (controlled_rate > best_controlled_rate) {
+                best_controlled_rate = controlled_rate;
+                best_controlled = mpl;
+            }
+            printf("%-4d | %10.1f %5.1f%% %9ld | %10.1f %5.1f%% %9ld %6d %6.2f\n", mpl,
+                   plain_rate, 100.0 * plain.cpu_busy / plain.ticks, plain.faults,
+                   controlled_rate, 100.0 * controlled.cpu_busy / controlled.ticks, controlled.faults,
+                   controlled.suspensions, controlled.avg_active);
+        }
+        
+        printf("\nBest multiprogramming level: %d without load control (%.1f refs/ktick), "
+               "%d with it (%.1f refs/ktick)\n", best_plain, best_plain_rate, best_controlled, best_controlled_rate);
+        printf("Refs/ktick = references completed per 1000 ticks; Active = processes admitted on average.\n");
+    }
+    
+    sim_state_restore(&user_state);
+    
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+// Latency Histogram Function Implementations
+
+// Bucket of a latency: values below 2^LATENCY_SUB_BITS are exact, above that
+// each power of two is split into 2^LATENCY_SUB_BITS equal buckets
+static int latency_bucket(unsigned long long ns) {
+    if (ns < (1ULL << LATENCY_SUB_BITS)) return (int)ns;
+    if (ns >= (1ULL << LATENCY_MAX_BITS)) return LATENCY_BUCKETS - 1;
+#if defined(__GNUC__)
+    int msb = 63 - __builtin_clzll(ns);
+#else
+    int msb = LATENCY_SUB_BITS;
+    while ((ns >> (msb + 1)) != 0) msb++;
+#endif
+    int shift = msb - LATENCY_SUB_BITS;
+    return ((shift + 1) << LATENCY_SUB_BITS) + (int)((ns >> shift) - (1ULL << LATENCY_SUB_BITS));
+}
+
+// Largest latency that falls in bucket
+static unsigned long long latency_bucket_top(int bucket) {
+    if (bucket < (1 << LATENCY_SUB_BITS)) return (unsigned long long)bucket;
+    int shift = (bucket >> LATENCY_SUB_BITS) - 1;
+    unsigned long long first = ((unsigned long long)(bucket & ((1 << LATENCY_SUB_BITS) - 1)) +
+                                (1ULL << LATENCY_SUB_BITS)) << shift;
+    return first + (1ULL << shift) - 1;
+}
+
+void latency_record(LatencyHistogram *h, unsigned long long ns) {
+    h->counts[latency_bucket(ns)]++;
+    if (h->total == 0 || ns < h->min) h->min = ns;
+    if (ns > h->max) h->max = ns;
+    h->total++;
+    h->sum += (double)ns;
+}
+
+// Adds src into dst; histograms from separate runs or threads combine exactly
+void latency_merge(LatencyHistogram *dst, const LatencyHistogram *src) {
+    if (src->total == 0) return;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) dst->counts[i] += src->counts[i];
+    if (dst->total == 0 || src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+    dst->total += src->total;
+    dst->sum += src->sum;
+}
+
+// Smallest bucket value that at least percentile% of the samples do not
+// exceed, capped at the largest sample; 0 for an empty histogram
+unsigned long long latency_percentile(const LatencyHistogram *h, double percentile) {
+    if (h->total == 0) return 0;
+    long long rank = (long long)(percentile / 100.0 * h->total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > h->total) rank = h->total;
+    
+    long long seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            unsigned long long top = latency_bucket_top(i);
+            return top < h->max ? top : h->max;
+        }
+    }
+    return h->max;
+}
+
+double latency_mean(const LatencyHistogram *h) {
+    return h->total > 0 ? h->sum / h->total : 0;
+}
+
+// Cost of one access with the given outcome: each outcome pays for the steps
+// of the ones before it
+unsigned long long access_latency(const AccessCostModel *costs, AccessKind kind) {
+    double ns = costs->tlb_ns;
+    if (kind >= ACCESS_WALK) ns += costs->walk_ns;
+    if (kind >= ACCESS_FAULT) ns += costs->fault_ns;
+    if (kind >= ACCESS_WRITEBACK) ns += costs->writeback_ns;
+    return (unsigned long long)(ns + 0.5);
+}
+
+// Writes ns as ns, us or ms, whichever keeps it short
+static void format_latency(double ns, char *buf, size_t size) {
+    if (ns < 10000) snprintf(buf, size, "%.0fns", ns);
+    else if (ns < 10000000) snprintf(buf, size, "%.1fus", ns / 1000);
+    else snprintf(buf, size, "%.1fms", ns / 1000000);
+}
+
+void display_latency_header(const char *first_column) {
+    printf(COLOR_YELLOW "%-16s %10s %9s %9s %9s %9s %9s %9s\n" COLOR_RESET, first_column, "Count",
+           "Mean", "p50", "p90", "p99", "p99.9", "Max");
+}
+
+void display_latency_row(const char *label, const LatencyHistogram *h) {
+    static const double percentiles[] = {50, 90, 99, 99.9};
+    char cell[16];
+    printf("%-16s %10lld", label, h->total);
+    if (h->total == 0) {
+        printf(" %9s %9s %9s %9s %9s %9s\n", "-", "-", "-", "-", "-", "-");
+        return;
+    }
+    format_latency(latency_mean(h), cell, sizeof(cell));
+    printf(" %9s", cell);
+    for (int i = 0; i < 4; i++) {
+        format_latency((double)latency_percentile(h, percentiles[i]), cell, sizeof(cell));
+        printf(" %9s", cell);
+    }
+    format_latency((double)h->max, cell, sizeof(cell));
+    printf(" %9s\n", cell);
+}
+
+// One row per access outcome and a merged row for all accesses
+void display_access_latencies(const LatencyHistogram latency[ACCESS_KINDS]) {
+    static const char *kind_names[] = {"TLB hit", "Page walk", "Page fault", "Fault+writeback"};
+    static LatencyHistogram all;
+    memset(&all, 0, sizeof(all));
+    
+    display_latency_header("Access");
+    for (int k = 0; k < ACCESS_KINDS; k++) {
+        display_latency_row(kind_names[k], &latency[k]);
+        latency_merge(&all, &latency[k]);
+    }
+    display_latency_row("All accesses", &all);
+}
+
+// Host Calibration Function Implementations
+
+void *volatile calibration_sink; // keeps the chase loops from being optimised away
+
+// Links count elements, stride bytes apart in buffer, into one random cycle of
+// pointers and returns its first element
+static void **build_chase(char *buffer, size_t count, size_t stride, unsigned long long *seed) {
+    size_t *order = (size_t*)malloc(count * sizeof(size_t));
+    if (order == NULL) return NULL;
+    for (size_t i = 0; i < count; i++) order[i] = i;
+    for (size_t i = count - 1; i > 0; i--) {
+        size_t j = (((size_t)fork_rand(seed) << 16) ^ fork_rand(seed)) % (i + 1);
+        size_t t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    for (size_t i = 0; i < count; i++) {
+        *(void**)(buffer + order[i] * stride) = buffer + order[(i + 1) % count] * stride;
+    }
+    void **start = (void**)(buffer + order[0] * stride);
+    free(order);
+    return start;
+}
+
+// Average ns per load while chasing the cycle from start; each load depends on
+// the previous one, so this is latency, not bandwidth
+static double chase_ns(void **start, size_t warmup, long loads) {
+    void **p = start;
+    for (size_t i = 0; i < warmup; i++) p = (void**)*p;
+    double t0 = get_time_seconds();
+    for (long i = 0; i < loads; i++) p = (void**)*p;
+    double elapsed = get_time_seconds() - t0;
+    calibration_sink = p;
+    return elapsed * 1e9 / loads;
+}
+
+// Buffer for the probes, aligned for huge pages; when huge asks for them the
+// kernel is advised to back it with transparent huge pages
+static char *calibration_alloc(size_t bytes, int huge, int *got_huge) {
+    *got_huge = 0;
+#ifndef _WIN32
+    void *p = NULL;
+    if (posix_memalign(&p, 2u << 20, bytes) != 0) return NULL;
+#if defined(MADV_HUGEPAGE) && defined(MADV_NOHUGEPAGE)
+    *got_huge = huge && madvise(p, bytes, MADV_HUGEPAGE) == 0;
+    if (!huge) madvise(p, bytes, MADV_NOHUGEPAGE);
+#endif
+    memset(p, 0, bytes);
+    return (char*)p;
+#else
+    (void)huge;
+    return (char*)calloc(bytes, 1);
+#endif
+}
+
+// Counts data TLB read misses in user space; -1 when perf events are
+// unavailable (other platforms, containers, perf_event_paranoid)
+static int dtlb_counter_open() {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+// Like chase_ns, and also the dTLB misses per load when fd is an open counter
+static double chase_counted_ns(void **start, size_t warmup, long loads, int fd, double *misses_per_load) {
+    *misses_per_load = -1;
+#ifdef __linux__
+    if (fd >= 0) {
+        void **p = start;
+        for (size_t i = 0; i < warmup; i++) p = (void**)*p;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        double ns = chase_ns(p, 0, loads);
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        unsigned long long misses;
+        if (read(fd, &misses, sizeof(misses)) == (ssize_t)sizeof(misses)) {
+            *misses_per_load = (double)misses / loads;
+        }
+        return ns;
+    }
+#else
+    (void)fd;
+#endif
+    return chase_ns(start, warmup, loads);
+}
+
+static double median_ns(const double *ns, int from, int to) {
+    double sorted[CALIBRATION_POINTS];
+    int n = 0;
+    for (int i = from; i <= to; i++) {
+        int k = n++;
+        while (k > 0 && sorted[k - 1] > ns[i]) {
+            sorted[k] = sorted[k - 1];
+            k--;
+        }
+        sorted[k] = ns[i];
+    }
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+// Splits the latency curve into plateaus wherever latency jumps by a third
+// from one working set to the next (adjacent jumps are one step), after a
+// running median of three has removed single-point timing noise. The
+// first plateau is L1 and the last DRAM; of those in between, the first is
+// L2 and the last the LLC. Each level gets its plateau's median latency.
+static void estimate_cache_levels(const size_t *bytes, const double *ns, int n, HostProfile *p) {
+    double smooth[CALIBRATION_POINTS];
+    for (int i = 0; i < n; i++) {
+        smooth[i] = i == 0 || i == n - 1 ? ns[i] : median_ns(ns, i - 1, i + 1);
+    }
+    
+    int start[CALIBRATION_POINTS], end[CALIBRATION_POINTS], plateaus = 0;
+    start[0] = 0;
+    for (int i = 1; i < n; i++) {
+        if (smooth[i] <= 1.33 * smooth[i - 1]) continue;
+        // A single point between two jumps is part of the step, not a level
+        if (plateaus == 0 || i - 1 > start[plateaus]) end[plateaus++] = i - 1;
+        start[plateaus] = i;
+    }
+    end[plateaus++] = n - 1;
+    
+    int l2 = plateaus > 2 ? 1 : plateaus - 1;
+    int llc = plateaus > 2 ? plateaus - 2 : l2;
+    p->l1_ns = median_ns(ns, start[0], end[0]);
+    p->l2_ns = median_ns(ns, start[l2], end[l2]);
+    p->llc_ns = median_ns(ns, start[llc], end[llc]);
+    p->dram_ns = median_ns(ns, start[plateaus - 1], end[plateaus - 1]);
+    p->l1_kb = (long)(bytes[end[0]] >> 10);
+    p->l2_kb = (long)(bytes[end[l2]] >> 10);
+    p->llc_kb = (long)(bytes[end[llc]] >> 10);
+}
+
+// Measures the host. A pointer chase over working sets from 4 KB upwards,
+// once on base pages and once on huge pages, gives the latency curve the
+// cache levels and DRAM are read from (huge pages keep TLB misses out of it).
+// The TLB-miss penalty is the difference between chasing one line per page
+// across more pages than the TLB maps and chasing the same number of lines
+// packed together; perf counters, when available, say how many of those loads
+// really missed. Returns 0 if the buffers cannot be allocated.
+int calibrate_host(HostProfile *profile, int verbose) {
+    memset(profile, 0, sizeof(*profile));
+    unsigned long long seed = 0x2545F4914F6CDD1DULL;
+#ifndef _WIN32
+    long page_bytes = sysconf(_SC_PAGESIZE);
+#else
+    long page_bytes = 4096;
+#endif
+    if (page_bytes < CALIBRATION_LINE) page_bytes = 4096;
+    profile->page_kb = (int)(page_bytes / 1024);
+    size_t max_bytes = (size_t)CALIBRATION_MAX_MB << 20;
+    
+    int huge = 0, no_huge;
+    char *huge_buf = calibration_alloc(max_bytes, 1, &huge);
+    char *base_buf = calibration_alloc(max_bytes, 0, &no_huge);
+    if (huge_buf == NULL || base_buf == NULL) {
+        free(huge_buf);
+        free(base_buf);
+        return 0;
+    }
+    profile->huge_pages = huge;
+    
+    if (verbose) {
+        printf(COLOR_YELLOW "%12s %14s %14s\n" COLOR_RESET, "Working Set", "Base pages", huge ? "Huge pages" : "(no THP)");
+    }
+    size_t sizes[CALIBRATION_POINTS];
+    double curve[CALIBRATION_POINTS];
+    int points = 0;
+    // Working sets grow by half octaves: 4, 6, 8, 12, 16 KB ...
+    for (size_t bytes = 4096; bytes <= max_bytes && points < CALIBRATION_POINTS;
+         bytes = points % 2 ? bytes / 2 * 3 : bytes / 3 * 4) {
+        size_t count = bytes / CALIBRATION_LINE;
+        size_t warmup = count < CALIBRATION_LOADS ? count : CALIBRATION_LOADS;
+        void **start = build_chase(base_buf, count, CALIBRATION_LINE, &seed);
+        if (start == NULL) break;
+        double base_ns = chase_ns(start, warmup, CALIBRATION_LOADS);
+        double huge_ns = base_ns;
+        if (huge) {
+            start = build_chase(huge_buf, count, CALIBRATION_LINE, &seed);
+            if (start == NULL) break;
+            huge_ns = chase_ns(start, warmup, CALIBRATION_LOADS);
+        }
+        
+        sizes[points] = bytes;
+        curve[points++] = huge_ns;
+        if (verbose) {
+            if (bytes % ((size_t)1 << 20) != 0) printf("%9lu KB", (unsigned long)(bytes >> 10));
+            else printf("%9lu MB", (unsigned long)(bytes >> 20));
+            printf(" %11.2f ns", base_ns);
+            if (huge) printf(" %11.2f ns", huge_ns);
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+    if (points == 0) {
+        free(huge_buf);
+        free(base_buf);
+        return 0;
+    }
+    estimate_cache_levels(sizes, curve, points, profile);
+    
+    // TLB probe: one line per base page over 8192 pages (more than second-level
+    // TLBs map), against the same lines packed into consecutive memory. Line
+    // offsets rotate within the page so both spread over the same cache sets.
+    size_t pages = max_bytes / page_bytes < 8192 ? max_bytes / page_bytes : 8192;
+    size_t line_slots = page_bytes / CALIBRATION_LINE;
+    size_t *order = (size_t*)malloc(pages * sizeof(size_t));
+    double tlb_ns = 0, packed_ns = 0, tlb_rate = -1, packed_rate = -1;
+    if (order != NULL) {
+        for (size_t i = 0; i < pages; i++) order[i] = i;
+        for (size_t i = pages - 1; i > 0; i--) {
+            size_t j = fork_rand(&seed) % (i + 1);
+            size_t t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+        }
+        for (size_t i = 0; i < pages; i++) {
+            size_t from = order[i], to = order[(i + 1) % pages];
+            *(void**)(base_buf + from * page_bytes + (from % line_slots) * CALIBRATION_LINE) =
+                base_buf + to * page_bytes + (to % line_slots) * CALIBRATION_LINE;
+        }
+        int fd = dtlb_counter_open();
+        void **start = (void**)(base_buf + order[0] * page_bytes + (order[0] % line_slots) * CALIBRATION_LINE);
+        tlb_ns = chase_counted_ns(start, pages, CALIBRATION_LOADS, fd, &tlb_rate);
+        free(order);
+        
+        start = build_chase(huge_buf, pages, CALIBRATION_LINE, &seed);
+        if (start != NULL) packed_ns = chase_counted_ns(start, pages, CALIBRATION_LOADS, fd, &packed_rate);
+#ifndef _WIN32
+        if (fd >= 0) close(fd);
+#endif
+    }
+    
+    double extra = tlb_ns - packed_ns;
+    if (extra < 0) extra = 0;
+    if (tlb_rate >= 0 && packed_rate >= 0 && tlb_rate - packed_rate > 0.05) {
+        profile->tlb_miss_rate = tlb_rate - packed_rate;
+        profile->tlb_miss_ns = extra / profile->tlb_miss_rate;
+    } else {
+        profile->tlb_miss_ns = extra; // every probe load assumed to miss
+    }
+    if (verbose) {
+        printf("\nTLB probe over %lu pages: %.2f ns per load, packed lines %.2f ns", (unsigned long)pages,
+               tlb_ns, packed_ns);
+        if (tlb_rate >= 0) printf(", %.2f vs %.2f dTLB misses per load (perf)", tlb_rate, packed_rate);
+        else printf(" (perf counters unavailable)");
+        printf("\n");
+    }
+    
+    free(huge_buf);
+    free(base_buf);
+    profile->valid = 1;
+    return 1;
+}
+
+int save_host_profile(const char *path, const HostProfile *p) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) return 0;
+    fprintf(f, "# host latency profile written by the memory visualizer calibration\n");
+    fprintf(f, "l1_kb %ld\nl2_kb %ld\nllc_kb %ld\n", p->l1_kb, p->l2_kb, p->llc_kb);
+    fprintf(f, "l1_ns %.3f\nl2_ns %.3f\nllc_ns %.3f\ndram_ns %.3f\n", p->l1_ns, p->l2_ns, p->llc_ns, p->dram_ns);
+    fprintf(f, "tlb_miss_ns %.3f\ntlb_miss_rate %.3f\n", p->tlb_miss_ns, p->tlb_miss_rate);
+    fprintf(f, "page_kb %d\nhuge_pages %d\n", p->page_kb, p->huge_pages);
+    int ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+// Reads "key value" lines; unknown keys and '#' comments are ignored. Returns
+// 0 (profile left invalid) if the file is missing or has no latencies.
+int load_host_profile(const char *path, HostProfile *p) {
+    memset(p, 0, sizeof(*p));
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return 0;
+    
+    char key[32];
+    double value;
+    char line[128];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || sscanf(line, "%31s %lf", key, &value) != 2) continue;
+        if (strcmp(key, "l1_kb") == 0) p->l1_kb = (long)value;
+        else if (strcmp(key, "l2_kb") == 0) p->l2_kb = (long)value;
+        else if (strcmp(key, "llc_kb") == 0) p->llc_kb = (long)value;
+        else if (strcmp(key, "l1_ns") == 0) p->l1_ns = value;
+        else if (strcmp(key, "l2_ns") == 0) p->l2_ns = value;
+        else if (strcmp(key, "llc_ns") == 0) p->llc_ns = value;
+        else if (strcmp(key, "dram_ns") == 0) p->dram_ns = value;
+        else if (strcmp(key, "tlb_miss_ns") == 0) p->tlb_miss_ns = value;
+        else if (strcmp(key, "tlb_miss_rate") == 0) p->tlb_miss_rate = value;
+        else if (strcmp(key, "page_kb") == 0) p->page_kb = (int)value;
+        else if (strcmp(key, "huge_pages") == 0) p->huge_pages = (int)value;
+    }
+    fclose(f);
+    p->valid = p->l1_ns > 0 && p->dram_ns > 0;
+    return p->valid;
+}
+
+// Prices trace replay with the host's numbers: a TLB hit is an L1 load, a
+// page walk adds the measured TLB-miss penalty
+void apply_host_profile(const HostProfile *p) {
+    if (!p->valid) return;
+    trace_access_costs.tlb_ns = p->l1_ns;
+    trace_access_costs.walk_ns = p->tlb_miss_ns;
+}
+
+void display_host_profile(const HostProfile *p) {
+    printf("L1 data  (%6ld KB): %8.2f ns\n", p->l1_kb, p->l1_ns);
+    printf("L2       (%6ld KB): %8.2f ns\n", p->l2_kb, p->l2_ns);
+    printf("LLC      (%6ld KB): %8.2f ns\n", p->llc_kb, p->llc_ns);
+    printf("DRAM                : %8.2f ns\n", p->dram_ns);
+    printf("TLB miss penalty    : %8.2f ns", p->tlb_miss_ns);
+    if (p->tlb_miss_rate > 0) printf(" (perf: %.2f misses per probe load)", p->tlb_miss_rate);
+    printf("\nPages               : %d KB base%s\n", p->page_kb, p->huge_pages ? ", caches probed on huge pages" : "");
+}
+
+void simulate_host_calibration() {
+    term_clear();
+    display_header("HOST CALIBRATION");
+    
+    if (host_profile.valid) {
+        printf("\n" COLOR_CYAN "Current profile (%s):" COLOR_RESET "\n", HOST_PROFILE_PATH);
+        display_host_profile(&host_profile);
+    } else {
+        printf("\nNo host profile loaded; the simulators use typed-in or default latencies.\n");
+    }
+    
+    printf("\n" COLOR_CYAN "Measuring (pointer chase, a few seconds)...\n\n" COLOR_RESET);
+    fflush(stdout);
+    HostProfile measured;
+    if (!calibrate_host(&measured, 1)) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        printf("\nPress Enter to continue...");
+        getchar();
+        return;
+    }
+    
+    printf("\n" COLOR_GREEN "================================================================\n");
+    printf("                     HOST LATENCY PROFILE\n");
+    printf("================================================================\n" COLOR_RESET);
+    display_host_profile(&measured);
+    
+    char path[256];
+    printf("\n" COLOR_CYAN "Save profile to (- to discard, default %s): " COLOR_RESET, HOST_PROFILE_PATH);
+    read_word(path, sizeof(path), HOST_PROFILE_PATH);
+    if (strcmp(path, "-") != 0) {
+        if (save_host_profile(path, &measured)) {
+            host_profile = measured;
+            apply_host_profile(&host_profile);
+            printf(COLOR_GREEN "Saved to %s; the TLB simulation and trace replay now use it.\n" COLOR_RESET, path);
+        } else {
+            printf(COLOR_RED "Cannot write '%s'\n" COLOR_RESET, path);
+        }
+    }
+    
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+// see --calibrate [profile]: measures the host and writes the profile
+int run_calibration_cli(int argc, char *argv[]) {
+    const char *path = argc > 2 ? argv[2] : HOST_PROFILE_PATH;
+    HostProfile measured;
+    if (!calibrate_host(&measured, 1)) {
+        fprintf(stderr, "cannot allocate calibration buffers\n");
+        return 1;
+    }
+    printf("\n");
+    display_host_profile(&measured);
+    if (!save_host_profile(path, &measured)) {
+        fprintf(stderr, "cannot write '%s'\n", path);
+        return 1;
+    }
+    printf("Profile written to %s\n", path);
+    return 0;
+}
+
+// Terminal Rendering Function Implementations
+
+static const char *term_color_codes[] = {
+    COLOR_RESET, COLOR_RED, COLOR_GREEN, COLOR_YELLOW, COLOR_BLUE, COLOR_MAGENTA, COLOR_CYAN
+};
+
+// Clears the screen and homes the cursor with escape sequences instead of a
+// shell; the next frame is drawn in full
+void term_clear() {
+#ifdef _WIN32
+    system("cls");
+#else
+    fputs("\x1b[H\x1b[2J", stdout);
+    fflush(stdout);
+#endif
+    term_screen.synced = 0;
+}
+
+void term_sleep_ms(int ms) {
+    if (ms <= 0) return;
+    fflush(stdout);
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    struct timespec delay = {ms / 1000, (long)(ms % 1000) * 1000000L};
+    while (nanosleep(&delay, &delay) == -1 && errno == EINTR);
+#endif
+}
+
+// Starts a frame: picks up the terminal size and blanks the grid
+void term_begin_frame() {
+    int rows = 50, cols = 100;
+#ifndef _WIN32
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+        rows = ws.ws_row;
+        cols = ws.ws_col;
+    }
+#endif
+    if (rows > TERM_MAX_ROWS) rows = TERM_MAX_ROWS;
+    if (cols > TERM_MAX_COLS) cols = TERM_MAX_COLS;
+    if (rows != term_screen.rows || cols != term_screen.cols) term_screen.synced = 0;
+    term_screen.rows = rows;
+    term_screen.cols = cols;
+    term_screen.used_rows = 0;
+    
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            term_screen.next[r][c].ch = ' ';
+            term_screen.next[r][c].color = TERM_DEFAULT;
+        }
+    }
+}
+
+// Writes formatted text into the frame at (row, col), clipped to the screen
+void term_print(int row, int col, TermColor color, const char *format, ...) {
+    if (row < 0 || row >= term_screen.rows) return;
+    char text[TERM_MAX_COLS + 1];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    
+    for (int i = 0; text[i] != '\0' && col + i < term_screen.cols; i++) {
+        if (col + i < 0 || text[i] == '\n') continue;
+        term_screen.next[row][col + i].ch = text[i];
+        term_screen.next[row][col + i].color = (unsigned char)color;
+    }
+    if (row + 1 > term_screen.used_rows) term_screen.used_rows = row + 1;
+}
+
+// Sends the frame to the terminal: only cells that differ from what is shown
+// are rewritten, each run of them after one cursor move (short unchanged gaps
+// are written through), with a colour code only where the colour changes. A
+// frame after term_clear() or a resize is drawn in full.
+void term_present() {
+    TermScreen *t = &term_screen;
+    if (!t->synced) {
+        fputs("\x1b[H\x1b[2J", stdout);
+        for (int r = 0; r < t->rows; r++) {
+            for (int c = 0; c < t->cols; c++) {
+                t->shown[r][c].ch = ' ';
+                t->shown[r][c].color = TERM_DEFAULT;
+            }
+        }
+        t->synced = 1;
+    }
+    
+    int color = -1;
+    for (int r = 0; r < t->rows; r++) {
+        int cursor = -1; // column the terminal cursor is at on this row, -1 = elsewhere
+        for (int c = 0; c < t->cols; c++) {
+            TermCell *want = &t->next[r][c], *have = &t->shown[r][c];
+            if (want->ch == have->ch && (want->color == have->color || want->ch == ' ')) continue;
+            
+            // A short gap of unchanged cells is cheaper to rewrite than to jump over
+            if (cursor >= 0 && c - cursor <= 4) {
+                for (; cursor < c; cursor++) {
+                    const TermCell *same = &t->shown[r][cursor];
+                    if (same->ch != ' ' && same->color != color) {
+                        fputs(term_color_codes[same->color], stdout);
+                        color = same->color;
+                    }
+                    putchar(same->ch);
+                }
+            }
+            if (cursor != c) printf("\x1b[%d;%dH", r + 1, c + 1);
+            if (want->color != color) {
+                fputs(term_color_codes[want->color], stdout);
+                color = want->color;
+            }
+            putchar(want->ch);
+            *have = *want;
+            cursor = c + 1;
+            t->cells_drawn++;
+        }
+    }
+    
+    // Park the cursor under the frame so a following prompt lands there
+    printf(COLOR_RESET "\x1b[%d;1H", t->used_rows + 1);
+    fflush(stdout);
+    t->frames++;
+}
+
+// Hands the terminal back to plain printing below the last frame
+void term_end_frames() {
+    printf("\n");
+    term_screen.synced = 0;
+}
+
+// One frame of the replacement view: the step, its outcome and the frame
+// table. Frames that do not fit on the screen are summarised in a last line.
+// The frame just filled is highlighted. The detailed view adds a line naming
+// the victim and keeps the table at the same rows whether or not there is one.
+static void draw_replacement_view(int step, int total, int page_no, const ReferenceResult *r, const char *algorithm,
+                                  int detailed) {
+    term_begin_frame();
+    term_print(0, 0, TERM_MAGENTA, "=");
+    term_print(0, 2, TERM_DEFAULT, "Step %2d/%2d | Reference: Page %2d | Algorithm: %-7s", step, total, page_no, algorithm);
+    term_print(0, 60, TERM_MAGENTA, "=");
+    
+    if (r->hit) {
+        term_print(1, 0, TERM_GREEN, "* Page HIT! ");
+        term_print(1, 12, TERM_DEFAULT, "Page %d found in frame %d", page_no, r->frame_no);
+    } else if (r->victim_page < 0) {
+        term_print(1, 0, TERM_YELLOW, "* Page FAULT! ");
+        term_print(1, 14, TERM_DEFAULT, "Loading page %d into free frame %d", page_no, r->frame_no);
+    } else {
+        term_print(1, 0, TERM_RED, "* Page FAULT! ");
+        term_print(1, 14, TERM_DEFAULT, "Replaced page %d (P%d) with page %d in frame %d",
+                   r->victim_page, r->victim_pid, page_no, r->frame_no);
+    }
+    
+    int row = 3;
+    if (detailed) {
+        if (!r->hit && r->victim_page >= 0) {
+            char lead[64];
+            int col = 2 + snprintf(lead, sizeof(lead), "%s selected frame %d, victim: ", algorithm, r->frame_no);
+            term_print(2, 2, TERM_DEFAULT, "%s", lead);
+            term_print(2, col, TERM_RED, "P%d (Process P%d)", r->victim_page, r->victim_pid);
+        }
+        row = 4;
+    }
+    term_print(row++, 0, TERM_MAGENTA, "-------------------------------------------------------------------------");
+    term_print(row++, 0, TERM_MAGENTA, "                    PHYSICAL MEMORY LAYOUT (%2d frames)", frame_count);
+    term_print(row++, 0, TERM_MAGENTA, "-------------------------------------------------------------------------");
+    term_print(row++, 0, TERM_YELLOW, " Frame #  Page #   Process   R-bit   M-bit  Load T.  Status");
+    term_print(row++, 0, TERM_MAGENTA, "-------------------------------------------------------------------------");
+    
+    // Keep the footer and the cursor line on screen (and, in the detailed
+    // view, the step prompt under them)
+    int last_row = term_screen.rows - (detailed ? 6 : 4), used_frames = 0;
+    for (int i = 0; i < frame_count; i++) {
+        const Frame *f = &physical_memory[i];
+        if (f->occupied) used_frames++;
+        if (row > last_row) continue;
+        if (row == last_row && i < frame_count - 1) {
+            term_print(row++, 0, TERM_DEFAULT, "   ... %d more frames", frame_count - i);
+            continue;
+        }
+        
+        term_print(row, 0, i == r->frame_no ? TERM_YELLOW : TERM_CYAN, "   %2d   ", i);
+        if (f->occupied && f->share_count > 1) {
+            term_print(row, 8, TERM_BLUE, "   P%-3d    P%-2d      %d       %d      %3d     Shared x%d",
+                       f->page_no, f->process_id, f->reference_bit, f->modify_bit, f->load_time, f->share_count);
+        } else if (f->occupied) {
+            term_print(row, 8, i == r->frame_no && !r->hit ? TERM_YELLOW : TERM_GREEN,
+                       "   P%-3d    P%-2d      %d       %d      %3d     Used",
+                       f->page_no, f->process_id, f->reference_bit, f->modify_bit, f->load_time);
+        } else {
+            term_print(row, 8, TERM_RED, "   ---    ---     ---     ---    ---     Free");
+        }
+        row++;
+    }
+    term_print(row++, 0, TERM_MAGENTA, "-------------------------------------------------------------------------");
+    term_print(row, 0, TERM_YELLOW, "Memory Usage: ");
+    term_print(row, 14, TERM_DEFAULT, "%d/%d frames (%.1f%%)", used_frames, frame_count,
+               (float)used_frames / frame_count * 100);
+    term_present();
+}
+
+// One animation frame of the replacement view
+void render_replacement_frame(int step, int total, int page_no, const ReferenceResult *r, const char *algorithm) {
+    draw_replacement_view(step, total, page_no, r, algorithm, 0);
+}
+
+// Coloured step-by-step view of one reference; the interactive consumer of
+// reference_page(). Drawn as a frame, so only what the step changed is redrawn
+void render_replacement_step(int step, int total, int page_no, const ReferenceResult *r, const char *algorithm) {
+    draw_replacement_view(step, total, page_no, r, algorithm, 1);
+}
+
+void display_settings_menu() {
+    term_clear();
+    display_header("DISPLAY SETTINGS");
+    
+    printf("\nAnimation step: %d ms\n", animation_ms);
+    if (term_screen.frames > 0) {
+        printf("Renderer: %ld frames drawn, %ld cells rewritten (%.1f per frame)\n", term_screen.frames,
+               term_screen.cells_drawn, (double)term_screen.cells_drawn / term_screen.frames);
+    }
+    
+    printf("\n" COLOR_CYAN "New animation step in ms (0-5000): " COLOR_RESET);
+    int ms;
+    if (scanf("%d", &ms) == 1) {
+        if (ms < 0) ms = 0;
+        if (ms > 5000) ms = 5000;
+        animation_ms = ms;
+    }
+    clear_input_buffer();
+    printf("Animation step set to %d ms\n", animation_ms);
+    
+    printf("\nPress Enter to continue...");
+    getchar();
+}
+
+// Cache Colouring Function Implementations
+
+// Sets up an empty hierarchy; cfg[CACHE_LEVELS - 1] is the last-level cache.
+// Returns 0 if the tag arrays cannot be allocated.
+int cache_init(CacheHierarchy *c, const CacheConfig cfg[CACHE_LEVELS]) {
+    memset(c, 0, sizeof(*c));
+    for (int l = 0; l < CACHE_LEVELS; l++) {
+        CacheLevel *level = &c->level[l];
+        level->cfg = cfg[l];
+        level->sets = (int)((long)cfg[l].size_kb * 1024 / ((long)cfg[l].ways * cfg[l].line_bytes));
+        if (level->sets < 1) level->sets = 1;
+        while ((1 << level->line_shift) < cfg[l].line_bytes) level->line_shift++;
+        
+        size_t slots = (size_t)level->sets * cfg[l].ways;
+        level->lines = (unsigned long long*)malloc(slots * sizeof(unsigned long long));
+        if (level->lines == NULL) {
+            cache_free(c);
+            return 0;
+        }
+        memset(level->lines, 0xff, slots * sizeof(unsigned long long));
+    }
+    return 1;
+}
+
+void cache_free(CacheHierarchy *c) {
+    for (int l = 0; l < CACHE_LEVELS; l++) {
+        free(c->level[l].lines);
+        c->level[l].lines = NULL;
+    }
+}
+
+// Looks the physical address up level by level, stopping at the first hit,
+// and fills the line into every level that missed. Returns the level that
+// hit, CACHE_LEVELS if the load went to memory.
+int cache_access(CacheHierarchy *c, unsigned long long paddr) {
+    for (int l = 0; l < CACHE_LEVELS; l++) {
+        CacheLevel *level = &c->level[l];
+        unsigned long long line = paddr >> level->line_shift;
+        unsigned long long *set = level->lines + (size_t)(line % (unsigned long long)level->sets) * level->cfg.ways;
+        level->accesses++;
+        
+        // Move-to-front: a hit shifts the more recent lines down one way, a
+        // miss shifts the whole set down and drops the least recently used
+        int way = 0;
+        while (way < level->cfg.ways - 1 && set[way] != line) way++;
+        int hit = set[way] == line;
+        memmove(set + 1, set, way * sizeof(unsigned long long));
+        set[0] = line;
+        if (hit) return l;
+        level->misses++;
+    }
+    return CACHE_LEVELS;
+}
+
+// Colours of a physically indexed cache: the pages one way of its sets spans.
+// Frames whose numbers are congruent modulo this compete for the same sets.
+int cache_page_colors(const CacheConfig *llc) {
+    long span = (long)llc->size_kb * 1024 / llc->ways;
+    return span > PAGE_BYTES ? (int)(span / PAGE_BYTES) : 1;
+}
+
+// Runs nproc processes of `pages` pages each through the cache model with
+// their pages placed by the given policy. Memory is four times the working
+// set and half of it, picked at random, is held by other allocations, so the
+// free frames are scattered as on a machine that has been up a while; both
+// policies see the same free frames. Pages are first touched in turn by each
+// process, then, after one warm-up pass over every line, processes take turns
+// issuing 100 random loads to their own pages. Returns 0 if memory cannot be
+// allocated.
+int run_cache_placement(FramePlacement placement, const CacheConfig cfg[CACHE_LEVELS], int nproc, int pages,
+                        long accesses, CachePlacementStats *out) {
+    unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+    int colors = cache_page_colors(&cfg[CACHE_LEVELS - 1]);
+    int line_bytes = cfg[0].line_bytes;
+    int lines_per_page = PAGE_BYTES / line_bytes;
+    int frames = 4 * nproc * pages > 4 * colors ? 4 * nproc * pages : 4 * colors;
+    double level_ns[CACHE_LEVELS + 1] = {1.0, 4.0, 15.0, 80.0};
+    if (host_profile.valid) {
+        level_ns[0] = host_profile.l1_ns;
+        level_ns[1] = host_profile.l2_ns;
+        level_ns[2] = host_profile.llc_ns;
+        level_ns[3] = host_profile.dram_ns;
+    }
+    
+    memset(out, 0, sizeof(*out));
+    out->colors = colors;
+    CacheHierarchy cache;
+    if (!resize_frames(frames) || !cache_init(&cache, cfg)) return 0;
+    
+    process_count = nproc;
+    for (int p = 0; p < nproc; p++) {
+        processes[p].pid = p + 1;
+        snprintf(processes[p].name, sizeof(processes[p].name), "job-%d", p + 1);
+        processes[p].page_count = pages;
+        processes[p].seg_count = 0;
+        for (int i = 0; i < pages; i++) processes[p].page_table[i].page_no = i;
+    }
+    reset_replacement_state();
+    
+    for (int pinned = 0; pinned < frames / 2;) {
+        Frame *f = &physical_memory[fork_rand(&seed) % frames];
+        if (f->occupied) continue;
+        f->occupied = 1;
+        f->process_id = 0;
+        f->share_count = 1;
+        pinned++;
+    }
+    
+    FramePlacement saved_placement = frame_placement;
+    int saved_colors = page_colors;
+    frame_placement = placement;
+    page_colors = colors;
+    for (int i = 0; i < pages; i++) {
+        for (int p = 0; p < nproc; p++) {
+            int f = reference_page(2, p, i, NULL, 0, 0).frame_no;
+            for (int l = 0; l < lines_per_page; l++) {
+                cache_access(&cache, (unsigned long long)f * PAGE_BYTES + (unsigned long long)l * line_bytes);
+            }
+        }
+    }
+    frame_placement = saved_placement;
+    page_colors = saved_colors;
+    
+    int *per_color = (int*)calloc(colors, sizeof(int));
+    if (per_color != NULL) {
+        for (int p = 0; p < nproc; p++) {
+            for (int i = 0; i < pages; i++) per_color[processes[p].page_table[i].frame_no % colors]++;
+        }
+        out->min_per_color = out->max_per_color = per_color[0];
+        for (int c = 1; c < colors; c++) {
+            if (per_color[c] > out->max_per_color) out->max_per_color = per_color[c];
+            if (per_color[c] < out->min_per_color) out->min_per_color = per_color[c];
+        }
+        free(per_color);
+    }
+    
+    for (int l = 0; l < CACHE_LEVELS; l++) {
+        cache.level[l].accesses = 0;
+        cache.level[l].misses = 0;
+    }
+    double total_ns = 0;
+    for (long a = 0; a < accesses; a++) {
+        int p = (int)(a / 100 % nproc);
+        int page = (int)(fork_rand(&seed) % pages);
+        int line = (int)(fork_rand(&seed) % lines_per_page);
+        unsigned long long paddr = (unsigned long long)processes[p].page_table[page].frame_no * PAGE_BYTES +
+                                   (unsigned long long)line * line_bytes;
+        total_ns += level_ns[cache_access(&cache, paddr)];
+    }
+    
+    for (int l = 0; l < CACHE_LEVELS; l++) {
+        out->accesses[l] = cache.level[l].accesses;
+        out->misses[l] = cache.level[l].misses;
+    }
+    out->avg_ns = accesses > 0 ? total_ns / accesses : 0;
+    cache_free(&cache);
+    return 1;
+}
+
+void simulate_cache_coloring() {
+    if (physical_memory == NULL) {
+        printf(COLOR_RED "\nMemory not initialized! Please setup memory frames first.\n" COLOR_RESET);
+        printf("Press Enter to continue...");
+        getchar();
+        return;
+    }
+    
+    term_clear();
+    display_header("CPU CACHE & PAGE COLOURING");
+    
+    printf("\n" COLOR_CYAN "Processes (1-%d): " COLOR_RESET, MAX_PROCESSES);
+    int nproc;
+    if (scanf("%d", &nproc) != 1) nproc = 4;
+    clear_input_buffer();
+    if (nproc < 1) nproc = 1;
+    if (nproc > MAX_PROCESSES) nproc = MAX_PROCESSES;
+    
+    printf(COLOR_CYAN "Pages per process (1-%d): " COLOR_RESET, MAX_PAGES);
+    int pages;
+    if (scanf("%d", &pages) != 1) pages = 16;
+    clear_input_buffer();
+    if (pages < 1) pages = 1;
+    if (pages > MAX_PAGES) pages = MAX_PAGES;
+    
+    printf(COLOR_CYAN "Last-level cache size in KB (128-16384): " COLOR_RESET);
+    int llc_kb;
+    if (scanf("%d", &llc_kb) != 1) llc_kb = 256;
+    clear_input_buffer();
+    if (llc_kb < 128) llc_kb = 128;
+    if (llc_kb > 16384) llc_kb = 16384;
+    
+    printf(COLOR_CYAN "Last-level cache ways (1-32): " COLOR_RESET);
+    int ways;
+    if (scanf("%d", &ways) != 1) ways = 8;
+    clear_input_buffer();
+    if (ways < 1) ways = 1;
+    if (ways > 32) ways = 32;
+    
+    printf(COLOR_CYAN "Loads to simulate (10000-10000000): " COLOR_RESET);
+    long accesses;
+    if (scanf("%ld", &accesses) != 1) accesses = 1000000;
+    clear_input_buffer();
+    if (accesses < 10000) accesses = 10000;
+    if (accesses > 10000000) accesses = 10000000;
+    
+    // L1 fits inside a page so only L2 and the LLC see colours
+    CacheConfig cfg[CACHE_LEVELS] = {{16, 4, 64}, {64, 4, 64}, {llc_kb, ways, 64}};
+    int colors = cache_page_colors(&cfg[CACHE_LEVELS - 1]);
+    
+    SimState user_state;
+    if (!sim_state_capture(&user_state)) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+        return;
+    }
+    
+    CachePlacementStats runs[2];
+    const char *names[2] = {"First free", "Coloured"};
+    int ok = run_cache_placement(PLACE_FIRST_FREE, cfg, nproc, pages, accesses, &runs[0]) &&
+             run_cache_placement(PLACE_COLORED, cfg, nproc, pages, accesses, &runs[1]);
+    
+    sim_state_restore(&user_state);
+    
+    if (!ok) {
+        printf(COLOR_RED "Memory allocation failed!\n" COLOR_RESET);
+    } else {
+        printf("\n" COLOR_GREEN "================================================================\n");
+        printf("                   CACHE PLACEMENT RESULTS\n");
+        printf("================================================================\n" COLOR_RESET);
+        printf("L1 %d KB %d-way, L2 %d KB %d-way, LLC %d KB %d-way, %d-byte lines\n",
+               cfg[0].size_kb, cfg[0].ways, cfg[1].size_kb, cfg[1].ways, llc_kb, ways, cfg[0].line_bytes);
+        printf("Working set %d KB (%d x %d pages) over %d page colours of %d KB each; half of memory pre-allocated\n",
+               nproc * pages * PAGE_SIZE, nproc, pages, colors, llc_kb / colors);
+        printf("Latencies: %s\n\n", host_profile.valid ? "calibrated host profile" : "1 / 4 / 15 / 80 ns (no host profile)");
+        
+        printf(COLOR_YELLOW "%-11s | %8s %8s %8s | %10s | %8s | %s\n" COLOR_RESET, "Placement",
+               "L1 miss", "L2 miss", "LLC miss", "DRAM/kload", "Avg load", "Pages per colour");
+        for (int i = 0; i < 2; i++) {
+            const CachePlacementStats *s = &runs[i];
+            printf("%-11s |", names[i]);
+            for (int l = 0; l < CACHE_LEVELS; l++) {
+                printf(" %7.2f%%", s->accesses[l] > 0 ? 100.0 * s->misses[l] / s->accesses[l] : 0.0);
+            }
+            printf(" | %10.2f | %6.1f ns | %d-%d\n", 1000.0 * s->misses[CACHE_LEVELS - 1] / accesses,
+                   s->avg_ns, s->min_per_color, s->max_per_color);
+        }
+        
+        long naive = runs[0].misses[CACHE_LEVELS - 1], colored = runs[1].misses[CACHE_LEVELS - 1];
+        printf("\nColouring changed LLC misses from %ld to %ld", naive, colored);
+        if (naive > 0) printf(" (%.1f%% fewer)", 100.0 * (naive - colored) / naive);
+        printf(". A colour holds %d pages before its sets overflow.\n", ways);
+        printf("Miss rates are local to each level; DRAM/kload counts loads per 1000 that reach memory.\n");
+    }
+    
+    printf("\nPress Enter to continue...");
+    getchar();
+}